@@ -0,0 +1,88 @@
+/*!
+	\file alloc-hook-math-expr.c
+	\brief
+	This file contains a test hook that counts the calls to malloc(), calloc() and
+	realloc() made between alloc_hook_arm() and alloc_hook_disarm(). It interposes
+	the glibc allocator, so it is only compiled in when MATH_EXPR_ALLOC_HOOK is
+	defined; main() then uses it in --alloc-check mode to prove that evaluating a
+	compiled plan never touches the heap.
+*/
+
+#include "alloc-hook-math-expr.h"
+
+#ifdef MATH_EXPR_ALLOC_HOOK
+
+#include <stddef.h>
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+static _Thread_local char armed = 0;
+static _Thread_local unsigned long calls = 0;
+
+void* malloc(size_t size)
+{
+	if(armed)
+		calls++;
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+	if(armed)
+		calls++;
+	return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+	if(armed)
+		calls++;
+	return __libc_realloc(ptr, size);
+}
+
+#else
+
+static char armed = 0;
+static unsigned long calls = 0;
+
+#endif
+
+/*! \fn char alloc_hook_enabled(void)
+		\brief
+		This function tells whether the hook was compiled in.
+
+		\return 1 if MATH_EXPR_ALLOC_HOOK was defined, 0 otherwise.
+*/
+char alloc_hook_enabled(void)
+{
+#ifdef MATH_EXPR_ALLOC_HOOK
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+/*! \fn void alloc_hook_arm(void)
+		\brief
+		This function starts counting the allocations of the calling thread.
+*/
+void alloc_hook_arm(void)
+{
+	calls = 0;
+	armed = 1;
+}
+
+/*! \fn unsigned long alloc_hook_disarm(void)
+		\brief
+		This function stops counting the allocations of the calling thread.
+
+		\return the number of allocations made since alloc_hook_arm(). Always 0 when
+		the hook is not compiled in.
+*/
+unsigned long alloc_hook_disarm(void)
+{
+	armed = 0;
+	return calls;
+}
@@ -0,0 +1,8 @@
+#ifndef ALLOC_HOOK_MATH_EXPR_H
+#define ALLOC_HOOK_MATH_EXPR_H
+
+char alloc_hook_enabled(void);
+void alloc_hook_arm(void);
+unsigned long alloc_hook_disarm(void);
+
+#endif
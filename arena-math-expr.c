@@ -0,0 +1,114 @@
+/*!
+	\file arena-math-expr.c
+	\brief
+	This file contains a bump allocator (arena) used by the plan compiler. All the
+	memory of a compiled plan is carved out of the chunks of an arena, so a batch of
+	plans is released at once with arena_reset(), which only rewinds the chunk
+	cursor. Chunks are kept after a reset and reused by the next batch, so once the
+	arena has grown to the size of the working set it no longer calls malloc().
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "arena-math-expr.h"
+
+static struct arena_chunk* new_chunk(size_t size)
+{
+	struct arena_chunk* chunk = malloc(sizeof(struct arena_chunk) + size);
+
+	if(chunk == NULL)
+		return NULL;
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+	return chunk;
+}
+
+/*! \fn char arena_init(struct arena* arena, size_t chunk_size)
+		\brief
+		This function initializes an arena and allocates its first chunk.
+
+		\param arena a pointer to the arena to initialize.
+		\param chunk_size the size in bytes of a regular chunk (0 selects ARENA_CHUNK_SIZE).
+		\return 'n' on success, 'm' if the first chunk could not be allocated.
+*/
+char arena_init(struct arena* arena, size_t chunk_size)
+{
+	arena->chunk_size = chunk_size ? chunk_size : ARENA_CHUNK_SIZE;
+	arena->head = new_chunk(arena->chunk_size);
+	arena->current = arena->head;
+	return arena->head ? 'n' : 'm';
+}
+
+/*! \fn void* arena_alloc(struct arena* arena, size_t size, size_t align)
+		\brief
+		This function returns 'size' bytes aligned on 'align' (a power of two) from the
+		arena. When the current chunk is full, the next chunk kept from a previous
+		batch is reused if it is large enough; otherwise a new chunk is inserted after
+		the current one.
+
+		\param arena a pointer to the arena.
+		\param size the number of bytes requested.
+		\param align the required alignment, a power of two.
+		\return a pointer to the memory, or NULL if a new chunk could not be allocated.
+*/
+void* arena_alloc(struct arena* arena, size_t size, size_t align)
+{
+	struct arena_chunk* chunk = arena->current;
+	uintptr_t at;
+
+	for(;;){
+		at = ((uintptr_t)(chunk->data + chunk->used) + (align - 1)) & ~(uintptr_t)(align - 1);
+		if(at + size <= (uintptr_t)(chunk->data + chunk->size)){
+			chunk->used = (size_t)(at - (uintptr_t)chunk->data) + size;
+			arena->current = chunk;
+			return (void*)at;
+		}
+		if(chunk->next == NULL || chunk->next->size < size + align){
+			size_t chunk_size = arena->chunk_size;
+			struct arena_chunk* fresh;
+
+			if(chunk_size < size + align)
+				chunk_size = size + align;
+			fresh = new_chunk(chunk_size);
+			if(fresh == NULL)
+				return NULL;
+			fresh->next = chunk->next;
+			chunk->next = fresh;
+		}
+		chunk = chunk->next;
+		chunk->used = 0;
+	}
+}
+
+/*! \fn void arena_reset(struct arena* arena)
+		\brief
+		This function releases every allocation of the arena in O(1): it rewinds the
+		cursor to the first chunk. The following chunks are rewound lazily when
+		arena_alloc() moves into them.
+
+		\param arena a pointer to the arena.
+*/
+void arena_reset(struct arena* arena)
+{
+	arena->current = arena->head;
+	arena->head->used = 0;
+}
+
+/*! \fn void arena_release(struct arena* arena)
+		\brief
+		This function frees all the chunks of the arena.
+
+		\param arena a pointer to the arena.
+*/
+void arena_release(struct arena* arena)
+{
+	struct arena_chunk* chunk = arena->head;
+
+	while(chunk != NULL){
+		struct arena_chunk* next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	arena->head = arena->current = NULL;
+}
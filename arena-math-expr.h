@@ -0,0 +1,26 @@
+#ifndef ARENA_MATH_EXPR_H
+#define ARENA_MATH_EXPR_H
+
+#include <stddef.h>
+
+#define ARENA_CHUNK_SIZE 65536
+
+struct arena_chunk {
+	struct arena_chunk* next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+struct arena {
+	struct arena_chunk* head;
+	struct arena_chunk* current;
+	size_t chunk_size;
+};
+
+char arena_init(struct arena* arena, size_t chunk_size);
+void* arena_alloc(struct arena* arena, size_t size, size_t align);
+void arena_reset(struct arena* arena);
+void arena_release(struct arena* arena);
+
+#endif
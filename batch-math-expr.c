@@ -0,0 +1,841 @@
+/*!
+	\file batch-math-expr.c
+	\brief
+	This file contains the batch mode of the calculator: it reads one expression
+	per line from stdin, compiles each one into a plan and prints its result. All
+	the plans of a line live in the arena of a single context, which is reset
+	before the next line, so a long run reuses the same memory. Results are
+	formatted into a large output buffer that is written to stdout in blocks.
+	With latencies on, the parse, compile and evaluate phases of every line are
+	timed into histograms, reported on stderr at the end of the run and
+	whenever the process receives SIGUSR1.
+	A line in error prints an error message in place of its result and the run
+	goes on with the next line. With an error column, the line number, code,
+	byte offset and offending token of every error are also written to a file,
+	one tab-separated record per line in error.
+	run_check() only validates the lines: it reads the input in large blocks
+	and checks every line with the functions of check-math-expr.c.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include "plan-math-expr.h"
+#include "check-math-expr.h"
+#include "alloc-hook-math-expr.h"
+#include "perf-math-expr.h"
+#include "format-math-expr.h"
+#include "diff-math-expr.h"
+#include "batch-math-expr.h"
+
+enum batch_phase { PHASE_READ, PHASE_PARSE, PHASE_COMPILE, PHASE_EVALUATE, PHASE_WRITE, PHASES };
+
+static const char* const latency_names[LATENCY_PHASES] = {"parse", "compile", "evaluate"};
+static volatile sig_atomic_t latency_signaled;
+
+/* records the time since '*since' in a phase and moves '*since' to now */
+static void latency_done(struct batch_latency* latency, enum latency_phase phase, uint64_t* since)
+{
+	uint64_t now = histogram_now();
+
+	histogram_record(&latency->phases[phase], now - *since);
+	*since = now;
+}
+
+/*! \fn char bind_var(struct bindings* vars, char* arg)
+		\brief
+		This function records a '--var name=value' argument. The value is kept as
+		text until bind_values() converts it for the arithmetic of the run.
+
+		\param vars the bindings collected so far.
+		\param arg the option argument, modified in place.
+		\return 'n' on success, 's' if the argument is malformed.
+*/
+char bind_var(struct bindings* vars, char* arg)
+{
+	char* eq = strchr(arg, '=');
+
+	if(eq == NULL || eq == arg || vars->count == MAX_BOUND_VARS)
+		return 's';
+	*eq = '\0';
+	vars->names[vars->count] = arg;
+	vars->texts[vars->count] = eq + 1;
+	vars->count++;
+	return 'n';
+}
+
+/*! \fn char bind_values(struct bindings* vars, char arithmetic)
+		\brief
+		This function converts the bound values for the arithmetic of the run, from
+		their text so that the exact modes get them exactly: to doubles, to
+		decimals at their own scale, to rationals or to intervals (where a
+		value may also be a range "lo:hi").
+
+		\return 'n' on success, or the parsing status of the first invalid value.
+*/
+char bind_values(struct bindings* vars, char arithmetic)
+{
+	unsigned int i;
+	char status = 'n';
+	char* end;
+
+	for(i = 0; i < vars->count && status == 'n'; i++){
+		const char* text = vars->texts[i];
+
+		switch(arithmetic){
+			case ARITHMETIC_DOUBLE:
+				vars->values[i] = strtod(text, &end);
+				status = *end == '\0' && end != text ? 'n' : 's';
+				break;
+			case ARITHMETIC_DECIMAL:
+				status = decimal_parse(text, strlen(text), &vars->decimals[i]);
+				break;
+			case ARITHMETIC_RATIONAL:
+				status = rational_parse(text, strlen(text), &vars->rationals[i]);
+				break;
+			case ARITHMETIC_INTERVAL:
+				status = interval_parse(text, strlen(text), &vars->intervals[i]);
+				break;
+		}
+	}
+	return status;
+}
+
+/*! \fn char declare_vars(struct plan_context* ctx, const struct bindings* vars)
+		\brief
+		This function declares the bound variables in a fresh context, in order, so
+		that the slot of each one indexes 'vars->values'.
+
+		\return 'n' on success, or the status of plan_symbol().
+*/
+char declare_vars(struct plan_context* ctx, const struct bindings* vars)
+{
+	unsigned int i, slot;
+	char status = 'n';
+
+	for(i = 0; i < vars->count && status == 'n'; i++)
+		status = plan_symbol(ctx, vars->names[i], strlen(vars->names[i]), &slot);
+	return status;
+}
+
+/*! \fn char declare_functions(struct plan_context* ctx, const char* const* definitions, unsigned int count)
+		\brief
+		This function defines the user functions of the run in a context, after
+		its variables, and reports the first invalid definition on stderr.
+
+		\return 'n' on success, or the status of plan_define().
+*/
+char declare_functions(struct plan_context* ctx, const char* const* definitions, unsigned int count)
+{
+	size_t error_at = 0;
+	unsigned int i;
+	char status = 'n';
+
+	for(i = 0; i < count && status == 'n'; i++)
+		if((status = plan_define(ctx, definitions[i], strlen(definitions[i]), &error_at)) != 'n')
+			fprintf(stderr, "INVALID DEFINITION '%s' at offset %zu\n", definitions[i], error_at);
+	return status;
+}
+
+void batch_latency_init(struct batch_latency* latency)
+{
+	int i;
+
+	for(i = 0; i < LATENCY_PHASES; i++)
+		histogram_init(&latency->phases[i]);
+}
+
+/*! \fn void batch_latency_merge(struct batch_latency* into, const struct batch_latency* from)
+		\brief
+		This function adds the latencies of a worker to a total, see histogram_merge().
+*/
+void batch_latency_merge(struct batch_latency* into, const struct batch_latency* from)
+{
+	int i;
+
+	for(i = 0; i < LATENCY_PHASES; i++)
+		histogram_merge(&into->phases[i], &from->phases[i]);
+}
+
+/*! \fn void batch_latency_report(const struct batch_latency* latency, int format, uint64_t started)
+		\brief
+		This function prints the latencies on stderr, with the throughput since
+		'started', a histogram_now() time stamp. Every expression is parsed, so the
+		parse histogram counts the expressions.
+*/
+void batch_latency_report(const struct batch_latency* latency, int format, uint64_t started)
+{
+	histogram_report(stderr, format, latency_names, latency->phases, LATENCY_PHASES,
+		latency->phases[LATENCY_PARSE].count, (double)(histogram_now() - started) / 1e9);
+}
+
+static void latency_signal(int signal)
+{
+	(void)signal;
+	latency_signaled = 1;
+}
+
+/*! \fn void batch_latency_watch(void)
+		\brief
+		This function makes SIGUSR1 request a report of the latencies, which the
+		batch modes print between two lines (see batch_latency_requested()).
+*/
+void batch_latency_watch(void)
+{
+	struct sigaction action;
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = latency_signal;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGUSR1, &action, NULL);
+}
+
+/*! \fn char batch_latency_requested(void)
+		\brief
+		This function returns 1 once for every SIGUSR1 received since the last call.
+*/
+char batch_latency_requested(void)
+{
+	if(!latency_signaled)
+		return 0;
+	latency_signaled = 0;
+	return 1;
+}
+
+static int is_digit(char c)
+{
+	return (c >= '0' && c <= '9') || c == '.';
+}
+
+static int is_name(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+/* the length of the token at 'at': a number, a name or a single char */
+static size_t token_length(const char* line, size_t len, size_t at)
+{
+	size_t end = at;
+
+	if(at >= len)
+		return 0;
+	if(is_digit(line[at]))
+		while(end < len && is_digit(line[end]))
+			end++;
+	else if(is_name(line[at]))
+		while(end < len && is_name(line[end]))
+			end++;
+	else
+		end++;
+	return end - at;
+}
+
+/*! \fn static void locate_name(const char* line, size_t len, const char* name, struct batch_error* error)
+		\brief
+		This function points an error at the first occurrence of a variable name
+		in the line, as a whole name, or at the end of the line if there is none.
+*/
+static void locate_name(const char* line, size_t len, const char* name, struct batch_error* error)
+{
+	size_t at, name_len = strlen(name);
+
+	for(at = 0; at + name_len <= len; at++)
+		if((at == 0 || !is_name(line[at-1])) && memcmp(line + at, name, name_len) == 0
+			&& (at + name_len == len || !is_name(line[at + name_len]))){
+			error->offset = at;
+			error->token_len = name_len;
+			return;
+		}
+	error->offset = len;
+	error->token_len = 0;
+}
+
+/*! \fn static void undefined_variable(const struct plan_context* ctx, const struct plan* plan, const char* line, size_t len, struct batch_error* error)
+		\brief
+		This function describes the error of a plan that reads an unbound
+		variable: the highest slot it reads is one.
+*/
+static void undefined_variable(const struct plan_context* ctx, const struct plan* plan, const char* line, size_t len, struct batch_error* error)
+{
+	error->status = 'u';
+	locate_name(line, len, ctx->symbols.names[plan->max_slot], error);
+}
+
+/*! \fn size_t batch_error_format(const struct batch_error* error, uint64_t number, const char* line, char* out)
+		\brief
+		This function writes the record of an error in the error column:
+		"number<TAB>code<TAB>offset<TAB>token<NEWLINE>". The token is cut to
+		BATCH_ERROR_TOKEN chars and its control chars are written as '?', so that
+		a record is always one line of four fields.
+
+		\param number the line number, from 1.
+		\param line the line the error is in.
+		\param out a buffer of at least BATCH_ERROR_MAX chars.
+		\return the number of chars written, newline included.
+*/
+size_t batch_error_format(const struct batch_error* error, uint64_t number, const char* line, char* out)
+{
+	const char* code;
+	size_t n, i;
+
+	switch(error->status){
+		case 'u': code = "undefined-variable"; break;
+		case 'd': code = "too-deep"; break;
+		case 'm': code = "out-of-memory"; break;
+		case 'z': code = "division-by-zero"; break;
+		case 'x': code = "inexact-power"; break;
+		case 'f': code = "inexact-function"; break;
+		case 'o': code = "overflow"; break;
+		case 'e': code = "domain-error"; break;
+		default: code = "syntax"; break;
+	}
+	n = (size_t)snprintf(out, BATCH_ERROR_MAX, "%llu\t%s\t%zu\t", (unsigned long long)number, code, error->offset);
+	for(i = 0; i < error->token_len && i < BATCH_ERROR_TOKEN; i++){
+		unsigned char c = (unsigned char)line[error->offset + i];
+
+		out[n++] = c < 0x20 || c == 0x7f ? '?' : (char)c;
+	}
+	out[n++] = '\n';
+	return n;
+}
+
+/*! \fn int batch_errors_open(const struct batch_options* options)
+		\brief
+		This function creates the file of the error column, truncating it.
+
+		\return its file descriptor, or -1 with a message on stderr.
+*/
+int batch_errors_open(const struct batch_options* options)
+{
+	int fd = open(options->errors, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if(fd < 0)
+		fprintf(stderr, "Cannot create the error file '%s'\n", options->errors);
+	return fd;
+}
+
+/*! \fn static size_t error_message(const struct batch_error* error, char* out)
+		\brief
+		This function writes the output line that stands for the result of a line
+		in error.
+*/
+static size_t error_message(const struct batch_error* error, char* out)
+{
+	const char* text;
+	size_t n;
+
+	switch(error->status){
+		case 'u': text = "UNDEFINED VARIABLE\n"; break;
+		case 'd': text = "TOO DEEP\n"; break;
+		case 'm': text = "OUT OF MEMORY\n"; break;
+		case 'z': text = "DIVISION BY ZERO\n"; break;
+		case 'x': text = "INEXACT POWER\n"; break;
+		case 'f': text = "INEXACT FUNCTION\n"; break;
+		case 'o': text = "OVERFLOW\n"; break;
+		case 'e': text = "DOMAIN ERROR\n"; break;
+		default: text = "SYNTAX ERROR\n"; break;
+	}
+	n = strlen(text);
+	memcpy(out, text, n);
+	return n;
+}
+
+/*! \fn static size_t exact_error(char status, struct batch_error* error, char* out)
+		\brief
+		This function records an exact evaluation that failed with 'status' and
+		writes its output line. Evaluation errors have no position: their offset
+		is 0 and their token is empty.
+*/
+static size_t exact_error(char status, struct batch_error* error, char* out)
+{
+	error->status = status == 'u' ? 'f' : (status == 'v' ? 'o' : status);
+	error->offset = error->token_len = 0;
+	return error_message(error, out);
+}
+
+/*! \fn static size_t exact_line(struct plan_context* ctx, const struct plan* plan, const struct plan_literal* literals, const struct batch_options* options,
+	struct batch_error* error, char* out)
+		\brief
+		This function evaluates a plan in one of the arithmetics that start from
+		the exact literals (decimal, rational or interval) and writes its output
+		line, the result or the message of the error recorded in 'error'.
+*/
+static size_t exact_line(struct plan_context* ctx, const struct plan* plan, const struct plan_literal* literals, const struct batch_options* options,
+	struct batch_error* error, char* out)
+{
+	struct decimal decimal;
+	struct rational rational;
+	const __m128d* constants;
+	__m128d interval;
+	char status;
+	size_t n;
+
+	if(options->arithmetic == ARITHMETIC_INTERVAL){
+		if(interval_constants(ctx, plan, literals, &constants) != 'n')
+			return exact_error('m', error, out);
+		evaluate_interval_batch(plan, constants, options->vars.intervals, 0, 1, &interval);
+		if(!interval_defined(interval))
+			return exact_error('e', error, out);
+		n = (size_t)interval_format(interval, out);
+	}
+	else if(options->arithmetic == ARITHMETIC_DECIMAL){
+		if((status = evaluate_decimal(plan, literals, options->vars.decimals, &options->decimal, &decimal)) != 'n')
+			return exact_error(status, error, out);
+		n = (size_t)decimal_format(&decimal, options->decimal.scale, out);
+	}
+	else{
+		if((status = evaluate_rational(plan, literals, options->vars.rationals, &rational)) != 'n')
+			return exact_error(status, error, out);
+		n = (size_t)rational_format(&rational, out);
+	}
+	out[n] = '\n';
+	return n + 1;
+}
+
+/* The measures taken between the phases of a line: latencies when 'latency'
+   is set, hardware counters when 'session' is. */
+struct probe {
+	struct batch_latency* latency;
+	uint64_t since;
+	struct perf_session* session;
+	struct perf_phase* phases;
+	uint64_t samples[2][PERF_VALUES];
+	int now;
+};
+
+static void probe_start(struct probe* probe)
+{
+	if(probe->latency != NULL)
+		probe->since = histogram_now();
+}
+
+/* ends a phase of a line: the latency phases are the parse, compile and evaluate ones */
+static void probe_done(struct probe* probe, enum batch_phase phase)
+{
+	if(probe->latency != NULL && phase >= PHASE_PARSE && phase <= PHASE_EVALUATE)
+		latency_done(probe->latency, (enum latency_phase)(phase - PHASE_PARSE), &probe->since);
+	if(probe->session != NULL){
+		perf_sample(probe->session, probe->samples[!probe->now]);
+		perf_account(&probe->phases[phase], probe->samples[probe->now], probe->samples[!probe->now]);
+		probe->now = !probe->now;
+	}
+}
+
+/*! \fn static char compile_line(struct plan_context* ctx, const char* line, size_t len, const struct batch_options* options, struct probe* probe,
+	struct plan** plan, struct plan_literal** literals, struct diff_tape* tape, struct batch_error* error)
+		\brief
+		This function compiles one line for the arithmetic of the run, and its
+		gradient tape when 'tape' is not NULL, and checks that the variables it
+		reads are bound.
+
+		\return 'n' with the plan, otherwise the status recorded in 'error'.
+*/
+static char compile_line(struct plan_context* ctx, const char* line, size_t len, const struct batch_options* options, struct probe* probe,
+	struct plan** plan, struct plan_literal** literals, struct diff_tape* tape, struct batch_error* error)
+{
+	struct plan_shape shape;
+	char status;
+
+	error->status = parse_plan(ctx, line, len, &shape, &error->offset);
+	probe_done(probe, PHASE_PARSE);
+	if(error->status != 'n'){
+		error->token_len = token_length(line, len, error->offset);
+		return error->status;
+	}
+	if(options->arithmetic == ARITHMETIC_DOUBLE)
+		status = emit_plan(ctx, line, len, &shape, plan);
+	else
+		status = emit_exact_plan(ctx, line, len, &shape, plan, literals);
+	if(status == 'n' && tape != NULL)
+		status = diff_tape_init(ctx, *plan, tape);
+	if(status != 'n'){
+		error->status = 'm';
+		error->offset = error->token_len = 0;
+		return 'm';
+	}
+	probe_done(probe, PHASE_COMPILE);
+	if((*plan)->n_slots > 0 && (*plan)->max_slot >= options->vars.count)
+		undefined_variable(ctx, *plan, line, len, error);
+	return error->status;
+}
+
+/*! \fn size_t batch_line(struct plan_context* ctx, const char* line, size_t len, const struct batch_options* options, struct batch_latency* latency,
+	struct batch_error* error, char* out)
+		\brief
+		This function compiles and evaluates one line and writes its output line,
+		the formatted result or an error, to 'out'. The plan is allocated from the
+		arena of 'ctx', which the caller resets between batches. Gradients are not
+		computed here, they are only printed by run_batch().
+
+		\param ctx a context where the bound variables were declared first.
+		\param line the expression, without its newline.
+		\param len the length of the expression.
+		\param options the options of the run.
+		\param latency the histograms to time the phases into, when options->latency is set.
+		\param error receives the error of the line, its status is 'n' when there is none.
+		\param out a buffer of at least BATCH_LINE_MAX chars.
+		\return the number of chars written to 'out', newline included.
+*/
+size_t batch_line(struct plan_context* ctx, const char* line, size_t len, const struct batch_options* options, struct batch_latency* latency,
+	struct batch_error* error, char* out)
+{
+	struct probe probe = {options->latency ? latency : NULL, 0, NULL, NULL, {{0}}, 0};
+	struct plan* plan;
+	struct plan_literal* literals = NULL;
+	union plan_value result;
+	size_t n;
+	char type;
+
+	probe_start(&probe);
+	if(compile_line(ctx, line, len, options, &probe, &plan, &literals, NULL, error) != 'n')
+		return error_message(error, out);
+	if(options->arithmetic != ARITHMETIC_DOUBLE){
+		n = exact_line(ctx, plan, literals, options, error, out);
+		probe_done(&probe, PHASE_EVALUATE);
+		return n;
+	}
+	type = evaluate_plan_typed(plan, options->vars.values, &result);
+	probe_done(&probe, PHASE_EVALUATE);
+	if(type == 'i')
+		n = (size_t)format_integer(result.i, options->precision, out);
+	else if(options->precision == FORMAT_SHORTEST)
+		n = (size_t)format_shortest(result.f, out);
+	else
+		n = (size_t)format_fixed(result.f, options->precision, out);
+	out[n] = '\n';
+	return n + 1;
+}
+
+/*! \fn int run_batch(struct batch_options* options)
+		\brief
+		This function runs the batch mode. The bound variables are declared first so
+		that their slots index 'options->vars.values'. With 'alloc_check' set, every
+		evaluation runs under the allocation hook and the run fails if any of them
+		called malloc(). With 'profile' set, the hardware counters are sampled between
+		the read, parse, compile, evaluate and write phases of every line and the
+		totals are reported on stderr at the end. With 'latency' set, the parse,
+		compile and evaluate phases are also timed into histograms (see
+		batch_latency_report()).
+
+		Results are printed with 'precision' decimals, or in the shortest form that
+		reads back as the same double when it is FORMAT_SHORTEST; integer results
+		are printed with all their digits. In the exact
+		arithmetics they are printed with the scale of the run (decimal) or as a
+		fraction in lowest terms (rational) instead, and intervals as "[lo, hi]".
+		With 'gradient' set, a double result is followed by its partial
+		derivatives in the order of the bindings, "[d/dx, d/dy]", computed in
+		reverse mode. A line in error prints the message of batch_line() and the
+		run goes on with the next one.
+
+		\param options the options of the run.
+		\return 0 on success, -1 on failure or if an evaluation allocated memory.
+*/
+int run_batch(struct batch_options* options)
+{
+	struct bindings* vars = &options->vars;
+	struct plan_context ctx;
+	struct plan* plan;
+	struct plan_literal* literals = NULL;
+	char text[BATCH_LINE_MAX];
+	struct perf_session session;
+	struct outbuf* out;
+	struct diff_tape tape;
+	double gradient[MAX_BOUND_VARS];
+	struct perf_phase phases[PHASES] = {{"read", {0}, 0}, {"parse", {0}, 0}, {"compile", {0}, 0}, {"evaluate", {0}, 0}, {"write", {0}, 0}};
+	static struct batch_latency latency;
+	struct probe probe = {NULL, 0, NULL, NULL, {{0}}, 0};
+	struct outbuf* errors = NULL;
+	struct batch_error error;
+	char record[BATCH_ERROR_MAX];
+	uint64_t expressions = 0, started = 0;
+	char* line = NULL;
+	size_t capacity = 0;
+	ssize_t len;
+	unsigned long allocations = 0;
+	union plan_value result;
+	char type;
+
+	out = malloc(sizeof(struct outbuf));
+	if(out == NULL || plan_context_init(&ctx) != 'n'){
+		fprintf(stderr, "Out of memory!\n");
+		free(out);
+		return -1;
+	}
+	outbuf_init(out, 1);
+	declare_vars(&ctx, vars);
+	if(declare_functions(&ctx, options->definitions, options->n_definitions) != 'n'){
+		plan_context_release(&ctx);
+		free(out);
+		return -1;
+	}
+	if(options->errors != NULL){
+		int fd = batch_errors_open(options);
+
+		if(fd < 0 || (errors = malloc(sizeof(struct outbuf))) == NULL){
+			if(fd >= 0)
+				close(fd);
+			plan_context_release(&ctx);
+			free(out);
+			return -1;
+		}
+		outbuf_init(errors, fd);
+	}
+
+	if(options->profile){
+		perf_open(&session);
+		probe.session = &session;
+		probe.phases = phases;
+		perf_sample(&session, probe.samples[probe.now]);
+	}
+	if(options->latency){
+		batch_latency_init(&latency);
+		batch_latency_watch();
+		probe.latency = &latency;
+		started = histogram_now();
+	}
+
+	while((len = getline(&line, &capacity, stdin)) >= 0){
+		if(len > 0 && line[len-1] == '\n')
+			len--;
+		plan_context_reset(&ctx);
+		expressions++;
+		probe_done(&probe, PHASE_READ);
+		if(options->latency && batch_latency_requested())
+			batch_latency_report(&latency, options->latency, started);
+		probe_start(&probe);
+
+		if(compile_line(&ctx, line, (size_t)len, options, &probe, &plan, &literals, options->gradient ? &tape : NULL, &error) == 'n'){
+			if(options->alloc_check)
+				alloc_hook_arm();
+			if(options->arithmetic == ARITHMETIC_DOUBLE){
+				type = evaluate_plan_typed(plan, vars->values, &result);
+				if(options->gradient)
+					diff_reverse(plan, vars->values, &tape, vars->count, gradient);
+				if(options->alloc_check)
+					allocations += alloc_hook_disarm();
+				probe_done(&probe, PHASE_EVALUATE);
+				if(type == 'i')
+					outbuf_integer(out, result.i, options->precision);
+				else
+					outbuf_double(out, result.f, options->precision);
+				if(options->gradient){
+					unsigned int i;
+
+					outbuf_write(out, " [", 2);
+					for(i = 0; i < vars->count; i++){
+						if(i > 0)
+							outbuf_write(out, ", ", 2);
+						outbuf_double(out, gradient[i], options->precision);
+					}
+					outbuf_char(out, ']');
+				}
+				outbuf_char(out, '\n');
+			}
+			else{
+				// exact arithmetic formats while evaluating, its result lives on the stack of exact_line()
+				size_t n = exact_line(&ctx, plan, literals, options, &error, text);
+
+				if(options->alloc_check)
+					allocations += alloc_hook_disarm();
+				probe_done(&probe, PHASE_EVALUATE);
+				outbuf_write(out, text, n);
+			}
+		}
+		else
+			outbuf_write(out, text, error_message(&error, text));
+		if(error.status != 'n' && errors != NULL)
+			outbuf_write(errors, record, batch_error_format(&error, expressions, line, record));
+		probe_done(&probe, PHASE_WRITE);
+	}
+
+	free(line);
+	plan_context_release(&ctx);
+	if(options->profile)
+		perf_sample(&session, probe.samples[probe.now]);
+	if(outbuf_flush(out) != 'n')
+		fprintf(stderr, "Cannot write the results!\n");
+	free(out);
+	if(errors != NULL){
+		if(outbuf_flush(errors) != 'n' || close(errors->fd) != 0)
+			fprintf(stderr, "Cannot write the errors!\n");
+		free(errors);
+	}
+
+	if(options->profile){
+		perf_sample(&session, probe.samples[!probe.now]);
+		perf_account(&phases[PHASE_WRITE], probe.samples[probe.now], probe.samples[!probe.now]);
+		perf_report(stderr, &session, phases, PHASES, expressions);
+		perf_close(&session);
+	}
+	if(options->latency)
+		batch_latency_report(&latency, options->latency, started);
+	if(allocations != 0){
+		fprintf(stderr, "alloc-check: evaluation performed %lu heap allocations\n", allocations);
+		return -1;
+	}
+	return 0;
+}
+
+/* The scan of the incomplete line at the end of a block, kept across the
+   refills of run_check() so that a long line is scanned once. */
+struct check_scan {
+	size_t scanned;   // bytes of the line known to hold no newline
+	size_t rejected;  // offset of its first rejected char, or SIZE_MAX
+};
+
+/*! \fn static size_t check_block(struct plan_context* ctx, const char* text, size_t len, char eof, uint64_t* number, struct outbuf* out,
+	struct outbuf* errors, struct check_scan* scan, char* invalid)
+		\brief
+		This function checks the whole lines at the start of a block of input, and
+		the last line too at the end of the input. The scan of check_chars() that
+		rejects a bad char also stops at the newline, so a valid line is read once
+		before its syntax is checked. The scan of an incomplete last line resumes
+		where 'scan' left it at the next call.
+
+		\param number the number of the last line checked, updated.
+		\param scan the scan of the line at the start of 'text', updated.
+		\param invalid set when a line is not valid.
+		\return the number of bytes used, the rest is an incomplete line.
+*/
+static size_t check_block(struct plan_context* ctx, const char* text, size_t len, char eof, uint64_t* number, struct outbuf* out,
+	struct outbuf* errors, struct check_scan* scan, char* invalid)
+{
+	struct plan_shape shape;
+	struct batch_error error;
+	char record[BATCH_ERROR_MAX], message[BATCH_LINE_MAX];
+	size_t start = 0, at, end;
+	const char* newline;
+
+	while(start < len){
+		if(scan->rejected != SIZE_MAX)
+			at = start + scan->rejected;
+		else
+			at = start + scan->scanned + check_chars(text + start + scan->scanned, len - start - scan->scanned);
+		end = at;
+		if(at < len && text[at] != '\n'){
+			size_t from = start + scan->scanned > at ? start + scan->scanned : at;
+
+			end = (newline = memchr(text + from, '\n', len - from)) != NULL ? (size_t)(newline - text) : len;
+		}
+		if(end == len && !eof){
+			scan->scanned = len - start;
+			scan->rejected = at < end ? at - start : SIZE_MAX;
+			break;
+		}
+		scan->scanned = 0;
+		scan->rejected = SIZE_MAX;
+
+		++*number;
+		if(at < end){
+			error.status = 's';
+			error.offset = at - start;
+		}
+		else
+			error.status = parse_plan(ctx, text + start, end - start, &shape, &error.offset);
+		if(error.status == 'n')
+			outbuf_write(out, "OK\n", 3);
+		else{
+			*invalid = 1;
+			outbuf_write(out, message, error_message(&error, message));
+			if(errors != NULL){
+				error.token_len = token_length(text + start, end - start, error.offset);
+				outbuf_write(errors, record, batch_error_format(&error, *number, text + start, record));
+			}
+		}
+		start = end < len ? end + 1 : len;
+	}
+	return start;
+}
+
+/*! \fn int run_check(struct batch_options* options)
+		\brief
+		This function runs the validation mode: every line of stdin is checked as
+		by check_expression() and "OK", "SYNTAX ERROR" or "TOO DEEP" is printed for
+		it, with a record in the error column for the latter two. Nothing is compiled or
+		evaluated, so the variables need not be bound; the user functions of the
+		options may be called. Input is read in blocks of BATCH_CHECK_BUFFER bytes,
+		grown for longer lines.
+
+		\param options the options of the run.
+		\return 0 if every line is valid, 1 if some line is not, -1 on failure.
+*/
+int run_check(struct batch_options* options)
+{
+	struct plan_context ctx;
+	struct outbuf* out = malloc(sizeof(struct outbuf));
+	struct outbuf* errors = NULL;
+	struct check_scan scan = {0, SIZE_MAX};
+	char* text = malloc(BATCH_CHECK_BUFFER);
+	size_t capacity = BATCH_CHECK_BUFFER, len = 0, used;
+	uint64_t number = 0;
+	ssize_t n;
+	char eof = 0, invalid = 0, failed = 0;
+	int fd = -1;
+
+	if(out == NULL || text == NULL || plan_context_init(&ctx) != 'n'){
+		fprintf(stderr, "Out of memory!\n");
+		free(out);
+		free(text);
+		return -1;
+	}
+	outbuf_init(out, 1);
+	if(declare_functions(&ctx, options->definitions, options->n_definitions) != 'n'
+		|| (options->errors != NULL && ((fd = batch_errors_open(options)) < 0 || (errors = malloc(sizeof(struct outbuf))) == NULL))){
+		if(fd >= 0)
+			close(fd);
+		plan_context_release(&ctx);
+		free(out);
+		free(text);
+		return -1;
+	}
+	if(errors != NULL)
+		outbuf_init(errors, fd);
+
+	while(!eof){
+		if(len == capacity){
+			char* grown = realloc(text, 2 * capacity);
+
+			if(grown == NULL){
+				fprintf(stderr, "Out of memory!\n");
+				failed = 1;
+				break;
+			}
+			text = grown;
+			capacity *= 2;
+		}
+		n = read(0, text + len, capacity - len);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n < 0){
+			fprintf(stderr, "Cannot read the input!\n");
+			failed = 1;
+			break;
+		}
+		eof = n == 0;
+		len += (size_t)n;
+		used = check_block(&ctx, text, len, eof, &number, out, errors, &scan, &invalid);
+		memmove(text, text + used, len - used);
+		len -= used;
+	}
+
+	if(outbuf_flush(out) != 'n'){
+		fprintf(stderr, "Cannot write the results!\n");
+		failed = 1;
+	}
+	if(errors != NULL){
+		if(outbuf_flush(errors) != 'n' || close(errors->fd) != 0){
+			fprintf(stderr, "Cannot write the errors!\n");
+			failed = 1;
+		}
+		free(errors);
+	}
+	plan_context_release(&ctx);
+	free(out);
+	free(text);
+	return failed ? -1 : invalid;
+}
@@ -0,0 +1,91 @@
+#ifndef BATCH_MATH_EXPR_H
+#define BATCH_MATH_EXPR_H
+
+#include <stddef.h>
+#include "plan-math-expr.h"
+#include "decimal-math-expr.h"
+#include "rational-math-expr.h"
+#include "interval-math-expr.h"
+#include "histogram-math-expr.h"
+
+#define MAX_BOUND_VARS 64
+#define MAX_DEFINITIONS 64
+#define BATCH_LINE_MAX (RATIONAL_FORMAT_MAX + 1)  // longest output line of batch_line(), newline included
+#define BATCH_ERROR_TOKEN 32   // longest token quoted in an error record
+#define BATCH_ERROR_MAX (BATCH_ERROR_TOKEN + 64)  // longest record of batch_error_format(), newline included
+#define BATCH_CHECK_BUFFER (1 << 20)  // input block of run_check(), grown for longer lines
+
+enum batch_arithmetic {
+	ARITHMETIC_DOUBLE,
+	ARITHMETIC_DECIMAL,
+	ARITHMETIC_RATIONAL,
+	ARITHMETIC_INTERVAL
+};
+
+enum latency_phase {
+	LATENCY_PARSE,
+	LATENCY_COMPILE,
+	LATENCY_EVALUATE,
+	LATENCY_PHASES
+};
+
+struct batch_latency {
+	struct histogram phases[LATENCY_PHASES];  // nanoseconds per expression
+};
+
+/* The error of a line, written as a record of the error column: the line
+   number, a code, the byte offset and the offending token. */
+struct batch_error {
+	char status;       // 'n' when the line has none, 's' syntax, 'd' too deep, 'm' out of memory,
+	                   // 'u' undefined variable, and from the exact arithmetics
+	                   // 'z' division by zero, 'x' inexact power, 'f' inexact function, 'o' overflow,
+	                   // and from the interval arithmetic 'e' domain error
+	size_t offset;     // byte offset of the error in the line
+	size_t token_len;  // length of the token at 'offset', 0 at the end of the line
+};
+
+struct bindings {
+	const char* names[MAX_BOUND_VARS];
+	const char* texts[MAX_BOUND_VARS];  // the values as written
+	double values[MAX_BOUND_VARS];      // the values are filled by bind_values() for the arithmetic of the run
+	struct decimal decimals[MAX_BOUND_VARS];
+	struct rational rationals[MAX_BOUND_VARS];
+	__m128d intervals[MAX_BOUND_VARS];
+	unsigned int count;
+};
+
+struct batch_options {
+	struct bindings vars;
+	const char* definitions[MAX_DEFINITIONS];  // user functions, "f(x) = body"
+	unsigned int n_definitions;
+	char alloc_check;  // count heap allocations made while evaluating
+	char profile;      // report hardware counters per phase on stderr
+	int precision;     // decimals of the results, or FORMAT_SHORTEST
+	char pipeline;     // overlap reading, evaluation and writing in threads
+	unsigned int workers;
+	const char* affinity;  // CPUs of the pipeline workers: a list such as "0-3,8", or "cores"
+	const char* io_cpus;   // "R,W": CPUs reserved for the pipeline reader and writer
+	char latency;          // an enum histogram_format to report latencies in, 0 to not record them
+	const char* errors;    // the file of the error column, NULL when it is not written
+	char arithmetic;   // an enum batch_arithmetic
+	char gradient;     // also print the partial derivatives of the bound variables
+	struct decimal_mode decimal;
+};
+
+char bind_var(struct bindings* vars, char* arg);
+char bind_values(struct bindings* vars, char arithmetic);
+char declare_vars(struct plan_context* ctx, const struct bindings* vars);
+char declare_functions(struct plan_context* ctx, const char* const* definitions, unsigned int count);
+size_t batch_line(struct plan_context* ctx, const char* line, size_t len, const struct batch_options* options, struct batch_latency* latency,
+	struct batch_error* error, char* out);
+size_t batch_error_format(const struct batch_error* error, uint64_t number, const char* line, char* out);
+int batch_errors_open(const struct batch_options* options);
+void batch_latency_init(struct batch_latency* latency);
+void batch_latency_merge(struct batch_latency* into, const struct batch_latency* from);
+void batch_latency_report(const struct batch_latency* latency, int format, uint64_t started);
+void batch_latency_watch(void);
+char batch_latency_requested(void);
+int run_batch(struct batch_options* options);
+int run_check(struct batch_options* options);
+
+#endif
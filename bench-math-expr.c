@@ -0,0 +1,856 @@
+/*!
+	\file bench-math-expr.c
+	\brief
+	This file contains the benchmark suite. For every corpus generated by
+	corpus-math-expr.c it times three phases separately: parse-only (parse_plan),
+	compile-only (emit_plan of an already measured expression) and evaluate-only
+	(evaluate_plan of a compiled plan). Expressions are timed in chunks of
+	BENCH_CHUNK and the per-expression time of every chunk feeds the percentiles,
+	which keeps the clock overhead out of the measurements. Results are printed as
+	text, JSON or CSV so that runs can be compared to gate regressions.
+
+	The layout mode compiles distinct formulas into one context and evaluates
+	them round-robin, so that every evaluation touches a plan that has likely been
+	evicted from the caches, then compares it with evaluating a single hot plan.
+	The gap between the two is the cost of the plan layout in cache misses.
+
+	The rings mode measures the throughput of lock-free rings when they carry
+	batches of pre-sliced expressions, for growing batch sizes: one producer and
+	one consumer on the SPSC ring of ring-math-expr.h, which the pipeline uses,
+	and two of each on the multi-producer multi-consumer ring below, which it
+	is compared with.
+
+	The gradient mode computes the gradient of formulas over x0..x7 three ways:
+	by central finite differences (two evaluations per variable), in forward
+	mode (two passes of DIFF_LANES directions) and in reverse mode (one pass
+	over a tape), and reports the largest gap between the two exact methods.
+
+	The functions mode times the built-in functions evaluated in blocks by
+	evaluate_plan_rows() against calling libm once per element, over
+	BENCH_FUNCTION_SIZE arguments.
+
+	The columns mode evaluates a*b+c*d-e over BENCH_COLUMN_ROWS rows of five
+	columns, row by row with evaluate_plan() and in blocks with
+	evaluate_plan_rows(), and reduces sum(a*b+c*d-e) with reduce_plan_rows(),
+	the last two with every instruction set of the CPU (see column_isa()). It
+	reports the time per row and the bandwidth of reading the columns and
+	writing the result once.
+
+	Usage: bench-math-expr [--corpus KIND|all] [--count N] [--seed S]
+	                       [--format text|json|csv] [--layout N] [--rings] [--gradient]
+	                       [--functions] [--columns] [--emit]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include "plan-math-expr.h"
+#include "corpus-math-expr.h"
+#include "ring-math-expr.h"
+#include "diff-math-expr.h"
+#include "function-math-expr.h"
+#include "column-math-expr.h"
+
+#define BENCH_CHUNK 64
+#define BENCH_PASSES 10
+#define BENCH_RING_ITEMS 4000000
+#define BENCH_RING_BATCHES 64
+#define BENCH_FUNCTION_SIZE 4096
+#define BENCH_COLUMN_ROWS (1u << 21)
+
+enum bench_phase { BENCH_PARSE, BENCH_COMPILE, BENCH_EVALUATE, BENCH_PHASES };
+
+static const char* phase_names[BENCH_PHASES] = {"parse", "compile", "evaluate"};
+
+struct bench_result {
+	const char* corpus;
+	const char* phase;
+	unsigned int count;
+	size_t bytes;
+	double total_ns;
+	double p50, p90, p99, p999, max;
+};
+
+struct bench_state {
+	struct plan_context ctx;
+	double vars[CORPUS_VARS];
+	double sink;
+};
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare_doubles(const void* a, const void* b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+static double percentile(const double* sorted, unsigned int n, double p)
+{
+	unsigned int i = (unsigned int)(p * (n - 1) + 0.5);
+	return sorted[i < n ? i : n - 1];
+}
+
+/*! \fn static void summarize(struct bench_result* result, double* chunks, unsigned int n_chunks)
+		\brief
+		This function sorts the per-expression times of the chunks and fills the
+		percentiles of 'result'.
+*/
+static void summarize(struct bench_result* result, double* chunks, unsigned int n_chunks)
+{
+	qsort(chunks, n_chunks, sizeof(double), compare_doubles);
+	result->p50 = percentile(chunks, n_chunks, 0.50);
+	result->p90 = percentile(chunks, n_chunks, 0.90);
+	result->p99 = percentile(chunks, n_chunks, 0.99);
+	result->p999 = percentile(chunks, n_chunks, 0.999);
+	result->max = chunks[n_chunks - 1];
+}
+
+/*! \fn static char bench_corpus(struct bench_state* bench, const struct corpus* corpus, struct bench_result results[BENCH_PHASES])
+		\brief
+		This function times the parse, compile and evaluate phases over a corpus.
+		Every phase runs over the whole corpus before the next one starts.
+*/
+static char bench_corpus(struct bench_state* bench, const struct corpus* corpus, struct bench_result results[BENCH_PHASES])
+{
+	unsigned int n_chunks = (corpus->count + BENCH_CHUNK - 1) / BENCH_CHUNK;
+	struct plan_shape* shapes = malloc(corpus->count * sizeof(struct plan_shape));
+	struct plan** plans = malloc(corpus->count * sizeof(struct plan*));
+	double* chunks = malloc(n_chunks * BENCH_PASSES * sizeof(double));
+	unsigned int i, c, phase, pass;
+	double start;
+	char status = 'n';
+
+	if(shapes == NULL || plans == NULL || chunks == NULL){
+		status = 'm';
+		goto done;
+	}
+	plan_context_reset(&bench->ctx);
+
+	for(phase = 0; phase < BENCH_PHASES && status == 'n'; phase++){
+		struct bench_result* result = &results[phase];
+		unsigned int passes = phase == BENCH_EVALUATE ? BENCH_PASSES : 1;
+		unsigned int timed = 0;
+
+		result->corpus = corpus->kind;
+		result->phase = phase_names[phase];
+		result->count = corpus->count * passes;
+		result->bytes = corpus->bytes * passes;
+		result->total_ns = 0;
+
+		for(pass = 0; pass < passes; pass++){
+			for(c = 0; c < n_chunks; c++){
+				unsigned int first = c * BENCH_CHUNK;
+				unsigned int last = first + BENCH_CHUNK < corpus->count ? first + BENCH_CHUNK : corpus->count;
+
+				start = now_ns();
+				for(i = first; i < last && status == 'n'; i++){
+					const char* src = corpus->text + corpus->offsets[i];
+					size_t len = corpus->offsets[i+1] - corpus->offsets[i] - 1;
+
+					if(phase == BENCH_PARSE)
+						status = parse_plan(&bench->ctx, src, len, &shapes[i], NULL);
+					else if(phase == BENCH_COMPILE)
+						status = emit_plan(&bench->ctx, src, len, &shapes[i], &plans[i]);
+					else
+						bench->sink += evaluate_plan(plans[i], bench->vars);
+				}
+				chunks[timed] = now_ns() - start;
+				result->total_ns += chunks[timed];
+				chunks[timed] /= last - first;
+				timed++;
+			}
+		}
+		summarize(result, chunks, timed);
+	}
+
+done:
+	free(shapes);
+	free(plans);
+	free(chunks);
+	return status;
+}
+
+static void print_results(const char* format, const struct bench_result* results, unsigned int n, uint64_t seed)
+{
+	unsigned int i;
+
+	if(strcmp(format, "json") == 0){
+		printf("{\"seed\": %llu, \"results\": [\n", (unsigned long long)seed);
+		for(i = 0; i < n; i++){
+			const struct bench_result* r = &results[i];
+			printf("  {\"corpus\": \"%s\", \"phase\": \"%s\", \"count\": %u, \"bytes\": %zu, "
+				"\"mean_ns\": %.2f, \"p50_ns\": %.2f, \"p90_ns\": %.2f, \"p99_ns\": %.2f, \"p999_ns\": %.2f, \"max_ns\": %.2f, "
+				"\"expr_per_s\": %.0f, \"mb_per_s\": %.2f}%s\n",
+				r->corpus, r->phase, r->count, r->bytes, r->total_ns / r->count, r->p50, r->p90, r->p99, r->p999, r->max,
+				r->count / r->total_ns * 1e9, r->bytes / r->total_ns * 1e3, i + 1 < n ? "," : "");
+		}
+		printf("]}\n");
+	}
+	else if(strcmp(format, "csv") == 0){
+		printf("corpus,phase,count,bytes,mean_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns,expr_per_s,mb_per_s\n");
+		for(i = 0; i < n; i++){
+			const struct bench_result* r = &results[i];
+			printf("%s,%s,%u,%zu,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.0f,%.2f\n",
+				r->corpus, r->phase, r->count, r->bytes, r->total_ns / r->count, r->p50, r->p90, r->p99, r->p999, r->max,
+				r->count / r->total_ns * 1e9, r->bytes / r->total_ns * 1e3);
+		}
+	}
+	else{
+		printf("%-9s %-9s %10s %10s %10s %10s %10s %12s\n", "corpus", "phase", "mean ns", "p50", "p99", "p99.9", "max", "MB/s");
+		for(i = 0; i < n; i++){
+			const struct bench_result* r = &results[i];
+			printf("%-9s %-9s %10.1f %10.1f %10.1f %10.1f %10.1f %12.1f\n", r->corpus, r->phase,
+				r->total_ns / r->count, r->p50, r->p99, r->p999, r->max, r->bytes / r->total_ns * 1e3);
+		}
+	}
+}
+
+/*! \fn static char bench_layout(struct bench_state* bench, unsigned int formulas, uint64_t seed)
+		\brief
+		This function compares round-robin evaluation of 'formulas' distinct plans
+		with the evaluation of a single hot plan.
+*/
+static char bench_layout(struct bench_state* bench, unsigned int formulas, uint64_t seed)
+{
+	struct corpus corpus;
+	struct plan** plans;
+	struct plan_shape shape;
+	double start, round_robin, hot;
+	size_t bytes = 0;
+	unsigned int i, pass;
+	char status;
+
+	if((status = corpus_generate(&corpus, "layout", formulas, seed)) != 'n')
+		return status;
+	if((plans = malloc(formulas * sizeof(struct plan*))) == NULL)
+		return 'm';
+	plan_context_reset(&bench->ctx);
+	for(i = 0; i < formulas && status == 'n'; i++){
+		const char* src = corpus.text + corpus.offsets[i];
+		size_t len = corpus.offsets[i+1] - corpus.offsets[i] - 1;
+
+		if((status = parse_plan(&bench->ctx, src, len, &shape, NULL)) == 'n')
+			status = emit_plan(&bench->ctx, src, len, &shape, &plans[i]);
+		bytes += plan_size(&shape);
+	}
+	if(status == 'n'){
+		start = now_ns();
+		for(pass = 0; pass < BENCH_PASSES; pass++)
+			for(i = 0; i < formulas; i++)
+				bench->sink += evaluate_plan(plans[i], bench->vars);
+		round_robin = (now_ns() - start) / ((double)BENCH_PASSES * formulas);
+
+		start = now_ns();
+		for(pass = 0; pass < BENCH_PASSES; pass++)
+			for(i = 0; i < formulas; i++)
+				bench->sink += evaluate_plan(plans[0], bench->vars);
+		hot = (now_ns() - start) / ((double)BENCH_PASSES * formulas);
+
+		printf("formulas:            %u\n", formulas);
+		printf("plan size (avg):     %.1f bytes, %.2f cache lines\n", (double)bytes / formulas, (double)bytes / formulas / 64);
+		printf("round-robin:         %.2f ns/eval\n", round_robin);
+		printf("hot plan:            %.2f ns/eval\n", hot);
+	}
+	free(plans);
+	corpus_free(&corpus);
+	return status;
+}
+
+/*! \fn static char bench_gradient(struct bench_state* bench, unsigned int count, uint64_t seed)
+		\brief
+		This function times finite differences, forward mode and reverse mode on
+		'count' formulas of the layout corpus, per gradient of CORPUS_VARS entries.
+*/
+static char bench_gradient(struct bench_state* bench, unsigned int count, uint64_t seed)
+{
+	static double seeds[CORPUS_VARS * CORPUS_VARS];
+	struct corpus corpus;
+	struct plan** plans;
+	struct diff_tape* tapes;
+	struct plan_shape shape;
+	double vars[CORPUS_VARS], forward[CORPUS_VARS], reverse[CORPUS_VARS];
+	double start, elapsed[3], gap = 0;
+	unsigned int i, j, pass;
+	char status;
+
+	if((status = corpus_generate(&corpus, "layout", count, seed)) != 'n')
+		return status;
+	plans = malloc(count * sizeof(struct plan*));
+	tapes = malloc(count * sizeof(struct diff_tape));
+	if(plans == NULL || tapes == NULL){
+		free(plans);
+		free(tapes);
+		corpus_free(&corpus);
+		return 'm';
+	}
+	plan_context_reset(&bench->ctx);
+	for(i = 0; i < count && status == 'n'; i++){
+		const char* src = corpus.text + corpus.offsets[i];
+		size_t len = corpus.offsets[i+1] - corpus.offsets[i] - 1;
+
+		if((status = parse_plan(&bench->ctx, src, len, &shape, NULL)) == 'n')
+			status = emit_plan(&bench->ctx, src, len, &shape, &plans[i]);
+		if(status == 'n')
+			status = diff_tape_init(&bench->ctx, plans[i], &tapes[i]);
+	}
+	for(j = 0; j < CORPUS_VARS; j++)
+		seeds[j * CORPUS_VARS + j] = 1;
+
+	if(status == 'n'){
+		start = now_ns();
+		for(pass = 0; pass < BENCH_PASSES; pass++)
+			for(i = 0; i < count; i++)
+				for(j = 0; j < CORPUS_VARS; j++){
+					double h = 1e-6 * bench->vars[j];
+
+					memcpy(vars, bench->vars, sizeof(vars));
+					vars[j] += h;
+					bench->sink += evaluate_plan(plans[i], vars);
+					vars[j] -= 2 * h;
+					bench->sink -= evaluate_plan(plans[i], vars);
+				}
+		elapsed[0] = (now_ns() - start) / ((double)BENCH_PASSES * count);
+
+		start = now_ns();
+		for(pass = 0; pass < BENCH_PASSES; pass++)
+			for(i = 0; i < count; i++){
+				bench->sink += diff_forward(plans[i], bench->vars, seeds, CORPUS_VARS, CORPUS_VARS, forward);
+				bench->sink += forward[CORPUS_VARS-1];
+			}
+		elapsed[1] = (now_ns() - start) / ((double)BENCH_PASSES * count);
+
+		start = now_ns();
+		for(pass = 0; pass < BENCH_PASSES; pass++)
+			for(i = 0; i < count; i++){
+				bench->sink += diff_reverse(plans[i], bench->vars, &tapes[i], CORPUS_VARS, reverse);
+				bench->sink += reverse[CORPUS_VARS-1];
+			}
+		elapsed[2] = (now_ns() - start) / ((double)BENCH_PASSES * count);
+
+		for(i = 0; i < count; i++){
+			diff_forward(plans[i], bench->vars, seeds, CORPUS_VARS, CORPUS_VARS, forward);
+			diff_reverse(plans[i], bench->vars, &tapes[i], CORPUS_VARS, reverse);
+			for(j = 0; j < CORPUS_VARS; j++){
+				double scale = fabs(reverse[j]) > 1 ? fabs(reverse[j]) : 1;
+
+				if(fabs(forward[j] - reverse[j]) / scale > gap)
+					gap = fabs(forward[j] - reverse[j]) / scale;
+			}
+		}
+
+		printf("formulas:            %u, %u variables\n", count, CORPUS_VARS);
+		printf("finite differences:  %.2f ns/gradient\n", elapsed[0]);
+		printf("forward mode:        %.2f ns/gradient\n", elapsed[1]);
+		printf("reverse mode:        %.2f ns/gradient\n", elapsed[2]);
+		printf("forward/reverse gap: %.3g (relative)\n", gap);
+	}
+	free(plans);
+	free(tapes);
+	corpus_free(&corpus);
+	return status;
+}
+
+/*! \fn static char bench_functions(struct bench_state* bench, unsigned int count, uint64_t seed)
+		\brief
+		This function times each built-in function over a column, evaluated by
+		the block kernel of the instruction set in use, and the matching libm
+		loop over 'count' passes of BENCH_FUNCTION_SIZE arguments, in ns per
+		element.
+*/
+static char bench_functions(struct bench_state* bench, unsigned int count, uint64_t seed)
+{
+	static const char* names[] = {"sqrt", "exp", "log", "sin"};
+	static const char* texts[] = {"sqrt(x0)", "exp(x0)", "log(x0)", "sin(x0)"};
+	static double x[BENCH_FUNCTION_SIZE], y[BENCH_FUNCTION_SIZE];
+	const double* columns[1] = {x};
+	double start, elapsed[2];
+	struct plan* plan;
+	size_t error_at;
+	unsigned int f, i, pass;
+
+	for(i = 0; i < BENCH_FUNCTION_SIZE; i++){
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		x[i] = (seed >> 11) * 0x1p-53 * 20.0 + 1e-3;  // in (0, 20]
+	}
+	printf("%-6s %12s %12s\n", "", "libm", column_isa_name());
+	for(f = 0; f < sizeof(names) / sizeof(names[0]); f++){
+		start = now_ns();
+		for(pass = 0; pass < count; pass++){
+			for(i = 0; i < BENCH_FUNCTION_SIZE; i++)
+				y[i] = f == 0 ? sqrt(x[i]) : f == 1 ? exp(x[i]) : f == 2 ? log(x[i]) : sin(x[i]);
+			bench->sink += y[pass % BENCH_FUNCTION_SIZE];
+		}
+		elapsed[0] = (now_ns() - start) / ((double)count * BENCH_FUNCTION_SIZE);
+
+		plan_context_reset(&bench->ctx);
+		if(compile_plan(&bench->ctx, texts[f], strlen(texts[f]), &plan, &error_at) != 'n')
+			return 'm';
+		start = now_ns();
+		for(pass = 0; pass < count; pass++){
+			evaluate_plan_rows(plan, columns, 1, 0, BENCH_FUNCTION_SIZE, y);
+			bench->sink += y[pass % BENCH_FUNCTION_SIZE];
+		}
+		elapsed[1] = (now_ns() - start) / ((double)count * BENCH_FUNCTION_SIZE);
+		printf("%-6s %9.2f ns %9.2f ns\n", names[f], elapsed[0], elapsed[1]);
+	}
+	return 'n';
+}
+
+/*! \fn static char bench_columns(struct bench_state* bench)
+		\brief
+		This function times the columnar evaluation of a*b+c*d-e (see the file
+		comment) with every instruction set of the CPU, as the best of
+		BENCH_PASSES passes.
+*/
+static char bench_columns(struct bench_state* bench)
+{
+	static const char* isas[] = {"sse2", "avx2", "avx512"};
+	const char* text = "x0*x1+x2*x3-x4";
+	struct column_reduction reduction;
+	const double* columns[CORPUS_VARS];
+	double* data = malloc((size_t)6 * BENCH_COLUMN_ROWS * sizeof(double));
+	double* out = data + (size_t)5 * BENCH_COLUMN_ROWS;
+	double vars[CORPUS_VARS], start, best;
+	struct plan* plan;
+	size_t error_at;
+	unsigned int i, c, pass, way, isa;
+
+	if(data == NULL)
+		return 'm';
+	if(compile_plan(&bench->ctx, text, strlen(text), &plan, &error_at) != 'n'){
+		free(data);
+		return 'm';
+	}
+	for(c = 0; c < CORPUS_VARS; c++)
+		columns[c] = data + (size_t)(c < 5 ? c : 0) * BENCH_COLUMN_ROWS;
+	for(i = 0; i < 5 * BENCH_COLUMN_ROWS; i++)
+		data[i] = 1.0 + (i % 1000) / 1000.0;
+
+	printf("%-8s %-8s %10s %10s\n", "", "isa", "ns/row", "GB/s");
+	for(way = 0; way < 3; way++){
+		for(isa = 0; isa < 3; isa++){
+			if(way == 0 ? isa > 0 : column_isa(isas[isa]) != 'n')
+				continue;  // the row by row evaluator has a single build
+			best = 1e300;
+			for(pass = 0; pass < BENCH_PASSES; pass++){
+				start = now_ns();
+				if(way == 0)
+					for(i = 0; i < BENCH_COLUMN_ROWS; i++){
+						for(c = 0; c < 5; c++)
+							vars[c] = columns[c][i];
+						out[i] = evaluate_plan(plan, vars);
+					}
+				else if(way == 1)
+					evaluate_plan_rows(plan, columns, CORPUS_VARS, 0, BENCH_COLUMN_ROWS, out);
+				else{
+					reduce_plan_rows(plan, columns, CORPUS_VARS, 0, BENCH_COLUMN_ROWS, SUMMATION_PLAIN, &reduction);
+					out[pass] = column_reduction_result(&reduction, 1, AGGREGATE_SUM, SUMMATION_PLAIN);
+				}
+				bench->sink += out[pass];
+				if(now_ns() - start < best)
+					best = now_ns() - start;
+			}
+			// five columns read, and one written except by the reduction
+			printf("%-8s %-8s %10.3f %10.2f\n", way == 0 ? "rows" : way == 1 ? "blocks" : "reduce", way == 0 ? "-" : isas[isa],
+				best / BENCH_COLUMN_ROWS, (way == 2 ? 40.0 : 48.0) * BENCH_COLUMN_ROWS / best);
+		}
+	}
+	free(data);
+	return 'n';
+}
+
+/* Bounded multi-producer multi-consumer ring of pointers (Dmitry Vyukov's
+   algorithm). Each cell carries a sequence number telling whether it is ready
+   to be written or read in the current lap, so producers and consumers only
+   contend on their own index with one compare-and-swap. */
+struct mpmc_cell {
+	atomic_size_t seq;
+	void* item;
+};
+
+struct mpmc_ring {
+	_Alignas(CACHE_LINE) atomic_size_t head;   // next cell to pop
+	_Alignas(CACHE_LINE) atomic_size_t tail;   // next cell to push
+	_Alignas(CACHE_LINE) size_t mask;
+	struct mpmc_cell* cells;
+};
+
+/* A batch of expressions passed between threads: the input is pre-sliced into
+   'count' items by 'offsets' into 'text', and the workers fill 'results' and
+   'status'. Batches come from a batch_pool, so nothing is allocated per item. */
+struct ring_batch {
+	uint64_t seq;
+	uint32_t count;
+	uint32_t capacity;
+	const char* text;
+	uint32_t* offsets;   // capacity + 1 boundaries in 'text'
+	double* results;
+	char* status;
+};
+
+struct batch_pool {
+	struct mpmc_ring spare;
+	struct ring_batch* batches;
+	void* storage;
+	unsigned int n_batches;
+};
+
+static inline int mpmc_push(struct mpmc_ring* ring, void* item)
+{
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	struct mpmc_cell* cell;
+
+	for(;;){
+		size_t seq;
+		intptr_t lap;
+
+		cell = &ring->cells[tail & ring->mask];
+		seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+		lap = (intptr_t)seq - (intptr_t)tail;
+		if(lap == 0){
+			if(atomic_compare_exchange_weak_explicit(&ring->tail, &tail, tail + 1, memory_order_relaxed, memory_order_relaxed))
+				break;
+		}
+		else if(lap < 0)
+			return 0;  // full
+		else
+			tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	}
+	cell->item = item;
+	atomic_store_explicit(&cell->seq, tail + 1, memory_order_release);
+	return 1;
+}
+
+static inline void* mpmc_pop(struct mpmc_ring* ring)
+{
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	struct mpmc_cell* cell;
+	void* item;
+
+	for(;;){
+		size_t seq;
+		intptr_t lap;
+
+		cell = &ring->cells[head & ring->mask];
+		seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+		lap = (intptr_t)seq - (intptr_t)(head + 1);
+		if(lap == 0){
+			if(atomic_compare_exchange_weak_explicit(&ring->head, &head, head + 1, memory_order_relaxed, memory_order_relaxed))
+				break;
+		}
+		else if(lap < 0)
+			return NULL;  // empty
+		else
+			head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	}
+	item = cell->item;
+	atomic_store_explicit(&cell->seq, head + ring->mask + 1, memory_order_release);
+	return item;
+}
+
+static inline struct ring_batch* batch_pool_get(struct batch_pool* pool)
+{
+	return mpmc_pop(&pool->spare);
+}
+
+static inline void batch_pool_put(struct batch_pool* pool, struct ring_batch* batch)
+{
+	batch->count = 0;
+	mpmc_push(&pool->spare, batch);  // cannot fail: the ring holds every batch of the pool
+}
+
+/*! \fn static char mpmc_init(struct mpmc_ring* ring, size_t capacity)
+		\brief
+		This function prepares an empty multi-producer multi-consumer ring.
+
+		\param ring the ring.
+		\param capacity the number of cells, rounded up to a power of two.
+		\return 'n' on success, 'm' when out of memory.
+*/
+static char mpmc_init(struct mpmc_ring* ring, size_t capacity)
+{
+	size_t size = 2, i;
+
+	while(size < capacity)
+		size <<= 1;
+	ring->cells = aligned_alloc(CACHE_LINE, ((size * sizeof(struct mpmc_cell)) + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1));
+	if(ring->cells == NULL)
+		return 'm';
+	for(i = 0; i < size; i++)
+		atomic_init(&ring->cells[i].seq, i);
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	ring->mask = size - 1;
+	return 'n';
+}
+
+static void mpmc_free(struct mpmc_ring* ring)
+{
+	free(ring->cells);
+	ring->cells = NULL;
+}
+
+/*! \fn static char batch_pool_init(struct batch_pool* pool, unsigned int n_batches, uint32_t capacity)
+		\brief
+		This function allocates 'n_batches' batches of 'capacity' items with a
+		single allocation and puts them all in the spare ring of the pool. Each
+		batch starts on its own cache line, so two threads working on neighbouring
+		batches do not share lines.
+
+		\return 'n' on success, 'm' when out of memory.
+*/
+static char batch_pool_init(struct batch_pool* pool, unsigned int n_batches, uint32_t capacity)
+{
+	size_t stride = (capacity + 1) * sizeof(uint32_t) + capacity * (sizeof(double) + 1);
+	char* at;
+	unsigned int i;
+
+	stride = (stride + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+	pool->n_batches = n_batches;
+	pool->batches = calloc(n_batches, sizeof(struct ring_batch));
+	pool->storage = aligned_alloc(CACHE_LINE, stride * n_batches);
+	if(pool->batches == NULL || pool->storage == NULL || mpmc_init(&pool->spare, n_batches) != 'n'){
+		free(pool->batches);
+		free(pool->storage);
+		return 'm';
+	}
+	for(i = 0, at = pool->storage; i < n_batches; i++, at += stride){
+		struct ring_batch* batch = &pool->batches[i];
+
+		batch->capacity = capacity;
+		batch->results = (double*)at;
+		batch->offsets = (uint32_t*)(batch->results + capacity);
+		batch->status = (char*)(batch->offsets + capacity + 1);
+		batch_pool_put(pool, batch);
+	}
+	return 'n';
+}
+
+static void batch_pool_free(struct batch_pool* pool)
+{
+	mpmc_free(&pool->spare);
+	free(pool->batches);
+	free(pool->storage);
+}
+
+struct ring_bench {
+	const struct corpus* corpus;
+	struct ring spsc;
+	struct mpmc_ring mpmc;
+	struct batch_pool pool;
+	char use_mpmc;
+	uint32_t batch_size;
+	uint64_t per_producer;
+	atomic_uint_fast64_t consumed;
+	uint64_t total;
+};
+
+static void* ring_producer(void* arg)
+{
+	struct ring_bench* rb = arg;
+	uint64_t produced = 0;
+	unsigned int spins = 0;
+	uint32_t i;
+
+	while(produced < rb->per_producer){
+		struct ring_batch* batch;
+
+		while((batch = batch_pool_get(&rb->pool)) == NULL)
+			ring_wait(&spins);
+		spins = 0;
+
+		// slice the next expressions of the corpus into the batch
+		batch->text = rb->corpus->text;
+		batch->seq = produced;
+		for(i = 0; i < rb->batch_size && produced < rb->per_producer; i++, produced++)
+			batch->offsets[i] = (uint32_t)rb->corpus->offsets[produced % rb->corpus->count];
+		batch->offsets[i] = batch->offsets[i - 1];
+		batch->count = i;
+
+		while(!(rb->use_mpmc ? mpmc_push(&rb->mpmc, batch) : ring_push(&rb->spsc, batch)))
+			ring_wait(&spins);
+		spins = 0;
+	}
+	return NULL;
+}
+
+static void* ring_consumer(void* arg)
+{
+	struct ring_bench* rb = arg;
+	unsigned int spins = 0;
+	uint32_t i;
+
+	while(atomic_load_explicit(&rb->consumed, memory_order_relaxed) < rb->total){
+		struct ring_batch* batch = rb->use_mpmc ? mpmc_pop(&rb->mpmc) : ring_pop(&rb->spsc);
+
+		if(batch == NULL){
+			ring_wait(&spins);
+			continue;
+		}
+		spins = 0;
+		for(i = 0; i < batch->count; i++){
+			batch->results[i] = (double)batch->text[batch->offsets[i]];
+			batch->status[i] = 'n';
+		}
+		atomic_fetch_add_explicit(&rb->consumed, batch->count, memory_order_relaxed);
+		batch_pool_put(&rb->pool, batch);
+	}
+	return NULL;
+}
+
+/*! \fn static char bench_rings(uint64_t seed)
+		\brief
+		This function measures the items and batches passed per second through the
+		SPSC and the MPMC rings for batch sizes from 1 to 1024.
+*/
+static char bench_rings(uint64_t seed)
+{
+	static const uint32_t sizes[] = {1, 4, 16, 64, 256, 1024};
+	static struct ring_bench rb;
+	struct corpus corpus;
+	pthread_t producers[2], consumers[2];
+	unsigned int s, t, threads;
+	double start, elapsed;
+	char status;
+
+	if((status = corpus_generate(&corpus, "short", 1 << 16, seed)) != 'n')
+		return status;
+	rb.corpus = &corpus;
+	printf("%-5s %7s %14s %14s\n", "ring", "batch", "Mitems/s", "Mbatches/s");
+
+	for(rb.use_mpmc = 0; rb.use_mpmc <= 1 && status == 'n'; rb.use_mpmc++){
+		threads = rb.use_mpmc ? 2 : 1;
+		for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && status == 'n'; s++){
+			if(batch_pool_init(&rb.pool, BENCH_RING_BATCHES, sizes[s]) != 'n' || ring_init(&rb.spsc, BENCH_RING_BATCHES) != 'n'
+				|| mpmc_init(&rb.mpmc, BENCH_RING_BATCHES) != 'n'){
+				status = 'm';
+				break;
+			}
+			rb.batch_size = sizes[s];
+			rb.per_producer = BENCH_RING_ITEMS / threads;
+			rb.total = rb.per_producer * threads;
+			atomic_store(&rb.consumed, 0);
+
+			start = now_ns();
+			for(t = 0; t < threads; t++){
+				pthread_create(&producers[t], NULL, ring_producer, &rb);
+				pthread_create(&consumers[t], NULL, ring_consumer, &rb);
+			}
+			for(t = 0; t < threads; t++){
+				pthread_join(producers[t], NULL);
+				pthread_join(consumers[t], NULL);
+			}
+			elapsed = now_ns() - start;
+
+			printf("%-5s %7u %14.2f %14.3f\n", rb.use_mpmc ? "mpmc" : "spsc", sizes[s],
+				rb.total / elapsed * 1e3, rb.total / (double)sizes[s] / elapsed * 1e3);
+			batch_pool_free(&rb.pool);
+			ring_free(&rb.spsc);
+			mpmc_free(&rb.mpmc);
+		}
+	}
+	corpus_free(&corpus);
+	return status;
+}
+
+int main(int argc, char** argv)
+{
+	static const struct option options[] = {
+		{"corpus", required_argument, NULL, 'c'},
+		{"count", required_argument, NULL, 'n'},
+		{"seed", required_argument, NULL, 's'},
+		{"format", required_argument, NULL, 'f'},
+		{"layout", required_argument, NULL, 'l'},
+		{"emit", no_argument, NULL, 'e'},
+		{"rings", no_argument, NULL, 'r'},
+		{"gradient", no_argument, NULL, 'g'},
+		{"functions", no_argument, NULL, 'm'},
+		{"columns", no_argument, NULL, 'k'},
+		{NULL, 0, NULL, 0}
+	};
+	static struct bench_state bench;
+	struct bench_result results[BENCH_PHASES * 8];
+	const char* kind = "all";
+	const char* format = "text";
+	unsigned int count = 10000, layout = 0, n_results = 0, i, slot;
+	uint64_t seed = 88172645463325252ull;
+	char emit = 0, rings = 0, gradient = 0, functions = 0, column_mode = 0, status = 'n', name[4];
+	int opt, k;
+
+	while((opt = getopt_long(argc, argv, "c:n:s:f:l:ergmk", options, NULL)) != -1){
+		switch(opt){
+			case 'c': kind = optarg; break;
+			case 'n': count = (unsigned int)strtoul(optarg, NULL, 10); break;
+			case 's': seed = strtoull(optarg, NULL, 10); break;
+			case 'f': format = optarg; break;
+			case 'l': layout = (unsigned int)strtoul(optarg, NULL, 10); break;
+			case 'e': emit = 1; break;
+			case 'r': rings = 1; break;
+			case 'g': gradient = 1; break;
+			case 'm': functions = 1; break;
+			case 'k': column_mode = 1; break;
+			default:
+				fprintf(stderr, "Usage: %s [--corpus KIND|all] [--count N] [--seed S] [--format text|json|csv] [--layout N] [--rings] [--gradient] [--functions] [--columns] [--emit]\n", argv[0]);
+				return -1;
+		}
+	}
+	if(count == 0 || plan_context_init(&bench.ctx) != 'n')
+		return -1;
+	for(i = 0; i < CORPUS_VARS; i++){
+		snprintf(name, sizeof(name), "x%u", i);
+		plan_symbol(&bench.ctx, name, 2, &slot);
+		bench.vars[i] = 1.0 + i / 8.0;
+	}
+
+	if(layout > 0)
+		status = bench_layout(&bench, layout, seed);
+	else if(rings)
+		status = bench_rings(seed);
+	else if(gradient)
+		status = bench_gradient(&bench, count, seed);
+	else if(functions)
+		status = bench_functions(&bench, count, seed);
+	else if(column_mode)
+		status = bench_columns(&bench);
+
+	for(k = 0; layout == 0 && !rings && !gradient && !functions && !column_mode && corpus_kinds[k] != NULL && status == 'n'; k++){
+		struct corpus corpus;
+
+		if(strcmp(kind, "all") != 0 && strcmp(kind, corpus_kinds[k]) != 0)
+			continue;
+		if((status = corpus_generate(&corpus, corpus_kinds[k], count, seed)) == 'n'){
+			if(emit)
+				fwrite(corpus.text, 1, corpus.bytes, stdout);
+			else
+				status = bench_corpus(&bench, &corpus, &results[n_results]);
+			n_results += BENCH_PHASES;
+		}
+		corpus_free(&corpus);
+	}
+	if(layout == 0 && !rings && !gradient && !functions && !column_mode && n_results == 0 && status == 'n')
+		status = 's';
+	if(status != 'n'){
+		fprintf(stderr, "bench-math-expr: failed with status '%c'\n", status);
+		return -1;
+	}
+	if(n_results > 0 && !emit)
+		print_results(format, results, n_results, seed);
+	if(bench.sink == 0.12345)
+		printf("\n");  // keeps the evaluations observable
+	plan_context_release(&bench.ctx);
+	return 0;
+}
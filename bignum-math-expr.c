@@ -0,0 +1,435 @@
+/*!
+	\file bignum-math-expr.c
+	\brief
+	This file contains the fixed-capacity big integers used by the exact
+	evaluation modes (decimal and rational) when a value no longer fits in 64
+	bits. They are schoolbook implementations on 32-bit limbs: exact modes only
+	spill to them on overflow, so their speed matters much less than the fact
+	that they never allocate.
+*/
+
+#include <string.h>
+#include <math.h>
+#include "bignum-math-expr.h"
+
+static void trim(struct bignum* r)
+{
+	while(r->n > 0 && r->limb[r->n - 1] == 0)
+		r->n--;
+	if(r->n == 0)
+		r->negative = 0;
+}
+
+void bignum_from_int64(struct bignum* r, int64_t value)
+{
+	uint64_t magnitude = value < 0 ? (uint64_t)0 - (uint64_t)value : (uint64_t)value;
+
+	r->negative = value < 0;
+	r->limb[0] = (uint32_t)magnitude;
+	r->limb[1] = (uint32_t)(magnitude >> 32);
+	r->n = 2;
+	trim(r);
+}
+
+void bignum_from_int128(struct bignum* r, __int128 value)
+{
+	unsigned __int128 magnitude = value < 0 ? (unsigned __int128)0 - (unsigned __int128)value : (unsigned __int128)value;
+	int i;
+
+	r->negative = value < 0;
+	for(i = 0; i < 4; i++){
+		r->limb[i] = (uint32_t)magnitude;
+		magnitude >>= 32;
+	}
+	r->n = 4;
+	trim(r);
+}
+
+/*! \fn char bignum_mul_small(struct bignum* r, const struct bignum* a, uint32_t m, uint32_t add)
+		\brief
+		This function computes r = |a| * m + add with the sign of 'a'. 'r' may be 'a'.
+*/
+char bignum_mul_small(struct bignum* r, const struct bignum* a, uint32_t m, uint32_t add)
+{
+	uint64_t carry = add;
+	int i;
+
+	for(i = 0; i < a->n; i++){
+		carry += (uint64_t)a->limb[i] * m;
+		r->limb[i] = (uint32_t)carry;
+		carry >>= 32;
+	}
+	r->n = a->n;
+	r->negative = a->negative;
+	if(carry != 0){
+		if(r->n == BIGNUM_LIMBS)
+			return 'v';
+		r->limb[r->n++] = (uint32_t)carry;
+	}
+	trim(r);
+	return 'n';
+}
+
+/*! \fn char bignum_from_digits(struct bignum* r, const char* digits, size_t len)
+		\brief
+		This function reads a non-negative integer written in decimal digits.
+
+		\return 'n' on success, 's' on a non-digit character, 'v' on overflow.
+*/
+char bignum_from_digits(struct bignum* r, const char* digits, size_t len)
+{
+	size_t i;
+
+	r->n = 0;
+	r->negative = 0;
+	for(i = 0; i < len; i++){
+		if(digits[i] < '0' || digits[i] > '9')
+			return 's';
+		if(bignum_mul_small(r, r, 10, (uint32_t)(digits[i] - '0')) != 'n')
+			return 'v';
+	}
+	return 'n';
+}
+
+/*! \fn char bignum_to_int64(const struct bignum* a, int64_t* value)
+		\return 'n' if 'a' fits in an int64_t, 'v' otherwise.
+*/
+char bignum_to_int64(const struct bignum* a, int64_t* value)
+{
+	uint64_t magnitude;
+
+	if(a->n > 2)
+		return 'v';
+	magnitude = (a->n > 0 ? a->limb[0] : 0) | ((uint64_t)(a->n > 1 ? a->limb[1] : 0) << 32);
+	if(magnitude > (uint64_t)INT64_MAX + (a->negative ? 1 : 0))
+		return 'v';
+	*value = a->negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+	return 'n';
+}
+
+double bignum_to_double(const struct bignum* a)
+{
+	double value = 0;
+	int i;
+
+	for(i = a->n - 1; i >= 0; i--)
+		value = value * 4294967296.0 + a->limb[i];
+	return a->negative ? -value : value;
+}
+
+static uint32_t divide_small(struct bignum* q, const struct bignum* a, uint32_t d)
+{
+	uint64_t rest = 0;
+	int i;
+
+	for(i = a->n - 1; i >= 0; i--){
+		rest = (rest << 32) | a->limb[i];
+		q->limb[i] = (uint32_t)(rest / d);
+		rest %= d;
+	}
+	q->n = a->n;
+	q->negative = a->negative;
+	trim(q);
+	return (uint32_t)rest;
+}
+
+/*! \fn int bignum_to_string(const struct bignum* a, char* out, size_t size)
+		\brief
+		This function writes 'a' in decimal.
+
+		\return the length written, or -1 if 'size' is too small.
+*/
+int bignum_to_string(const struct bignum* a, char* out, size_t size)
+{
+	struct bignum q = *a;
+	char reversed[BIGNUM_LIMBS * 10 + 2];
+	int len = 0, i, n = 0;
+
+	do{
+		uint32_t chunk = divide_small(&q, &q, 1000000000u);
+
+		for(i = 0; i < 9 && (chunk != 0 || q.n != 0 || i == 0); i++){
+			reversed[len++] = (char)('0' + chunk % 10);
+			chunk /= 10;
+		}
+	}while(q.n != 0);
+
+	if((size_t)len + 2 > size)
+		return -1;
+	if(a->negative)
+		out[n++] = '-';
+	for(i = len - 1; i >= 0; i--)
+		out[n++] = reversed[i];
+	out[n] = '\0';
+	return n;
+}
+
+int bignum_compare_abs(const struct bignum* a, const struct bignum* b)
+{
+	int i;
+
+	if(a->n != b->n)
+		return a->n < b->n ? -1 : 1;
+	for(i = a->n - 1; i >= 0; i--)
+		if(a->limb[i] != b->limb[i])
+			return a->limb[i] < b->limb[i] ? -1 : 1;
+	return 0;
+}
+
+static char add_abs(struct bignum* r, const struct bignum* a, const struct bignum* b)
+{
+	const struct bignum* longer = a->n >= b->n ? a : b;
+	const struct bignum* shorter = a->n >= b->n ? b : a;
+	uint64_t carry = 0;
+	int i;
+
+	for(i = 0; i < longer->n; i++){
+		carry += (uint64_t)longer->limb[i] + (i < shorter->n ? shorter->limb[i] : 0);
+		r->limb[i] = (uint32_t)carry;
+		carry >>= 32;
+	}
+	r->n = longer->n;
+	if(carry != 0){
+		if(r->n == BIGNUM_LIMBS)
+			return 'v';
+		r->limb[r->n++] = 1;
+	}
+	return 'n';
+}
+
+static void sub_abs(struct bignum* r, const struct bignum* a, const struct bignum* b)  // |a| >= |b|
+{
+	int64_t borrow = 0;
+	int i;
+
+	for(i = 0; i < a->n; i++){
+		borrow += (int64_t)a->limb[i] - (i < b->n ? b->limb[i] : 0);
+		r->limb[i] = (uint32_t)borrow;
+		borrow = borrow < 0 ? -1 : 0;
+	}
+	r->n = a->n;
+}
+
+static char add_signed(struct bignum* r, const struct bignum* a, const struct bignum* b, int b_negative)
+{
+	char status = 'n';
+
+	if(a->negative == b_negative){
+		int negative = a->negative;
+		status = add_abs(r, a, b);
+		r->negative = negative;
+	}
+	else if(bignum_compare_abs(a, b) >= 0){
+		int negative = a->negative;
+		sub_abs(r, a, b);
+		r->negative = negative;
+	}
+	else{
+		sub_abs(r, b, a);
+		r->negative = b_negative;
+	}
+	trim(r);
+	return status;
+}
+
+char bignum_add(struct bignum* r, const struct bignum* a, const struct bignum* b)
+{
+	return add_signed(r, a, b, b->negative);
+}
+
+char bignum_sub(struct bignum* r, const struct bignum* a, const struct bignum* b)
+{
+	return add_signed(r, a, b, b->n != 0 && !b->negative);
+}
+
+char bignum_mul(struct bignum* r, const struct bignum* a, const struct bignum* b)
+{
+	uint32_t limb[2 * BIGNUM_LIMBS];
+	int i, j, n = a->n + b->n;
+
+	if(a->n == 0 || b->n == 0){
+		r->n = 0;
+		r->negative = 0;
+		return 'n';
+	}
+	if(n > BIGNUM_LIMBS + 1)
+		return 'v';
+	memset(limb, 0, n * sizeof(uint32_t));
+	for(i = 0; i < a->n; i++){
+		uint64_t carry = 0;
+
+		for(j = 0; j < b->n; j++){
+			carry += (uint64_t)a->limb[i] * b->limb[j] + limb[i + j];
+			limb[i + j] = (uint32_t)carry;
+			carry >>= 32;
+		}
+		limb[i + b->n] = (uint32_t)carry;
+	}
+	while(n > 0 && limb[n - 1] == 0)
+		n--;
+	if(n > BIGNUM_LIMBS)
+		return 'v';
+	r->negative = a->negative != b->negative;
+	memcpy(r->limb, limb, n * sizeof(uint32_t));
+	r->n = n;
+	trim(r);
+	return 'n';
+}
+
+/*! \fn char bignum_divmod(struct bignum* q, struct bignum* rem, const struct bignum* a, const struct bignum* b)
+		\brief
+		This function computes the truncated division a = q*b + rem, where 'rem'
+		has the sign of 'a' (like C's '/' and '%'), with Knuth's algorithm D.
+		Either output may be NULL.
+
+		\return 'n' on success, 'z' if 'b' is zero.
+*/
+char bignum_divmod(struct bignum* q, struct bignum* rem, const struct bignum* a, const struct bignum* b)
+{
+	uint32_t u[BIGNUM_LIMBS + 1], v[BIGNUM_LIMBS], quotient[BIGNUM_LIMBS];
+	int negative_q = a->negative != b->negative, negative_r = a->negative;
+	int m, n = b->n, shift, i, j;
+
+	if(n == 0)
+		return 'z';
+	if(bignum_compare_abs(a, b) < 0){
+		if(rem != NULL)
+			*rem = *a;
+		if(q != NULL){
+			q->n = 0;
+			q->negative = 0;
+		}
+		return 'n';
+	}
+	if(n == 1){
+		struct bignum tmp;
+		uint32_t r = divide_small(&tmp, a, b->limb[0]);
+
+		if(rem != NULL){
+			rem->limb[0] = r;
+			rem->n = 1;
+			rem->negative = negative_r;
+			trim(rem);
+		}
+		if(q != NULL){
+			*q = tmp;
+			q->negative = negative_q;
+			trim(q);
+		}
+		return 'n';
+	}
+
+	// normalize so that the top limb of the divisor has its high bit set
+	m = a->n - n;
+	shift = __builtin_clz(b->limb[n - 1]);
+	for(i = n - 1; i > 0; i--)
+		v[i] = (b->limb[i] << shift) | (shift ? (uint32_t)((uint64_t)b->limb[i - 1] >> (32 - shift)) : 0);
+	v[0] = b->limb[0] << shift;
+	u[a->n] = shift ? (uint32_t)((uint64_t)a->limb[a->n - 1] >> (32 - shift)) : 0;
+	for(i = a->n - 1; i > 0; i--)
+		u[i] = (a->limb[i] << shift) | (shift ? (uint32_t)((uint64_t)a->limb[i - 1] >> (32 - shift)) : 0);
+	u[0] = a->limb[0] << shift;
+
+	for(j = m; j >= 0; j--){
+		uint64_t numerator = ((uint64_t)u[j + n] << 32) | u[j + n - 1];
+		uint64_t qhat = numerator / v[n - 1];
+		uint64_t rhat = numerator % v[n - 1];
+		int64_t borrow = 0, t;
+		uint64_t product;
+
+		while(qhat > 0xFFFFFFFFull || qhat * v[n - 2] > ((rhat << 32) | u[j + n - 2])){
+			qhat--;
+			rhat += v[n - 1];
+			if(rhat > 0xFFFFFFFFull)
+				break;
+		}
+		// multiply and subtract
+		for(i = 0; i < n; i++){
+			product = qhat * v[i];
+			t = (int64_t)u[i + j] - borrow - (int64_t)(product & 0xFFFFFFFFull);
+			u[i + j] = (uint32_t)t;
+			borrow = (int64_t)(product >> 32) - (t >> 32);
+		}
+		t = (int64_t)u[j + n] - borrow;
+		u[j + n] = (uint32_t)t;
+
+		quotient[j] = (uint32_t)qhat;
+		if(t < 0){
+			// add back
+			uint64_t carry = 0;
+
+			quotient[j]--;
+			for(i = 0; i < n; i++){
+				carry += (uint64_t)u[i + j] + v[i];
+				u[i + j] = (uint32_t)carry;
+				carry >>= 32;
+			}
+			u[j + n] += (uint32_t)carry;
+		}
+	}
+
+	if(q != NULL){
+		memcpy(q->limb, quotient, (m + 1) * sizeof(uint32_t));
+		q->n = m + 1;
+		q->negative = negative_q;
+		trim(q);
+	}
+	if(rem != NULL){
+		for(i = 0; i < n; i++)
+			rem->limb[i] = (u[i] >> shift) | (shift ? (uint32_t)((uint64_t)u[i + 1] << (32 - shift)) : 0);
+		rem->n = n;
+		rem->negative = negative_r;
+		trim(rem);
+	}
+	return 'n';
+}
+
+/*! \fn char bignum_pow(struct bignum* r, const struct bignum* base, uint64_t n)
+		\brief
+		This function computes r = base^n by repeated squaring. 'r' may be 'base'.
+*/
+char bignum_pow(struct bignum* r, const struct bignum* base, uint64_t n)
+{
+	struct bignum square = *base;
+
+	bignum_from_int64(r, 1);
+	while(n != 0){
+		if((n & 1) && bignum_mul(r, r, &square) != 'n')
+			return 'v';
+		if((n >>= 1) != 0 && bignum_mul(&square, &square, &square) != 'n')
+			return 'v';
+	}
+	return 'n';
+}
+
+char bignum_pow10(struct bignum* r, unsigned int k)
+{
+	bignum_from_int64(r, 1);
+	while(k >= 9){
+		if(bignum_mul_small(r, r, 1000000000u, 0) != 'n')
+			return 'v';
+		k -= 9;
+	}
+	while(k-- > 0)
+		if(bignum_mul_small(r, r, 10, 0) != 'n')
+			return 'v';
+	return 'n';
+}
+
+/*! \fn char bignum_gcd(struct bignum* r, const struct bignum* a, const struct bignum* b)
+		\brief
+		This function computes the non-negative greatest common divisor of 'a' and 'b'.
+*/
+char bignum_gcd(struct bignum* r, const struct bignum* a, const struct bignum* b)
+{
+	struct bignum x = *a, y = *b, rest;
+
+	x.negative = y.negative = 0;
+	while(y.n != 0){
+		bignum_divmod(NULL, &rest, &x, &y);
+		x = y;
+		y = rest;
+	}
+	*r = x;
+	return 'n';
+}
@@ -0,0 +1,41 @@
+#ifndef BIGNUM_MATH_EXPR_H
+#define BIGNUM_MATH_EXPR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BIGNUM_LIMBS 40  // 1280 bits, about 385 decimal digits
+
+/* A signed integer of up to BIGNUM_LIMBS 32-bit limbs, stored inline so that
+   bignums live on the evaluation stack and never allocate. The magnitude is
+   little-endian in limb[0..n), n = 0 for zero, and has no leading zero limb.
+   Operations whose result does not fit return 'v' (overflow). */
+struct bignum {
+	int negative;
+	int n;
+	uint32_t limb[BIGNUM_LIMBS];
+};
+
+void bignum_from_int64(struct bignum* r, int64_t value);
+void bignum_from_int128(struct bignum* r, __int128 value);
+char bignum_from_digits(struct bignum* r, const char* digits, size_t len);
+char bignum_to_int64(const struct bignum* a, int64_t* value);
+double bignum_to_double(const struct bignum* a);
+int bignum_to_string(const struct bignum* a, char* out, size_t size);
+
+int bignum_compare_abs(const struct bignum* a, const struct bignum* b);
+char bignum_add(struct bignum* r, const struct bignum* a, const struct bignum* b);
+char bignum_sub(struct bignum* r, const struct bignum* a, const struct bignum* b);
+char bignum_mul(struct bignum* r, const struct bignum* a, const struct bignum* b);
+char bignum_mul_small(struct bignum* r, const struct bignum* a, uint32_t m, uint32_t add);
+char bignum_divmod(struct bignum* q, struct bignum* rem, const struct bignum* a, const struct bignum* b);
+char bignum_pow(struct bignum* r, const struct bignum* base, uint64_t n);
+char bignum_pow10(struct bignum* r, unsigned int k);
+char bignum_gcd(struct bignum* r, const struct bignum* a, const struct bignum* b);
+
+static inline int bignum_is_zero(const struct bignum* a)
+{
+	return a->n == 0;
+}
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef CHECK_MATH_EXPR_H
+#define CHECK_MATH_EXPR_H
+
+#include <stddef.h>
+#include "plan-math-expr.h"
+
+size_t check_chars(const char* src, size_t len);
+char check_expression(struct plan_context* ctx, const char* src, size_t len, size_t* error_at);
+
+#endif
@@ -0,0 +1,710 @@
+/*!
+	\file column-math-expr.c
+	\brief
+	This file contains the binary batch mode: a compiled expression is applied to
+	every row of a set of columns of doubles and the results are written as a
+	column, with no number parsing or formatting on either side. Columns come
+	either from a column table file (see struct column_header), whose named
+	columns become the variables of the expression, or from raw files of bare
+	little-endian doubles bound to a name with --column name=path. Files are
+	mapped with mmap(), so the data is never copied.
+
+	An aggregate, such as sum(a*b) or max(x-y), is reduced block by block as
+	the rows are evaluated, so the results of the rows are never stored. The
+	rows are split between worker threads, whose partial results are combined
+	in row order: a run gives the same result for the same number of workers.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <time.h>
+#include "plan-math-expr.h"
+#include "function-math-expr.h"
+#include "column-math-expr.h"
+#include "batch-math-expr.h"
+#include "format-math-expr.h"
+#include "kernel-math-expr.h"
+#include "numa-math-expr.h"
+#include "trace-math-expr.h"
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "column files hold little-endian doubles, which are mapped without conversion"
+#endif
+
+static size_t round_up(size_t n, size_t align)
+{
+	return (n + align - 1) & ~(align - 1);
+}
+
+/*! \fn size_t column_offset(uint32_t ncols, uint64_t nrows, uint32_t col)
+		\brief
+		This function returns the byte offset of column 'col' in a column table of
+		'ncols' columns of 'nrows' rows. Passing col = ncols gives the file size.
+*/
+size_t column_offset(uint32_t ncols, uint64_t nrows, uint32_t col)
+{
+	size_t data = round_up(sizeof(struct column_header) + (size_t)ncols * COLUMN_NAME_SIZE, COLUMN_ALIGN);
+	return data + col * round_up(nrows * sizeof(double), COLUMN_ALIGN);
+}
+
+static void* map_file(const char* path, int flags, size_t size, size_t* mapped)
+{
+	struct stat st;
+	void* map;
+	int fd = open(path, flags, 0644);
+
+	if(fd < 0)
+		return NULL;
+	if(flags & O_CREAT){
+		if(ftruncate(fd, (off_t)size) != 0){
+			close(fd);
+			return NULL;
+		}
+	}
+	else if(fstat(fd, &st) == 0)
+		size = (size_t)st.st_size;
+	else
+		size = 0;
+
+	map = size ? mmap(NULL, size, (flags & O_CREAT) ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0) : NULL;
+	close(fd);
+	if(map == MAP_FAILED)
+		return NULL;
+	*mapped = size;
+	return map;
+}
+
+static char add_column(struct column_table* table, const char* name, double* data, uint64_t nrows)
+{
+	if(table->ncols == COLUMN_MAX)
+		return 'd';
+	if(table->ncols > 0 && table->nrows != nrows)
+		return 'r';  // the columns do not have the same number of rows
+	table->nrows = nrows;
+	snprintf(table->names[table->ncols], COLUMN_NAME_SIZE, "%s", name);
+	table->columns[table->ncols++] = data;
+	return 'n';
+}
+
+/*! \fn char column_open(struct column_table* table, const char* path)
+		\brief
+		This function maps a column table file and appends its columns to 'table'.
+
+		\param table the table to extend, zero-initialized before the first call.
+		\param path the path of the column table.
+		\return 'n' on success, 'i' if the file cannot be read, 'f' if it is not a
+		valid column table, 'r' if its row count differs from the table's, 'd' if
+		the table would exceed COLUMN_MAX columns.
+*/
+char column_open(struct column_table* table, const char* path)
+{
+	const struct column_header* header;
+	size_t size = 0;
+	uint32_t c;
+	char status = 'n', name[COLUMN_NAME_SIZE];
+	char* map = map_file(path, O_RDONLY, 0, &size);
+
+	if(map == NULL || table->n_maps == COLUMN_MAX){
+		if(map != NULL)
+			munmap(map, size);
+		return 'i';
+	}
+	table->maps[table->n_maps] = map;
+	table->map_sizes[table->n_maps++] = size;
+
+	header = (const struct column_header*)map;
+	if(size < sizeof(*header) || memcmp(header->magic, COLUMN_MAGIC, 4) != 0 || header->ncols > COLUMN_MAX
+		|| header->nrows > SIZE_MAX / sizeof(double) || size < column_offset(header->ncols, header->nrows, header->ncols))
+		return 'f';
+
+	for(c = 0; c < header->ncols && status == 'n'; c++){
+		memcpy(name, map + sizeof(*header) + c * COLUMN_NAME_SIZE, COLUMN_NAME_SIZE);
+		name[COLUMN_NAME_SIZE - 1] = '\0';
+		status = add_column(table, name, (double*)(map + column_offset(header->ncols, header->nrows, c)), header->nrows);
+	}
+	return status;
+}
+
+/*! \fn char column_open_raw(struct column_table* table, const char* name, const char* path)
+		\brief
+		This function maps a file of bare little-endian doubles and appends it to
+		'table' as the column 'name'.
+
+		\return the status codes of column_open().
+*/
+char column_open_raw(struct column_table* table, const char* name, const char* path)
+{
+	size_t size = 0;
+	char* map = map_file(path, O_RDONLY, 0, &size);
+
+	if(map == NULL || table->n_maps == COLUMN_MAX){
+		if(map != NULL)
+			munmap(map, size);
+		return size == 0 && map == NULL ? 'i' : 'd';
+	}
+	table->maps[table->n_maps] = map;
+	table->map_sizes[table->n_maps++] = size;
+	if(size % sizeof(double) != 0)
+		return 'f';
+	return add_column(table, name, (double*)map, size / sizeof(double));
+}
+
+/*! \fn char column_create(struct column_table* table, const char* path, const char* name, uint64_t nrows, char raw)
+		\brief
+		This function creates a file holding a single column of 'nrows' doubles and
+		maps it in 'table', which must be empty. The column is a column table named
+		'name', or bare doubles when 'raw' is set.
+
+		\return 'n' on success, 'i' if the file cannot be created.
+*/
+char column_create(struct column_table* table, const char* path, const char* name, uint64_t nrows, char raw)
+{
+	size_t size = raw ? nrows * sizeof(double) : column_offset(1, nrows, 1);
+	size_t mapped = 0;
+	char* map;
+
+	if(size == 0){
+		int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);  // no rows: an empty raw file
+		if(fd < 0)
+			return 'i';
+		close(fd);
+		return add_column(table, name, NULL, 0);
+	}
+	if((map = map_file(path, O_RDWR | O_CREAT | O_TRUNC, size, &mapped)) == NULL)
+		return 'i';
+	table->maps[table->n_maps] = map;
+	table->map_sizes[table->n_maps++] = mapped;
+	if(raw)
+		return add_column(table, name, (double*)map, nrows);
+
+	memset(map, 0, column_offset(1, nrows, 0));
+	memcpy(map, COLUMN_MAGIC, 4);
+	((struct column_header*)map)->ncols = 1;
+	((struct column_header*)map)->nrows = nrows;
+	snprintf(map + sizeof(struct column_header), COLUMN_NAME_SIZE, "%s", name);
+	return add_column(table, name, (double*)(map + column_offset(1, nrows, 0)), nrows);
+}
+
+void column_close(struct column_table* table)
+{
+	int i;
+
+	for(i = 0; i < table->n_maps; i++)
+		munmap(table->maps[i], table->map_sizes[i]);
+	table->n_maps = 0;
+	table->ncols = 0;
+}
+
+struct column_kernel {
+	const char* name;
+	void (*evaluate)(const struct plan*, const double* const*, uint32_t, uint64_t, uint64_t, double*);
+	void (*reduce)(const struct plan*, const double* const*, uint32_t, uint64_t, uint64_t, int, struct column_reduction*);
+};
+
+static const struct column_kernel kernels[] = {
+	{"sse2", evaluate_plan_rows_sse2, reduce_plan_rows_sse2},
+	{"avx2", evaluate_plan_rows_avx2, reduce_plan_rows_avx2},
+	{"avx512", evaluate_plan_rows_avx512, reduce_plan_rows_avx512}
+};
+
+static const struct column_kernel* kernel;  // the instruction set in use
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static int isa_supported(int k)
+{
+	if(k == 2)
+		return __builtin_cpu_supports("avx512f");
+	if(k == 1)
+		return __builtin_cpu_supports("avx2");
+	return 1;  // SSE2 is part of x86-64
+}
+
+static void select_kernel(void)  // the widest set of the CPU, or the one named by COLUMN_ISA_ENV
+{
+	const char* forced = getenv(COLUMN_ISA_ENV);
+	int k;
+
+	__builtin_cpu_init();
+	for(k = 2; k > 0 && !isa_supported(k); k--)
+		;
+	kernel = &kernels[k];
+	if(forced == NULL)
+		return;
+	for(k = 0; k < 3; k++)
+		if(strcmp(forced, kernels[k].name) == 0 && isa_supported(k)){
+			kernel = &kernels[k];
+			return;
+		}
+	fprintf(stderr, "Ignoring %s=%s: not an instruction set of this CPU, using %s\n", COLUMN_ISA_ENV, forced, kernel->name);
+}
+
+/*! \fn char column_isa(const char* name)
+		\brief
+		This function forces the instruction set of the block evaluator, for
+		testing and for measurements. It must not run concurrently with an
+		evaluation. Without it, the widest set of the CPU is used, or the one
+		named by the COLUMN_ISA_ENV environment variable.
+
+		\param name sse2, avx2 or avx512.
+		\return 'n' on success, 's' for an unknown name, 'u' if the CPU does not support the set.
+*/
+char column_isa(const char* name)
+{
+	int k;
+
+	pthread_once(&kernel_once, select_kernel);
+	for(k = 0; k < 3; k++){
+		if(strcmp(name, kernels[k].name) != 0)
+			continue;
+		if(!isa_supported(k))
+			return 'u';
+		kernel = &kernels[k];
+		return 'n';
+	}
+	return 's';
+}
+
+const char* column_isa_name(void)
+{
+	pthread_once(&kernel_once, select_kernel);
+	return kernel->name;
+}
+
+/*! \fn void evaluate_plan_rows(const struct plan* plan, const double* const* columns, uint32_t ncols, uint64_t first, uint64_t last, double* out)
+		\brief
+		This function evaluates 'plan' on the rows [first, last) of 'columns', where
+		column i holds the values of variable slot i, and stores the results in
+		out[first..last). Rows are evaluated in blocks of COLUMN_BLOCK (see
+		kernel-math-expr.c) and give the same results as evaluate_plan() on each
+		row, whatever the instruction set in use.
+
+		\param ncols the number of columns, more than the highest slot of the plan.
+*/
+void evaluate_plan_rows(const struct plan* plan, const double* const* columns, uint32_t ncols, uint64_t first, uint64_t last, double* out)
+{
+	pthread_once(&kernel_once, select_kernel);
+	kernel->evaluate(plan, columns, ncols, first, last, out);
+}
+
+/*! \fn void reduce_plan_rows(const struct plan* plan, const double* const* columns, uint32_t ncols, uint64_t first, uint64_t last, int summation, struct column_reduction* reduction)
+		\brief
+		This function evaluates 'plan' on the rows [first, last) of 'columns' like
+		evaluate_plan_rows(), but reduces every block as soon as it is computed
+		instead of storing it: the sum (with the 'summation' method), the minimum,
+		the maximum and the count of the rows go to 'reduction', so that a single
+		pass over the columns serves any aggregate and nothing is written back.
+		Ranges reduced separately, by different threads, are combined by
+		column_reduction_result().
+
+		\param reduction the partial result, initialized by this function.
+*/
+void reduce_plan_rows(const struct plan* plan, const double* const* columns, uint32_t ncols, uint64_t first, uint64_t last, int summation, struct column_reduction* reduction)
+{
+	pthread_once(&kernel_once, select_kernel);
+	kernel->reduce(plan, columns, ncols, first, last, summation, reduction);
+}
+
+static void add_compensated(double* sum, double* compensation, double x)  // Neumaier's variant of Kahan's step
+{
+	double t = *sum + x;
+
+	*compensation += fabs(*sum) >= fabs(x) ? (*sum - t) + x : (x - t) + *sum;
+	*sum = t;
+}
+
+/*! \fn double column_reduction_result(const struct column_reduction* partials, unsigned int count, int aggregate, int summation)
+		\brief
+		This function combines the partial results of consecutive row ranges into
+		the value of an aggregate. The partial sums are added with compensation
+		unless 'summation' is SUMMATION_PLAIN. The mean of no rows is NaN, and so
+		are the minimum and the maximum of rows that are all NaN.
+
+		\param aggregate an enum column_aggregate other than AGGREGATE_NONE.
+		\param summation the method 'partials' were reduced with.
+*/
+double column_reduction_result(const struct column_reduction* partials, unsigned int count, int aggregate, int summation)
+{
+	double result = NAN, sum = 0, compensation = 0;
+	uint64_t rows = 0;
+	unsigned int i, k;
+
+	for(i = 0; i < count; i++){
+		const struct column_reduction* r = &partials[i];
+
+		rows += r->count;
+		for(k = 0; k < COLUMN_LANES; k++){
+			if(aggregate == AGGREGATE_MIN)
+				result = function_min(result, r->min[k]);
+			else if(aggregate == AGGREGATE_MAX)
+				result = function_max(result, r->max[k]);
+		}
+		if(summation == SUMMATION_PLAIN)
+			for(k = 0; k < COLUMN_LANES; k++)
+				sum += r->sum[k];
+		else if(summation == SUMMATION_KAHAN)
+			for(k = 0; k < COLUMN_LANES; k++){
+				add_compensated(&sum, &compensation, r->sum[k]);
+				add_compensated(&sum, &compensation, -r->compensation[k]);
+			}
+		else
+			for(k = 0; k < 64; k++)
+				if(r->blocks & ((uint64_t)1 << k))
+					add_compensated(&sum, &compensation, r->levels[k]);
+	}
+	if(aggregate == AGGREGATE_MIN || aggregate == AGGREGATE_MAX)
+		return result;
+	sum += compensation;
+	return aggregate == AGGREGATE_MEAN ? sum / (double)rows : sum;
+}
+
+/*! \fn int column_aggregate(const char* expression, size_t* start, size_t* end, size_t* comma)
+		\brief
+		This function tells whether an expression is an aggregate, an aggregate
+		function called around the whole of it.
+
+		\param start set to the offset of the argument of the aggregate.
+		\param end set to the offset of the closing parenthesis.
+		\param comma set to the offset of the comma of dot(u, v).
+		\return an enum column_aggregate, AGGREGATE_NONE for a row-wise expression.
+*/
+int column_aggregate(const char* expression, size_t* start, size_t* end, size_t* comma)
+{
+	static const char* const names[] = {"sum", "mean", "min", "max", "dot"};
+	size_t i = strspn(expression, " \t"), name = i, len, commas = 0;
+	int aggregate, depth = 0;
+
+	while((expression[i] >= 'a' && expression[i] <= 'z'))
+		i++;
+	len = i - name;
+	for(aggregate = 0; aggregate < 5; aggregate++)
+		if(strlen(names[aggregate]) == len && strncmp(expression + name, names[aggregate], len) == 0)
+			break;
+	i += strspn(expression + i, " \t");
+	if(aggregate == 5 || expression[i] != '(')
+		return AGGREGATE_NONE;
+	*start = i + 1;
+	for(; expression[i] != '\0'; i++){
+		if(expression[i] == '(')
+			depth++;
+		else if(expression[i] == ')' && --depth == 0)
+			break;
+		else if(expression[i] == ',' && depth == 1){
+			*comma = i;
+			commas++;
+		}
+	}
+	if(expression[i] != ')' || expression[i + 1 + strspn(expression + i + 1, " \t")] != '\0')
+		return AGGREGATE_NONE;  // the call is not the whole expression
+	*end = i;
+	if(commas != (aggregate == 4 ? 1u : 0u))
+		return AGGREGATE_NONE;  // min(x, y) and max(x, y) are the built-in functions
+	return AGGREGATE_SUM + aggregate;
+}
+
+/*! \fn char column_summation_mode(const char* name, int* summation)
+		\brief
+		This function reads the name of a summation method: plain, pairwise or
+		kahan.
+
+		\return 'n' on success, 's' for an unknown name.
+*/
+char column_summation_mode(const char* name, int* summation)
+{
+	static const char* const names[] = {"plain", "pairwise", "kahan"};
+	int i;
+
+	for(i = 0; i < 3; i++){
+		if(strcmp(name, names[i]) == 0){
+			*summation = i;
+			return 'n';
+		}
+	}
+	return 's';
+}
+
+/*! \fn char bind_column(struct column_options* options, char* arg)
+		\brief
+		This function records a '--column name=path' argument.
+
+		\return 'n' on success, 's' if the argument is malformed.
+*/
+char bind_column(struct column_options* options, char* arg)
+{
+	char* eq = strchr(arg, '=');
+
+	if(eq == NULL || eq == arg || eq[1] == '\0' || options->n_raw == COLUMN_MAX)
+		return 's';
+	*eq = '\0';
+	options->raw_names[options->n_raw] = arg;
+	options->raw_paths[options->n_raw++] = eq + 1;
+	return 'n';
+}
+
+struct column_worker {
+	const struct plan* plan;
+	const struct column_table* input;
+	uint64_t first, last;       // the rows of the worker, whole blocks except in the last worker
+	int aggregate;              // set when the worker reduces its rows instead of writing them
+	double* out;                // the output column, unused by an aggregate
+	int summation;
+	struct column_reduction* reduction;  // the partial result of an aggregate
+	const struct numa_topology* numa;    // NULL unless the worker is placed on a node
+	unsigned int node;                   // the index of its node in 'numa'
+	const char* read;                    // read[c] is set for the columns the plan reads
+	double seconds;                      // the time spent evaluating
+	unsigned int index;
+	pthread_t thread;
+};
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void* run_column_worker(void* arg)
+{
+	struct column_worker* worker = arg;
+	const double* const* columns = (const double* const*)worker->input->columns;
+	size_t bytes = (worker->last - worker->first) * sizeof(double);
+	uint64_t span;
+	double start;
+	uint32_t c;
+
+	trace_thread("column worker", worker->index);
+	if(worker->numa != NULL && numa_pin(worker->numa, worker->node) == 'n'){
+		// first touch: the pages of the rows of the worker come to its node
+		span = trace_begin();
+		for(c = 0; c < worker->input->ncols; c++)
+			if(worker->read[c])
+				numa_touch(columns[c] + worker->first, bytes);
+		if(!worker->aggregate)
+			memset(worker->out + worker->first, 0, bytes);
+		trace_end("first touch", span, bytes);
+	}
+	span = trace_begin();
+	start = now_seconds();
+	if(!worker->aggregate)
+		evaluate_plan_rows(worker->plan, columns, worker->input->ncols, worker->first, worker->last, worker->out);
+	else
+		reduce_plan_rows(worker->plan, columns, worker->input->ncols, worker->first, worker->last, worker->summation, worker->reduction);
+	worker->seconds = now_seconds() - start;
+	trace_end(worker->aggregate ? "reduce rows" : "evaluate rows", span, worker->last - worker->first);
+	return NULL;
+}
+
+/*! \fn static unsigned int run_workers(struct column_worker* workers, struct column_reduction* partials, unsigned int count)
+		\brief
+		This function splits the rows between 'count' workers, in consecutive
+		ranges of whole blocks, and runs them: the first one in the calling thread,
+		the others in threads of their own (or in the calling thread too if a
+		thread cannot be created). Worker i reduces into partials[i], when
+		'partials' is not NULL. With no rows, no worker runs.
+
+		With a topology in workers[0].numa, the workers are spread over the nodes
+		in row order, worker i on node i * n_nodes / count, and the first one gets
+		a thread too, so that the calling thread is never pinned.
+
+		\return the number of workers that ran, 'count' or 0.
+*/
+static unsigned int run_workers(struct column_worker* workers, struct column_reduction* partials, unsigned int count)
+{
+	uint64_t nrows = workers[0].input->nrows;
+	uint64_t blocks = (nrows + COLUMN_BLOCK - 1) / COLUMN_BLOCK;
+	char started[COLUMN_MAX_WORKERS];
+	unsigned int i, first;
+
+	if(nrows == 0)
+		return 0;
+	for(i = 0; i < count; i++){
+		workers[i] = workers[0];
+		workers[i].index = i;
+		workers[i].reduction = partials != NULL ? &partials[i] : NULL;
+		workers[i].first = blocks * i / count * COLUMN_BLOCK;
+		workers[i].last = i + 1 == count ? nrows : blocks * (i + 1) / count * COLUMN_BLOCK;
+		workers[i].node = workers[0].numa != NULL ? i * workers[0].numa->n_nodes / count : 0;
+	}
+	first = workers[0].numa != NULL ? 0 : 1;
+	for(i = first; i < count; i++)
+		started[i] = pthread_create(&workers[i].thread, NULL, run_column_worker, &workers[i]) == 0;
+	if(first == 1)
+		run_column_worker(&workers[0]);
+	for(i = first; i < count; i++){
+		if(started[i])
+			pthread_join(workers[i].thread, NULL);
+		else
+			run_column_worker(&workers[i]);
+	}
+	return count;
+}
+
+/*! \fn static void report_nodes(const struct column_worker* workers, unsigned int count, unsigned int n_nodes, unsigned int n_read)
+		\brief
+		This function prints the throughput of every node on stderr: the rows of
+		its workers over the time of the slowest one, and the bandwidth of
+		reading the 'n_read' columns of the plan and writing the output.
+*/
+static void report_nodes(const struct column_worker* workers, unsigned int count, unsigned int n_nodes, unsigned int n_read)
+{
+	unsigned int node, i, n;
+	uint64_t rows;
+	double seconds, bytes;
+
+	for(node = 0; node < n_nodes; node++){
+		for(i = n = 0, rows = 0, seconds = 0; i < count; i++){
+			if(workers[i].node != node)
+				continue;
+			n++;
+			rows += workers[i].last - workers[i].first;
+			seconds = workers[i].seconds > seconds ? workers[i].seconds : seconds;
+		}
+		if(n == 0)
+			continue;
+		bytes = (double)rows * sizeof(double) * (n_read + !workers[0].aggregate);
+		fprintf(stderr, "node %u: %u workers, %llu rows in %.6f s, %.1f Mrows/s, %.2f GB/s\n",
+			workers[0].numa != NULL ? workers[0].numa->ids[node] : 0, n, (unsigned long long)rows, seconds,
+			seconds > 0 ? rows / seconds * 1e-6 : 0, seconds > 0 ? bytes / seconds * 1e-9 : 0);
+	}
+}
+
+static char print_aggregate(double value, int precision)
+{
+	char text[FORMAT_MAX];
+
+	if(precision == FORMAT_SHORTEST)
+		format_shortest(value, text);
+	else
+		format_fixed(value, precision, text);
+	return printf("%s\n", text) < 0 || fflush(stdout) != 0 ? 'i' : 'n';
+}
+
+/*! \fn int run_columns(struct column_options* options)
+		\brief
+		This function runs the binary batch mode: it maps the input columns,
+		compiles the expression with the column names declared as its first
+		variables, so that slot i reads column i (the user functions are defined
+		next), and writes one result per row to the output file. An aggregate is
+		computed in the same pass over the rows and printed instead. The rows are
+		shared by options->workers threads, placed on the NUMA nodes of the
+		machine unless options->no_numa is set (see run_workers()).
+
+		\param options the options of the run.
+		\return 0 on success, -1 on failure.
+*/
+int run_columns(struct column_options* options)
+{
+	static struct column_table input, output;
+	static struct column_worker workers[COLUMN_MAX_WORKERS];
+	static struct column_reduction partials[COLUMN_MAX_WORKERS];
+	static struct numa_topology numa;
+	struct plan_context ctx;
+	struct plan* plan;
+	const uint16_t* slots;
+	char read[COLUMN_MAX] = {0};
+	unsigned int n_read = 0;
+	const char* expression = options->expression;
+	size_t error_at = 0, start = 0, end = 0, comma = 0, len = strlen(expression);
+	unsigned int i, slot, n_workers = options->workers ? options->workers : 1;
+	int aggregate = column_aggregate(expression, &start, &end, &comma);
+	char status = 'n';
+	char* text;
+
+	if(plan_context_init(&ctx) != 'n'){
+		fprintf(stderr, "Out of memory!\n");
+		return -1;
+	}
+	if(options->input != NULL)
+		status = column_open(&input, options->input);
+	for(i = 0; i < options->n_raw && status == 'n'; i++)
+		status = column_open_raw(&input, options->raw_names[i], options->raw_paths[i]);
+	if(status != 'n'){
+		fprintf(stderr, "Cannot read the input columns (status '%c')\n", status);
+		goto fail;
+	}
+
+	if(aggregate == AGGREGATE_DOT){
+		// dot(u, v) compiles as (u)*(v): the two operands lose the comma and gain 5 chars, plus the NUL
+		if((text = arena_alloc(&ctx.arena, end - start + 5, 1)) == NULL){
+			fprintf(stderr, "Out of memory!\n");
+			goto fail;
+		}
+		len = (size_t)snprintf(text, end - start + 5, "(%.*s)*(%.*s)", (int)(comma - start), expression + start, (int)(end - comma - 1), expression + comma + 1);
+		expression = text;
+	}
+	else if(aggregate != AGGREGATE_NONE){
+		expression += start;
+		len = end - start;
+	}
+	for(i = 0; i < input.ncols && status == 'n'; i++)
+		status = plan_symbol(&ctx, input.names[i], strlen(input.names[i]), &slot);
+	if(status == 'n' && declare_functions(&ctx, options->definitions, options->n_definitions) != 'n')
+		goto fail;
+	if(status == 'n')
+		status = compile_plan(&ctx, expression, len, &plan, &error_at);
+	if(status != 'n'){
+		if(aggregate == AGGREGATE_DOT)  // back to the offsets of dot(u, v) from those of (u)*(v)
+			error_at = error_at <= comma - start + 1 ? start + error_at - 1 : comma + 1 + error_at - (comma - start + 4);
+		else if(aggregate != AGGREGATE_NONE)
+			error_at += start;
+		fprintf(stderr, "SYNTAX ERROR at offset %zu\n", error_at);
+		goto fail;
+	}
+	if(plan->n_slots > 0 && plan->max_slot >= input.ncols){
+		fprintf(stderr, "UNDEFINED VARIABLE '%s'\n", ctx.symbols.names[plan->max_slot]);
+		goto fail;
+	}
+
+	slots = plan_slots(plan);
+	for(i = 0; i < plan->n_slots; i++)
+		if(!read[slots[i]]){
+			read[slots[i]] = 1;
+			n_read++;
+		}
+	numa_discover(&numa);
+
+	workers[0].plan = plan;
+	workers[0].input = &input;
+	workers[0].summation = options->summation;
+	workers[0].aggregate = aggregate != AGGREGATE_NONE;
+	workers[0].out = NULL;
+	workers[0].numa = !options->no_numa && numa.n_nodes > 1 ? &numa : NULL;
+	workers[0].read = read;
+	if(n_workers > COLUMN_MAX_WORKERS)
+		n_workers = COLUMN_MAX_WORKERS;
+	if(aggregate != AGGREGATE_NONE){
+		n_workers = run_workers(workers, partials, n_workers);
+		if(options->profile)
+			report_nodes(workers, n_workers, workers[0].numa != NULL ? numa.n_nodes : 1, n_read);
+		if(print_aggregate(column_reduction_result(partials, n_workers, aggregate, options->summation), options->precision) != 'n')
+			goto fail;
+	}
+	else{
+		if(column_create(&output, options->output, "result", input.nrows, options->raw_output) != 'n'){
+			fprintf(stderr, "Cannot create '%s'\n", options->output);
+			goto fail;
+		}
+		workers[0].out = output.columns[0];
+		n_workers = run_workers(workers, NULL, n_workers);
+		if(options->profile)
+			report_nodes(workers, n_workers, workers[0].numa != NULL ? numa.n_nodes : 1, n_read);
+		column_close(&output);
+	}
+
+	column_close(&input);
+	plan_context_release(&ctx);
+	return 0;
+
+fail:
+	column_close(&input);
+	plan_context_release(&ctx);
+	return -1;
+}
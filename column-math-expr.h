@@ -0,0 +1,98 @@
+#ifndef COLUMN_MATH_EXPR_H
+#define COLUMN_MATH_EXPR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "plan-math-expr.h"
+
+#define COLUMN_MAGIC "MXC1"
+#define COLUMN_NAME_SIZE 32
+#define COLUMN_MAX 64
+#define COLUMN_ALIGN 64
+#define COLUMN_BLOCK 128  // rows evaluated together by evaluate_plan_rows()
+#define COLUMN_LANES 8    // interleaved partial results of a reduction, so that its loop is vectorized
+#define COLUMN_MAX_WORKERS 64
+#define COLUMN_ISA_ENV "MATH_EXPR_ISA"  // forces the instruction set of the block evaluator: sse2, avx2 or avx512
+
+/* A column table file: a 16-byte header (magic, column count, row count), the
+   column names padded to COLUMN_NAME_SIZE bytes, then every column as nrows
+   little-endian doubles starting on a COLUMN_ALIGN boundary. */
+struct column_header {
+	char magic[4];
+	uint32_t ncols;
+	uint64_t nrows;
+};
+
+struct column_table {
+	uint32_t ncols;
+	uint64_t nrows;
+	char names[COLUMN_MAX][COLUMN_NAME_SIZE];
+	double* columns[COLUMN_MAX];
+	void* maps[COLUMN_MAX];     // mappings to unmap, one per file
+	size_t map_sizes[COLUMN_MAX];
+	int n_maps;
+};
+
+/* An aggregate reduces the expression over all the rows to one value: it is
+   written sum(e), mean(e), min(e), max(e) or dot(u, v) around the whole
+   expression. min() and max() with two arguments stay the built-in functions. */
+enum column_aggregate {
+	AGGREGATE_NONE,  // one result per row, written to the output column
+	AGGREGATE_SUM,
+	AGGREGATE_MEAN,
+	AGGREGATE_MIN,
+	AGGREGATE_MAX,
+	AGGREGATE_DOT    // dot(u, v) is sum(u*v)
+};
+
+enum column_summation {
+	SUMMATION_PLAIN,     // COLUMN_LANES running sums
+	SUMMATION_PAIRWISE,  // a balanced tree of sums, whose error grows with log(nrows)
+	SUMMATION_KAHAN      // compensated running sums, whose error does not grow with nrows
+};
+
+/* The partial result of an aggregate over a range of rows. */
+struct column_reduction {
+	double sum[COLUMN_LANES];
+	double compensation[COLUMN_LANES];  // the low parts lost by sum[], for SUMMATION_KAHAN
+	double levels[64];                  // for SUMMATION_PAIRWISE, levels[k] sums 2^k blocks
+	uint64_t blocks;                    // the blocks summed into levels[], whose bits tell the levels in use
+	double min[COLUMN_LANES];
+	double max[COLUMN_LANES];
+	uint64_t count;
+};
+
+struct column_options {
+	const char* expression;
+	const char* input;          // column table, or NULL with raw columns
+	const char* raw_names[COLUMN_MAX];
+	const char* raw_paths[COLUMN_MAX];
+	unsigned int n_raw;
+	const char* output;         // may be NULL for an aggregate, which is printed
+	char raw_output;            // write bare doubles instead of a table
+	int summation;              // an enum column_summation
+	int precision;              // decimals of a printed aggregate, or FORMAT_SHORTEST
+	unsigned int workers;       // threads sharing the rows
+	char no_numa;               // do not place the workers and their rows on the NUMA nodes
+	char profile;               // report the throughput of every node on stderr
+	const char* const* definitions;  // user functions, "f(x) = body"
+	unsigned int n_definitions;
+};
+
+char column_open(struct column_table* table, const char* path);
+char column_open_raw(struct column_table* table, const char* name, const char* path);
+char column_create(struct column_table* table, const char* path, const char* name, uint64_t nrows, char raw);
+void column_close(struct column_table* table);
+size_t column_offset(uint32_t ncols, uint64_t nrows, uint32_t col);
+
+void evaluate_plan_rows(const struct plan* plan, const double* const* columns, uint32_t ncols, uint64_t first, uint64_t last, double* out);
+char column_isa(const char* name);
+const char* column_isa_name(void);
+void reduce_plan_rows(const struct plan* plan, const double* const* columns, uint32_t ncols, uint64_t first, uint64_t last, int summation, struct column_reduction* reduction);
+double column_reduction_result(const struct column_reduction* partials, unsigned int count, int aggregate, int summation);
+int column_aggregate(const char* expression, size_t* start, size_t* end, size_t* comma);
+char column_summation_mode(const char* name, int* summation);
+char bind_column(struct column_options* options, char* arg);
+int run_columns(struct column_options* options);
+
+#endif
@@ -45,16 +45,16 @@ double calculate(char* status)
 		}
 		else if(*status == 'o'){
 			if(contains_nest_op(operators)){
-				operators[window_at] = '*';
+				operators[(unsigned char)window_at] = '*';
 				if(window_at < 2)
 					operands[window_at+1] = calculate(status);
 				else{
 					compute(operators, operands, &window_at);
-					operands[window_at] = calculate(status);
+					operands[(unsigned char)window_at] = calculate(status);
 				}
 			}
 			else
-				operands[window_at] = calculate(status);
+				operands[(unsigned char)window_at] = calculate(status);
 			compute(operators, operands, &window_at);
 
 			if(*status == '\n')
@@ -0,0 +1,248 @@
+/*!
+	\file corpus-math-expr.c
+	\brief
+	This file contains the generators of the benchmark corpora. A corpus is a set
+	of expressions of one kind, generated from a seed with a xorshift generator so
+	that the same seed always yields the same bytes on every host:
+		- short: a few small operands and variables, the common case
+		- literals: long decimal literals, stressing literal conversion
+		- nested: deeply nested parentheses
+		- power: chains of '^', stressing pow()
+		- wide: long flat sums, stressing the parser loop
+		- layout: 20-op formulas mixing variables and constants
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "corpus-math-expr.h"
+
+#define CORPUS_MAX_EXPR 4096
+
+const char* const corpus_kinds[] = {"short", "literals", "nested", "power", "wide", "layout", NULL};
+
+struct writer {
+	char* out;
+	int len;
+};
+
+static void put(struct writer* w, const char* text)
+{
+	int n = (int)strlen(text);
+
+	if(w->len + n < CORPUS_MAX_EXPR - 1){
+		memcpy(w->out + w->len, text, n);
+		w->len += n;
+	}
+}
+
+static void put_char(struct writer* w, char c)
+{
+	char text[2] = {c, '\0'};
+	put(w, text);
+}
+
+/*! \fn uint64_t corpus_random(uint64_t* state)
+		\brief
+		This function advances a xorshift64 generator, whose state must not be 0.
+*/
+uint64_t corpus_random(uint64_t* state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+static void put_operand(struct writer* w, uint64_t* state, int digits)
+{
+	uint64_t r = corpus_random(state);
+	char text[64];
+	int i;
+
+	if(digits == 0 && (r & 3) == 0){
+		snprintf(text, sizeof(text), "x%d", (int)((r >> 2) % CORPUS_VARS));
+		put(w, text);
+		return;
+	}
+	if(digits == 0){
+		snprintf(text, sizeof(text), (r & 4) ? "%d" : "%d.%d", (int)((r >> 8) % 100), (int)((r >> 16) % 1000));
+		put(w, text);
+		return;
+	}
+	for(i = 0; i < digits; i++){
+		if(i == digits / 2)
+			put_char(w, '.');
+		put_char(w, (char)('0' + corpus_random(state) % 10));
+	}
+}
+
+static char random_op(uint64_t* state, const char* ops)
+{
+	return ops[corpus_random(state) % strlen(ops)];
+}
+
+static void generate_short(struct writer* w, uint64_t* state)
+{
+	int n = 2 + (int)(corpus_random(state) % 4), i;
+
+	for(i = 0; i < n; i++){
+		if(i > 0)
+			put_char(w, random_op(state, "+-*/"));
+		put_operand(w, state, 0);
+	}
+}
+
+static void generate_literals(struct writer* w, uint64_t* state)
+{
+	int n = 2 + (int)(corpus_random(state) % 3), i;
+
+	for(i = 0; i < n; i++){
+		if(i > 0)
+			put_char(w, random_op(state, "+-*"));
+		put_operand(w, state, 16 + (int)(corpus_random(state) % 24));
+	}
+}
+
+static void generate_nested(struct writer* w, uint64_t* state)
+{
+	int depth = 20 + (int)(corpus_random(state) % 40), i;
+
+	if(corpus_random(state) & 1){
+		// left-nested: (((a+b)*c)-d)... keeps the operand stack shallow
+		for(i = 0; i < depth; i++)
+			put_char(w, '(');
+		put_operand(w, state, 0);
+		for(i = 0; i < depth; i++){
+			put_char(w, random_op(state, "+-*"));
+			put_operand(w, state, 0);
+			put_char(w, ')');
+		}
+	}
+	else{
+		// right-nested: a+(b*(c-(...))) grows the operand stack with the depth
+		for(i = 0; i < depth; i++){
+			put_operand(w, state, 0);
+			put_char(w, random_op(state, "+-*"));
+			put_char(w, '(');
+		}
+		put_operand(w, state, 0);
+		for(i = 0; i < depth; i++)
+			put_char(w, ')');
+	}
+}
+
+static void generate_power(struct writer* w, uint64_t* state)
+{
+	int n = 2 + (int)(corpus_random(state) % 4), i;
+	char text[64];
+
+	for(i = 0; i < n; i++){
+		uint64_t r = corpus_random(state);
+
+		if(i > 0)
+			put_char(w, random_op(state, "+*"));
+		snprintf(text, sizeof(text), "%d.%02d^%d.%d", 1 + (int)(r % 3), (int)((r >> 8) % 100), (int)((r >> 16) % 4), (int)((r >> 24) % 10));
+		put(w, text);
+		if(r & (1 << 30))
+			put(w, "^x1");
+	}
+}
+
+static void generate_wide(struct writer* w, uint64_t* state)
+{
+	int n = 100 + (int)(corpus_random(state) % 100), i;
+
+	for(i = 0; i < n; i++){
+		if(i > 0)
+			put_char(w, random_op(state, "+-"));
+		put_operand(w, state, 0);
+	}
+}
+
+static void generate_layout(struct writer* w, uint64_t* state)
+{
+	int open = 0, i;
+
+	for(i = 0; i < 10; i++){
+		uint64_t r = corpus_random(state);
+
+		if(i < 8 && (r & 7) == 0){
+			put_char(w, '(');
+			open++;
+		}
+		put_operand(w, state, 0);
+		if(open > 0 && ((r >> 20) & 3) == 0){
+			put_char(w, ')');
+			open--;
+		}
+		if(i < 9)
+			put_char(w, ((r >> 24) & 31) == 0 ? '^' : random_op(state, "+-*/+-*+"));
+	}
+	while(open-- > 0)
+		put_char(w, ')');
+}
+
+/*! \fn char corpus_generate(struct corpus* corpus, const char* kind, unsigned int count, uint64_t seed)
+		\brief
+		This function generates 'count' expressions of the given kind.
+
+		\param corpus a pointer to the corpus to fill, freed with corpus_free().
+		\param kind one of corpus_kinds.
+		\param count the number of expressions.
+		\param seed the seed of the generator (0 is replaced by a fixed seed).
+		\return 'n' on success, 's' for an unknown kind, 'm' when out of memory.
+*/
+char corpus_generate(struct corpus* corpus, const char* kind, unsigned int count, uint64_t seed)
+{
+	static void (*const generators[])(struct writer*, uint64_t*) = {
+		generate_short, generate_literals, generate_nested, generate_power, generate_wide, generate_layout
+	};
+	uint64_t state = seed ? seed : 88172645463325252ull;
+	char expr[CORPUS_MAX_EXPR];
+	size_t capacity = 1 << 16;
+	unsigned int i;
+	int k;
+
+	for(k = 0; corpus_kinds[k] != NULL && strcmp(corpus_kinds[k], kind) != 0; k++)
+		;
+	if(corpus_kinds[k] == NULL)
+		return 's';
+
+	corpus->kind = corpus_kinds[k];
+	corpus->count = count;
+	corpus->bytes = 0;
+	corpus->text = malloc(capacity);
+	corpus->offsets = malloc((count + 1) * sizeof(size_t));
+	if(corpus->text == NULL || corpus->offsets == NULL)
+		return 'm';
+
+	for(i = 0; i < count; i++){
+		struct writer w = {expr, 0};
+
+		generators[k](&w, &state);
+		expr[w.len++] = '\n';
+		if(corpus->bytes + w.len > capacity){
+			char* text;
+
+			while(corpus->bytes + w.len > capacity)
+				capacity *= 2;
+			if((text = realloc(corpus->text, capacity)) == NULL)
+				return 'm';
+			corpus->text = text;
+		}
+		corpus->offsets[i] = corpus->bytes;
+		memcpy(corpus->text + corpus->bytes, expr, w.len);
+		corpus->bytes += w.len;
+	}
+	corpus->offsets[count] = corpus->bytes;
+	return 'n';
+}
+
+void corpus_free(struct corpus* corpus)
+{
+	free(corpus->text);
+	free(corpus->offsets);
+	corpus->text = NULL;
+	corpus->offsets = NULL;
+}
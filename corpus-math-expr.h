@@ -0,0 +1,23 @@
+#ifndef CORPUS_MATH_EXPR_H
+#define CORPUS_MATH_EXPR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CORPUS_VARS 8  // corpora use the variables x0..x7
+
+struct corpus {
+	const char* kind;
+	char* text;        // the expressions, each one followed by '\n'
+	size_t* offsets;   // count + 1 offsets into text
+	unsigned int count;
+	size_t bytes;
+};
+
+extern const char* const corpus_kinds[];
+
+uint64_t corpus_random(uint64_t* state);
+char corpus_generate(struct corpus* corpus, const char* kind, unsigned int count, uint64_t seed);
+void corpus_free(struct corpus* corpus);
+
+#endif
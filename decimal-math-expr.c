@@ -0,0 +1,574 @@
+/*!
+	\file decimal-math-expr.c
+	\brief
+	This file contains the exact decimal evaluator. It runs the same plans as
+	evaluate_plan(), but every value is a decimal number with its own number of
+	digits after the dot (its scale), so 0.1+0.2 is exactly 0.3. Literals and
+	bound values keep the scale they are written with: they are read from the
+	exact text kept by emit_exact_plan(), never from the rounded doubles of the
+	constant pool, and are not rounded to the scale of the run.
+
+	Addition, subtraction, negation, products and powers with a non-negative
+	integer exponent are exact, and only the result of the expression is rounded
+	to the scale of the run, once, with its rounding mode: 0.004*1000 at scale 2
+	is 4.00 and 1.1^2 at scale 1 is 1.2, not 1.1*1.1 rounded twice. A quotient
+	and a negative power may not terminate; they are rounded to the scale of the
+	run where they are computed. A power with an exponent that is not an integer
+	is an error.
+
+	Coefficients are int64_t while they fit, with 128-bit intermediates for
+	products and quotients; only a result that does not fit in 64 bits spills to
+	a fixed-capacity bignum. Nothing is allocated, so the evaluator can run on
+	the worker threads of the pipeline.
+*/
+
+#include <string.h>
+#include "decimal-math-expr.h"
+
+static const int64_t pow10_64[19] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+	10000000000, 100000000000, 1000000000000, 10000000000000, 100000000000000,
+	1000000000000000, 10000000000000000, 100000000000000000, 1000000000000000000
+};
+
+static __int128 pow10_128(int k)  // k <= 38
+{
+	__int128 p = 1;
+
+	while(k-- > 0)
+		p *= 10;
+	return p;
+}
+
+/*! \fn static int round_away(int rounding, int negative, int half, int odd)
+		\brief
+		This function decides whether an inexact truncated quotient must move one
+		unit away from zero.
+
+		\param negative whether the exact result is negative.
+		\param half the sign of |remainder| - (|divisor| - |remainder|): above, at or below half a unit.
+		\param odd whether the truncated quotient is odd.
+*/
+static int round_away(int rounding, int negative, int half, int odd)
+{
+	switch(rounding){
+		case DECIMAL_HALF_EVEN:
+			return half > 0 || (half == 0 && odd);
+		case DECIMAL_HALF_UP:
+			return half >= 0;
+		case DECIMAL_DOWN:
+			return 0;
+		case DECIMAL_FLOOR:
+			return negative;
+		default:
+			return !negative;
+	}
+}
+
+static void set_128(struct decimal* r, __int128 value)
+{
+	if(value >= INT64_MIN && value <= INT64_MAX){
+		r->small = (int64_t)value;
+		r->big = 0;
+	}
+	else{
+		bignum_from_int128(&r->wide, value);
+		r->big = 1;
+	}
+}
+
+static void settle(struct decimal* r, const struct bignum* value)
+{
+	if(bignum_to_int64(value, &r->small) == 'n')
+		r->big = 0;
+	else{
+		r->wide = *value;
+		r->big = 1;
+	}
+}
+
+static void widen(const struct decimal* a, struct bignum* out)
+{
+	if(a->big)
+		*out = a->wide;
+	else
+		bignum_from_int64(out, a->small);
+}
+
+static void divide_128(__int128 num, __int128 den, int rounding, struct decimal* r)
+{
+	__int128 q = num / den, rest = num % den;
+	int negative = (num < 0) != (den < 0);
+
+	if(rest != 0){
+		unsigned __int128 ur = rest < 0 ? -(unsigned __int128)rest : (unsigned __int128)rest;
+		unsigned __int128 ud = den < 0 ? -(unsigned __int128)den : (unsigned __int128)den;
+		int half = ur > ud - ur ? 1 : (ur == ud - ur ? 0 : -1);
+
+		if(round_away(rounding, negative, half, (int)(q & 1)))
+			q += negative ? -1 : 1;
+	}
+	set_128(r, q);
+}
+
+static char divide_big(const struct bignum* num, const struct bignum* den, int rounding, struct decimal* r)
+{
+	struct bignum q, rest, gap, unit;
+	int negative = num->negative != den->negative;
+
+	if(bignum_divmod(&q, &rest, num, den) != 'n')
+		return 'z';
+	if(!bignum_is_zero(&rest)){
+		struct bignum d = *den;
+		int half;
+
+		d.negative = rest.negative = 0;
+		bignum_sub(&gap, &d, &rest);
+		half = bignum_compare_abs(&rest, &gap);
+		if(round_away(rounding, negative, half, q.n > 0 && (q.limb[0] & 1))){
+			bignum_from_int64(&unit, negative ? -1 : 1);
+			if(bignum_add(&q, &q, &unit) != 'n')
+				return 'v';
+		}
+	}
+	settle(r, &q);
+	return 'n';
+}
+
+static char pow10_big(struct bignum* r, uint64_t k)
+{
+	return k > DECIMAL_MAX_DIGITS ? 'v' : bignum_pow10(r, (unsigned int)k);
+}
+
+static void copy(struct decimal* r, const struct decimal* a)
+{
+	if(a->big)
+		*r = *a;
+	else{
+		r->small = a->small;
+		r->big = 0;
+		r->scale = a->scale;
+	}
+}
+
+/*! \fn static char rescale(struct decimal* a, int scale, int rounding)
+		\brief
+		This function moves 'a' to another scale: exactly to a larger one, rounding
+		with 'rounding' to a smaller one.
+
+		\return 'n' on success, 'v' on overflow.
+*/
+static char rescale(struct decimal* a, int scale, int rounding)
+{
+	int shift = scale - a->scale;
+	struct bignum x, p;
+	char status = 'n';
+
+	if(shift == 0)
+		return 'n';
+	if(!a->big && shift > 0 && shift <= 18)
+		set_128(a, (__int128)a->small * pow10_64[shift]);
+	else if(!a->big && shift < 0 && shift >= -DECIMAL_MAX_SCALE)
+		divide_128(a->small, pow10_128(-shift), rounding, a);
+	else{
+		widen(a, &x);
+		if(pow10_big(&p, (uint64_t)(shift < 0 ? -shift : shift)) != 'n')
+			return 'v';
+		if(shift < 0)
+			status = divide_big(&x, &p, rounding, a);
+		else if(bignum_mul(&x, &x, &p) != 'n')
+			return 'v';
+		else
+			settle(a, &x);
+	}
+	a->scale = scale;
+	return status;
+}
+
+/*! \fn static char literal_decimal(const struct plan_literal* literal, struct decimal* r)
+		\brief
+		This function converts the exact digits of a literal to a decimal, at the
+		scale of the literal.
+*/
+static char literal_decimal(const struct plan_literal* literal, struct decimal* r)
+{
+	struct bignum num;
+
+	r->scale = (int)literal->fraction;
+	if(literal->n_digits <= 18){
+		r->small = literal->negative ? -(int64_t)literal->value : (int64_t)literal->value;
+		r->big = 0;
+		return 'n';
+	}
+	if(bignum_from_digits(&num, literal->digits, literal->n_digits) != 'n')
+		return 'v';
+	num.negative = literal->negative && !bignum_is_zero(&num);
+	settle(r, &num);
+	return 'n';
+}
+
+static int is_negative(const struct decimal* a)
+{
+	return a->big ? a->wide.negative : a->small < 0;
+}
+
+static char negate(struct decimal* a)
+{
+	struct bignum x;
+
+	if(!a->big && a->small != INT64_MIN){
+		a->small = -a->small;
+		return 'n';
+	}
+	widen(a, &x);
+	x.negative = !x.negative && !bignum_is_zero(&x);
+	settle(a, &x);
+	return 'n';
+}
+
+static char add(struct decimal* a, const struct decimal* b, int subtract)
+{
+	struct decimal aligned;
+	struct bignum x, y;
+	int64_t sum;
+
+	if(a->scale < b->scale && rescale(a, b->scale, DECIMAL_DOWN) != 'n')
+		return 'v';
+	if(b->scale < a->scale){
+		copy(&aligned, b);
+		if(rescale(&aligned, a->scale, DECIMAL_DOWN) != 'n')
+			return 'v';
+		b = &aligned;
+	}
+	if(!a->big && !b->big
+		&& !(subtract ? __builtin_sub_overflow(a->small, b->small, &sum) : __builtin_add_overflow(a->small, b->small, &sum))){
+		a->small = sum;
+		return 'n';
+	}
+	widen(a, &x);
+	widen(b, &y);
+	if((subtract ? bignum_sub(&x, &x, &y) : bignum_add(&x, &x, &y)) != 'n')
+		return 'v';
+	settle(a, &x);
+	return 'n';
+}
+
+static char multiply(struct decimal* a, const struct decimal* b)
+{
+	struct bignum x, y;
+
+	if(a->scale + b->scale > DECIMAL_MAX_DIGITS)
+		return 'v';
+	a->scale += b->scale;
+	if(!a->big && !b->big){
+		set_128(a, (__int128)a->small * b->small);
+		return 'n';
+	}
+	widen(a, &x);
+	widen(b, &y);
+	if(bignum_mul(&x, &x, &y) != 'n')
+		return 'v';
+	settle(a, &x);
+	return 'n';
+}
+
+/*! \fn static char divide(struct decimal* a, const struct decimal* b, const struct decimal_mode* mode)
+		\brief
+		This function divides 'a' by 'b', rounding the quotient to the scale of the
+		run. With a = c / 10^s and b = d / 10^t, the coefficient of the quotient is
+		c * 10^(scale - s + t) / d, where a negative power of ten moves to the divisor.
+*/
+static char divide(struct decimal* a, const struct decimal* b, const struct decimal_mode* mode)
+{
+	int shift = mode->scale - a->scale + b->scale;
+	struct bignum x, y, p;
+
+	if(!b->big && b->small == 0)
+		return 'z';
+	a->scale = mode->scale;
+	if(!a->big && !b->big && shift >= 0 && shift <= 18){
+		divide_128((__int128)a->small * pow10_64[shift], b->small, mode->rounding, a);
+		return 'n';
+	}
+	if(!a->big && !b->big && shift < 0 && shift >= -18){
+		divide_128(a->small, (__int128)b->small * pow10_64[-shift], mode->rounding, a);
+		return 'n';
+	}
+	widen(a, &x);
+	widen(b, &y);
+	if(pow10_big(&p, (uint64_t)(shift < 0 ? -shift : shift)) != 'n' || bignum_mul(shift < 0 ? &y : &x, shift < 0 ? &y : &x, &p) != 'n')
+		return 'v';
+	return divide_big(&x, &y, mode->rounding, a);
+}
+
+/*! \fn static char power(struct decimal* a, const struct decimal* b, const struct decimal_mode* mode)
+		\brief
+		This function raises 'a' to the integer power 'b'. With c the coefficient of
+		'a' and s its scale, a^n = c^n / 10^(s*n) exactly, and a^-m = 10^(s*m) / c^m,
+		whose coefficient at the scale of the run is divided exactly and rounded once.
+
+		\return 'n' on success, 'x' if 'b' is not an integer, 'z' for a negative power of zero, 'v' on overflow.
+*/
+static char power(struct decimal* a, const struct decimal* b, const struct decimal_mode* mode)
+{
+	struct bignum base, num, den;
+	int64_t n;
+	uint64_t m;
+
+	if(!b->big && b->scale <= 18){
+		if(b->small % pow10_64[b->scale] != 0)
+			return 'x';
+		n = b->small / pow10_64[b->scale];
+	}
+	else{
+		struct bignum exponent, rest, p;
+
+		widen(b, &exponent);
+		if(pow10_big(&p, (uint64_t)b->scale) != 'n')
+			return 'v';
+		bignum_divmod(&exponent, &rest, &exponent, &p);
+		if(!bignum_is_zero(&rest))
+			return 'x';
+		if(bignum_to_int64(&exponent, &n) != 'n')
+			return 'v';
+	}
+	m = n < 0 ? (uint64_t)0 - (uint64_t)n : (uint64_t)n;
+	widen(a, &base);
+	if(n == 0){
+		a->small = 1;
+		a->big = 0;
+		a->scale = 0;
+		return 'n';
+	}
+	if(n > 0){
+		if((uint64_t)a->scale * m > DECIMAL_MAX_DIGITS || bignum_pow(&num, &base, m) != 'n')
+			return 'v';
+		a->scale *= (int)m;
+		settle(a, &num);
+		return 'n';
+	}
+	if(bignum_is_zero(&base))
+		return 'z';
+	if(pow10_big(&num, (uint64_t)a->scale * m + (uint64_t)mode->scale) != 'n' || bignum_pow(&den, &base, m) != 'n')
+		return 'v';
+	a->scale = mode->scale;
+	return divide_big(&num, &den, mode->rounding, a);
+}
+
+/*! \fn char decimal_rounding_mode(const char* name, int* rounding)
+		\brief
+		This function reads the name of a rounding mode: half-even, half-up, down,
+		floor or ceiling.
+
+		\return 'n' on success, 's' for an unknown name.
+*/
+char decimal_rounding_mode(const char* name, int* rounding)
+{
+	static const char* const names[] = {"half-even", "half-up", "down", "floor", "ceiling"};
+	int i;
+
+	for(i = 0; i < 5; i++){
+		if(strcmp(name, names[i]) == 0){
+			*rounding = i;
+			return 'n';
+		}
+	}
+	return 's';
+}
+
+/*! \fn char decimal_parse(const char* text, size_t len, struct decimal* value)
+		\brief
+		This function reads a decimal number, such as the value of a '--var', with
+		an optional sign, digits and at most one dot. The number keeps its own scale.
+
+		\return 'n' on success, 's' if the text is not a number, 'v' if it is too long.
+*/
+char decimal_parse(const char* text, size_t len, struct decimal* value)
+{
+	char digits[BIGNUM_LIMBS * 10];
+	struct plan_literal literal = {digits, 0, 0, 0, 0};
+	int dot = 0;
+	size_t i = 0;
+
+	if(i < len && (text[i] == '-' || text[i] == '+'))
+		literal.negative = text[i++] == '-';
+	for(; i < len; i++){
+		if(text[i] == '.' && !dot)
+			dot = 1;
+		else if(text[i] >= '0' && text[i] <= '9'){
+			if(literal.n_digits == sizeof(digits))
+				return 'v';
+			digits[literal.n_digits++] = text[i];
+			literal.value = literal.value * 10 + (uint64_t)(text[i] - '0');
+			literal.fraction += (uint32_t)dot;
+		}
+		else
+			return 's';
+	}
+	if(literal.n_digits == 0)
+		return 's';
+	return literal_decimal(&literal, value);
+}
+
+/*! \fn int decimal_format(const struct decimal* value, int scale, char* out)
+		\brief
+		This function writes a decimal number with exactly 'scale' digits after the dot.
+
+		\param out a buffer of at least DECIMAL_FORMAT_MAX chars.
+		\return the length written, without the terminating NUL.
+*/
+int decimal_format(const struct decimal* value, int scale, char* out)
+{
+	char digits[DECIMAL_FORMAT_MAX];
+	const char* first = digits;
+	int n = 0, len, negative;
+
+	if(value->big){
+		len = bignum_to_string(&value->wide, digits, sizeof(digits));
+		negative = value->wide.negative;
+	}
+	else{
+		uint64_t magnitude = value->small < 0 ? (uint64_t)0 - (uint64_t)value->small : (uint64_t)value->small;
+		char* p = digits + sizeof(digits);
+
+		do{
+			*--p = (char)('0' + magnitude % 10);
+			magnitude /= 10;
+		}while(magnitude != 0);
+		len = (int)(digits + sizeof(digits) - p);
+		first = p;
+		negative = value->small < 0;
+	}
+	if(value->big && negative){
+		first++;
+		len--;
+	}
+
+	if(negative)
+		out[n++] = '-';
+	if(len <= scale){
+		out[n++] = '0';
+		out[n++] = '.';
+		memset(out + n, '0', (size_t)(scale - len));
+		n += scale - len;
+		memcpy(out + n, first, (size_t)len);
+		n += len;
+	}
+	else{
+		memcpy(out + n, first, (size_t)(len - scale));
+		n += len - scale;
+		if(scale > 0){
+			out[n++] = '.';
+			memcpy(out + n, first + len - scale, (size_t)scale);
+			n += scale;
+		}
+	}
+	out[n] = '\0';
+	return n;
+}
+
+/*! \fn static char extreme(struct decimal* a, const struct decimal* b, int maximum)
+		\brief
+		This function keeps in 'a' the smaller of 'a' and 'b', or the larger one
+		with 'maximum' set, by the sign of their exact difference.
+*/
+static char extreme(struct decimal* a, const struct decimal* b, int maximum)
+{
+	struct decimal difference = *a;
+	char status = add(&difference, b, 1);
+
+	if(status == 'n' && is_negative(&difference) == maximum)
+		*a = *b;
+	return status;
+}
+
+/*! \fn char evaluate_decimal(const struct plan* plan, const struct plan_literal* literals, const struct decimal* vars, const struct decimal_mode* mode, struct decimal* result)
+		\brief
+		This function evaluates a plan in exact decimal arithmetic. The operand stack
+		lives on the C stack, so evaluation performs no heap allocation.
+
+		\param plan a plan compiled by compile_exact_plan().
+		\param literals the literals kept with the plan.
+		\param vars the values of the variables, indexed by slot.
+		\param mode the scale and the rounding mode.
+		\param result a pointer that receives the result, at the scale of 'mode'.
+		\return a char indicating the status of the evaluation:
+			- 'n' on success
+			- 'z' for a division by zero or a negative power of zero
+			- 'x' for a power with a non-integer exponent
+			- 'u' for sqrt, exp, log and sin, whose results are not exact
+			- 'v' if a value exceeds the capacity of the bignums
+*/
+char evaluate_decimal(const struct plan* plan, const struct plan_literal* literals, const struct decimal* vars, const struct decimal_mode* mode, struct decimal* result)
+{
+	struct decimal stack[PLAN_MAX_STACK];
+	const uint16_t* slot = plan_slots(plan);
+	const uint8_t* code = plan_code(plan);
+	const struct decimal* var;
+	char status = 'n';
+	int top = -1;
+	uint32_t i;
+
+	for(i = 0; i < plan->length && status == 'n'; i++){
+		switch(code[i]){
+			case PLAN_CONST:
+			case PLAN_ICONST:
+				status = literal_decimal(literals++, &stack[++top]);
+				break;
+			case PLAN_VAR:
+			case PLAN_ARG:
+				var = code[i] == PLAN_VAR ? &vars[*slot++] : &stack[code[++i]];
+				copy(&stack[++top], var);
+				break;
+			case PLAN_RETURN:
+			case PLAN_IRETURN:
+				var = &stack[top--];
+				copy(&stack[top], var);
+				break;
+			case PLAN_NEG:
+			case PLAN_INEG:
+				status = negate(&stack[top]);
+				break;
+			case PLAN_ADD:
+			case PLAN_SUB:
+			case PLAN_IADD:
+			case PLAN_ISUB:
+				top--;
+				status = add(&stack[top], &stack[top+1], code[i] == PLAN_SUB || code[i] == PLAN_ISUB);
+				break;
+			case PLAN_MUL:
+			case PLAN_IMUL:
+				top--;
+				status = multiply(&stack[top], &stack[top+1]);
+				break;
+			case PLAN_DIV:
+				top--;
+				status = divide(&stack[top], &stack[top+1], mode);
+				break;
+			case PLAN_POW:
+			case PLAN_IPOW:
+				top--;
+				status = power(&stack[top], &stack[top+1], mode);
+				break;
+			case PLAN_FLOAT:
+			case PLAN_FLOAT_NEXT:
+				break;
+			case PLAN_ABS:
+				if(is_negative(&stack[top]))
+					status = negate(&stack[top]);
+				break;
+			case PLAN_MIN:
+			case PLAN_MAX:
+				top--;
+				status = extreme(&stack[top], &stack[top+1], code[i] == PLAN_MAX);
+				break;
+			default:
+				status = 'u';
+		}
+	}
+	if(status == 'n'){
+		copy(result, &stack[0]);
+		status = rescale(result, mode->scale, mode->rounding);
+	}
+	return status;
+}
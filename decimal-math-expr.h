@@ -0,0 +1,42 @@
+#ifndef DECIMAL_MATH_EXPR_H
+#define DECIMAL_MATH_EXPR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "plan-math-expr.h"
+#include "bignum-math-expr.h"
+
+#define DECIMAL_MAX_SCALE 38
+#define DECIMAL_MAX_DIGITS (BIGNUM_LIMBS * 10)  // largest scale of an intermediate value
+#define DECIMAL_FORMAT_MAX (BIGNUM_LIMBS * 10 + 4)  // longest formatted decimal, '\0' included
+
+enum decimal_rounding {
+	DECIMAL_HALF_EVEN,  // to nearest, ties to the even neighbour (banker's rounding)
+	DECIMAL_HALF_UP,    // to nearest, ties away from zero
+	DECIMAL_DOWN,       // toward zero
+	DECIMAL_FLOOR,      // toward -infinity
+	DECIMAL_CEILING     // toward +infinity
+};
+
+struct decimal_mode {
+	int scale;          // digits kept after the dot, 0 to DECIMAL_MAX_SCALE
+	int rounding;       // an enum decimal_rounding
+};
+
+/* A decimal number is an integer coefficient c standing for c / 10^scale,
+   where the scale is the number's own. The coefficient is an int64_t while it
+   fits; 'big' is set when it lives in 'wide' instead. Only the active field is
+   meaningful. */
+struct decimal {
+	int64_t small;
+	int big;
+	int scale;
+	struct bignum wide;
+};
+
+char decimal_rounding_mode(const char* name, int* rounding);
+char decimal_parse(const char* text, size_t len, struct decimal* value);
+int decimal_format(const struct decimal* value, int scale, char* out);
+char evaluate_decimal(const struct plan* plan, const struct plan_literal* literals, const struct decimal* vars, const struct decimal_mode* mode, struct decimal* result);
+
+#endif
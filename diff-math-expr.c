@@ -0,0 +1,379 @@
+/*!
+	\file diff-math-expr.c
+	\brief
+	This file contains the automatic differentiation of compiled plans, which
+	gives exact derivatives (up to rounding) where finite differences need two
+	extra evaluations per variable and lose half the digits.
+
+	diff_forward() propagates dual numbers: every stack entry carries its value
+	and its derivatives along DIFF_LANES directions, updated together by loops
+	of fixed length that the compiler vectorizes. More directions take more
+	passes. It suits a few directions, such as a directional derivative.
+
+	diff_reverse() records the values of a plan on a tape, then propagates the
+	adjoints backward from the result: one forward and one backward pass give
+	the whole gradient, whatever the number of variables. The tape is allocated
+	from the context's arena by diff_tape_init(); instructions that depend on
+	no variable are skipped on the way back. The argument of a user function
+	read several times through PLAN_ARG keeps a single node, whose adjoint
+	gathers every use.
+
+	For x^y, d/dx = y*x^(y-1) and d/dy = x^y*ln(x). A term whose operand does not
+	vary is dropped rather than multiplied by zero, so a constant exponent on a
+	negative base, where ln(x) is NaN, still differentiates. Integer opcodes are
+	differentiated as their double counterparts. abs'(0) is taken as 0, and min
+	and max pass the derivative of the argument they return.
+*/
+
+#include <string.h>
+#include <math.h>
+#include "function-math-expr.h"
+#include "diff-math-expr.h"
+
+/*! \fn static double unary(uint8_t op, double x, double* derivative)
+		\brief
+		This function returns f(x) for the one-argument built-in function 'op',
+		and its derivative f'(x).
+*/
+static double unary(uint8_t op, double x, double* derivative)
+{
+	double r;
+
+	switch(op){
+		case PLAN_SQRT:
+			r = sqrt(x);
+			*derivative = 0.5 / r;
+			return r;
+		case PLAN_EXP:
+			r = function_exp(x);
+			*derivative = r;
+			return r;
+		case PLAN_LOG:
+			*derivative = 1 / x;
+			return function_log(x);
+		case PLAN_SIN:
+			*derivative = cos(x);
+			return function_sin(x);
+		default:
+			*derivative = x > 0 ? 1 : (x < 0 ? -1 : 0);
+			return fabs(x);
+	}
+}
+
+static int picks_second(uint8_t op, double a, double b)  // whether min() or max() returns b
+{
+	return (op == PLAN_MIN ? b < a : b > a) || a != a;
+}
+
+/*! \fn double diff_forward(const struct plan* plan, const double* vars, const double* seeds, unsigned int n_vars, unsigned int n_directions, double* tangents)
+		\brief
+		This function evaluates a plan and its directional derivatives in forward
+		mode. The operand stack lives on the C stack, so it does not allocate.
+
+		\param plan a compiled plan.
+		\param vars the values of the variables, indexed by slot.
+		\param seeds the directions: direction d is seeds[d * n_vars + slot].
+		\param n_vars the number of variables of a direction (more than the highest slot of the plan).
+		\param n_directions the number of directions.
+		\param tangents an array that receives the 'n_directions' derivatives.
+		\return the value of the expression.
+*/
+double diff_forward(const struct plan* plan, const double* vars, const double* seeds, unsigned int n_vars, unsigned int n_directions, double* tangents)
+{
+	double value[PLAN_MAX_STACK];
+	double tangent[PLAN_MAX_STACK][DIFF_LANES] __attribute__((aligned(32)));
+	const uint8_t* code = plan_code(plan);
+	unsigned int first, k;
+
+	value[0] = 0;
+	for(first = 0; first < n_directions || first == 0; first += DIFF_LANES){
+		const double* constant = plan_constants(plan);
+		const uint16_t* slot = plan_slots(plan);
+		int top = -1;
+		uint32_t i;
+
+		for(i = 0; i < plan->length; i++){
+			double* ta = tangent[top > 0 ? top - 1 : 0];
+			double* tb = tangent[top >= 0 ? top : 0];
+			double va, vb, r, ca, cb;
+
+			switch(code[i]){
+				case PLAN_CONST:
+				case PLAN_ICONST:
+					top++;
+					value[top] = code[i] == PLAN_CONST ? *constant : (double)*(const int64_t*)constant;
+					constant++;
+					for(k = 0; k < DIFF_LANES; k++)
+						tangent[top][k] = 0;
+					break;
+				case PLAN_VAR:
+					top++;
+					value[top] = vars[*slot];
+					for(k = 0; k < DIFF_LANES; k++)
+						tangent[top][k] = first + k < n_directions ? seeds[(first + k) * n_vars + *slot] : 0;
+					slot++;
+					break;
+				case PLAN_NEG:
+				case PLAN_INEG:
+					value[top] = -value[top];
+					for(k = 0; k < DIFF_LANES; k++)
+						tb[k] = -tb[k];
+					break;
+				case PLAN_ADD:
+				case PLAN_IADD:
+					top--;
+					value[top] += value[top+1];
+					for(k = 0; k < DIFF_LANES; k++)
+						ta[k] += tb[k];
+					break;
+				case PLAN_SUB:
+				case PLAN_ISUB:
+					top--;
+					value[top] -= value[top+1];
+					for(k = 0; k < DIFF_LANES; k++)
+						ta[k] -= tb[k];
+					break;
+				case PLAN_MUL:
+				case PLAN_IMUL:
+					top--;
+					va = value[top];
+					vb = value[top+1];
+					value[top] = va * vb;
+					for(k = 0; k < DIFF_LANES; k++)
+						ta[k] = ta[k] * vb + va * tb[k];
+					break;
+				case PLAN_DIV:
+					top--;
+					vb = value[top+1];
+					r = value[top] / vb;
+					value[top] = r;
+					for(k = 0; k < DIFF_LANES; k++)
+						ta[k] = (ta[k] - r * tb[k]) / vb;
+					break;
+				case PLAN_POW:
+				case PLAN_IPOW:
+					top--;
+					va = value[top];
+					vb = value[top+1];
+					r = pow(va, vb);
+					ca = vb * pow(va, vb - 1);
+					cb = r * log(va);
+					value[top] = r;
+					for(k = 0; k < DIFF_LANES; k++)
+						ta[k] = (ta[k] != 0 ? ca * ta[k] : 0) + (tb[k] != 0 ? cb * tb[k] : 0);
+					break;
+				case PLAN_FLOAT:
+				case PLAN_FLOAT_NEXT:
+					break;
+				case PLAN_SQRT:
+				case PLAN_EXP:
+				case PLAN_LOG:
+				case PLAN_SIN:
+				case PLAN_ABS:
+					value[top] = unary(code[i], value[top], &ca);
+					for(k = 0; k < DIFF_LANES; k++)
+						tb[k] = tb[k] != 0 ? ca * tb[k] : 0;
+					break;
+				case PLAN_MIN:
+				case PLAN_MAX:
+					top--;
+					if(picks_second(code[i], value[top], value[top+1])){
+						value[top] = value[top+1];
+						for(k = 0; k < DIFF_LANES; k++)
+							ta[k] = tb[k];
+					}
+					break;
+				case PLAN_ARG:
+					top++;
+					value[top] = value[code[i+1]];
+					for(k = 0; k < DIFF_LANES; k++)
+						tangent[top][k] = tangent[code[i+1]][k];
+					i++;
+					break;
+				case PLAN_RETURN:
+				case PLAN_IRETURN:
+					top--;
+					value[top] = value[top+1];
+					for(k = 0; k < DIFF_LANES; k++)
+						ta[k] = tb[k];
+					break;
+			}
+		}
+		for(k = 0; k < DIFF_LANES && first + k < n_directions; k++)
+			tangents[first + k] = tangent[0][k];
+	}
+	return value[0];
+}
+
+/*! \fn char diff_tape_init(struct plan_context* ctx, const struct plan* plan, struct diff_tape* tape)
+		\brief
+		This function allocates the tape of a plan from the arena of 'ctx'. A tape
+		can be reused for any number of diff_reverse() calls on the same plan.
+
+		\return 'n' on success, 'm' when the arena is out of memory.
+*/
+char diff_tape_init(struct plan_context* ctx, const struct plan* plan, struct diff_tape* tape)
+{
+	tape->length = plan->length;
+	tape->values = arena_alloc(&ctx->arena, plan->length * sizeof(double), 64);
+	tape->adjoints = arena_alloc(&ctx->arena, plan->length * sizeof(double), 64);
+	tape->operands = arena_alloc(&ctx->arena, 2 * plan->length * sizeof(uint32_t), 8);
+	tape->active = arena_alloc(&ctx->arena, plan->length, 8);
+	if(tape->values == NULL || tape->adjoints == NULL || tape->operands == NULL || tape->active == NULL)
+		return 'm';
+	return 'n';
+}
+
+/*! \fn double diff_reverse(const struct plan* plan, const double* vars, struct diff_tape* tape, unsigned int n_vars, double* gradient)
+		\brief
+		This function evaluates a plan and its gradient in reverse mode.
+
+		\param plan a compiled plan.
+		\param vars the values of the variables, indexed by slot.
+		\param tape a tape initialized for the plan by diff_tape_init().
+		\param n_vars the size of 'gradient' (more than the highest slot of the plan).
+		\param gradient an array that receives the partial derivative of every variable.
+		\return the value of the expression.
+*/
+double diff_reverse(const struct plan* plan, const double* vars, struct diff_tape* tape, unsigned int n_vars, double* gradient)
+{
+	uint32_t index[PLAN_MAX_STACK];
+	const double* constant = plan_constants(plan);
+	const uint16_t* slot = plan_slots(plan);
+	const uint8_t* code = plan_code(plan);
+	double* value = tape->values;
+	double* adjoint = tape->adjoints;
+	uint32_t* operand = tape->operands;
+	uint8_t* active = tape->active;
+	uint32_t i, a, b;
+	int top = -1;
+	double g, d;
+
+	// forward: evaluate, and record the operands of every instruction
+	for(i = 0; i < plan->length; i++){
+		switch(code[i]){
+			case PLAN_CONST:
+			case PLAN_ICONST:
+				value[i] = code[i] == PLAN_CONST ? *constant : (double)*(const int64_t*)constant;
+				constant++;
+				active[i] = 0;
+				index[++top] = i;
+				break;
+			case PLAN_VAR:
+				value[i] = vars[*slot];
+				operand[2*i] = *slot++;
+				active[i] = 1;
+				index[++top] = i;
+				break;
+			case PLAN_NEG:
+			case PLAN_INEG:
+				a = index[top];
+				value[i] = -value[a];
+				operand[2*i] = a;
+				active[i] = active[a];
+				index[top] = i;
+				break;
+			case PLAN_FLOAT:
+			case PLAN_FLOAT_NEXT:
+				active[i] = 0;
+				break;
+			case PLAN_ARG:  // the stack entry is the node of the argument itself
+				index[top+1] = index[code[i+1]];
+				top++;
+				active[i] = active[i+1] = 0;
+				i++;
+				break;
+			case PLAN_RETURN:
+			case PLAN_IRETURN:
+				top--;
+				index[top] = index[top+1];
+				active[i] = 0;
+				break;
+			case PLAN_SQRT:
+			case PLAN_EXP:
+			case PLAN_LOG:
+			case PLAN_SIN:
+			case PLAN_ABS:
+				a = index[top];
+				value[i] = unary(code[i], value[a], &g);
+				operand[2*i] = a;
+				active[i] = active[a];
+				index[top] = i;
+				break;
+			default:
+				b = index[top--];
+				a = index[top];
+				operand[2*i] = a;
+				operand[2*i+1] = b;
+				active[i] = active[a] | active[b];
+				index[top] = i;
+				switch(code[i]){
+					case PLAN_ADD: case PLAN_IADD: value[i] = value[a] + value[b]; break;
+					case PLAN_SUB: case PLAN_ISUB: value[i] = value[a] - value[b]; break;
+					case PLAN_MUL: case PLAN_IMUL: value[i] = value[a] * value[b]; break;
+					case PLAN_DIV: value[i] = value[a] / value[b]; break;
+					case PLAN_MIN: case PLAN_MAX: value[i] = picks_second(code[i], value[a], value[b]) ? value[b] : value[a]; break;
+					default: value[i] = pow(value[a], value[b]); break;
+				}
+		}
+	}
+
+	// backward: propagate the adjoints from the result to the variables
+	memset(gradient, 0, n_vars * sizeof(double));
+	memset(adjoint, 0, plan->length * sizeof(double));
+	adjoint[index[0]] = 1;
+	for(i = index[0] + 1; i-- > 0; ){
+		if(!active[i] || (g = adjoint[i]) == 0)
+			continue;
+		a = operand[2*i];
+		b = operand[2*i+1];
+		switch(code[i]){
+			case PLAN_VAR:
+				gradient[a] += g;
+				break;
+			case PLAN_NEG:
+			case PLAN_INEG:
+				adjoint[a] -= g;
+				break;
+			case PLAN_ADD:
+			case PLAN_IADD:
+				adjoint[a] += g;
+				adjoint[b] += g;
+				break;
+			case PLAN_SUB:
+			case PLAN_ISUB:
+				adjoint[a] += g;
+				adjoint[b] -= g;
+				break;
+			case PLAN_MUL:
+			case PLAN_IMUL:
+				adjoint[a] += g * value[b];
+				adjoint[b] += g * value[a];
+				break;
+			case PLAN_DIV:
+				adjoint[a] += g / value[b];
+				adjoint[b] -= g * value[i] / value[b];
+				break;
+			case PLAN_POW:
+			case PLAN_IPOW:
+				if(active[a])
+					adjoint[a] += g * value[b] * pow(value[a], value[b] - 1);
+				if(active[b] && value[i] != 0)
+					adjoint[b] += g * value[i] * log(value[a]);
+				break;
+			case PLAN_SQRT:
+			case PLAN_EXP:
+			case PLAN_LOG:
+			case PLAN_SIN:
+			case PLAN_ABS:
+				unary(code[i], value[a], &d);
+				adjoint[a] += g * d;
+				break;
+			case PLAN_MIN:
+			case PLAN_MAX:
+				adjoint[picks_second(code[i], value[a], value[b]) ? b : a] += g;
+				break;
+		}
+	}
+	return value[index[0]];
+}
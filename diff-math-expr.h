@@ -0,0 +1,24 @@
+#ifndef DIFF_MATH_EXPR_H
+#define DIFF_MATH_EXPR_H
+
+#include <stdint.h>
+#include "plan-math-expr.h"
+
+#define DIFF_LANES 4  // directions carried by one forward pass
+
+/* The tape of a reverse-mode pass: for every instruction of the plan, its
+   value, its operands (instruction indices, or the slot of a PLAN_VAR),
+   whether it depends on a variable, and its adjoint. */
+struct diff_tape {
+	double* values;
+	double* adjoints;
+	uint32_t* operands;
+	uint8_t* active;
+	uint32_t length;
+};
+
+double diff_forward(const struct plan* plan, const double* vars, const double* seeds, unsigned int n_vars, unsigned int n_directions, double* tangents);
+char diff_tape_init(struct plan_context* ctx, const struct plan* plan, struct diff_tape* tape);
+double diff_reverse(const struct plan* plan, const double* vars, struct diff_tape* tape, unsigned int n_vars, double* gradient);
+
+#endif
@@ -0,0 +1,497 @@
+/*!
+	\file format-math-expr.c
+	\brief
+	This file contains the formatting of results. printf() is slow, depends on the
+	locale and its "%.3lf" silently drops digits, so results are formatted here:
+		- format_shortest() writes the shortest digits that read back as the same
+		  double, with the Grisu2 algorithm (Florian Loitsch, "Printing
+		  floating-point numbers quickly and accurately with integers", 2010). Its
+		  output always round-trips and is the shortest one in all but a tiny
+		  fraction of cases, where it is one digit longer.
+		- format_fixed() writes a fixed number of decimals, correctly rounded (ties
+		  to even, like glibc), with exact 128-bit integer arithmetic.
+	An outbuf gathers the formatted text and hands it to write() in large blocks.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <errno.h>
+#include "format-math-expr.h"
+
+struct diyfp {
+	uint64_t f;
+	int e;
+};
+
+static const uint64_t pow10_u64[20] = {
+	1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull,
+	1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull,
+	100000000000000ull, 1000000000000000ull, 10000000000000000ull, 100000000000000000ull,
+	1000000000000000000ull, 10000000000000000000ull
+};
+
+/* 10^k for k = -348, -340, ..., 340, normalized to 64-bit significands. */
+static const struct diyfp cached_powers[87] = {
+	{0xfa8fd5a0081c0288ull, -1220}, {0xbaaee17fa23ebf76ull, -1193},
+	{0x8b16fb203055ac76ull, -1166}, {0xcf42894a5dce35eaull, -1140},
+	{0x9a6bb0aa55653b2dull, -1113}, {0xe61acf033d1a45dfull, -1087},
+	{0xab70fe17c79ac6caull, -1060}, {0xff77b1fcbebcdc4full, -1034},
+	{0xbe5691ef416bd60cull, -1007}, {0x8dd01fad907ffc3cull, -980},
+	{0xd3515c2831559a83ull, -954}, {0x9d71ac8fada6c9b5ull, -927},
+	{0xea9c227723ee8bcbull, -901}, {0xaecc49914078536dull, -874},
+	{0x823c12795db6ce57ull, -847}, {0xc21094364dfb5637ull, -821},
+	{0x9096ea6f3848984full, -794}, {0xd77485cb25823ac7ull, -768},
+	{0xa086cfcd97bf97f4ull, -741}, {0xef340a98172aace5ull, -715},
+	{0xb23867fb2a35b28eull, -688}, {0x84c8d4dfd2c63f3bull, -661},
+	{0xc5dd44271ad3cdbaull, -635}, {0x936b9fcebb25c996ull, -608},
+	{0xdbac6c247d62a584ull, -582}, {0xa3ab66580d5fdaf6ull, -555},
+	{0xf3e2f893dec3f126ull, -529}, {0xb5b5ada8aaff80b8ull, -502},
+	{0x87625f056c7c4a8bull, -475}, {0xc9bcff6034c13053ull, -449},
+	{0x964e858c91ba2655ull, -422}, {0xdff9772470297ebdull, -396},
+	{0xa6dfbd9fb8e5b88full, -369}, {0xf8a95fcf88747d94ull, -343},
+	{0xb94470938fa89bcfull, -316}, {0x8a08f0f8bf0f156bull, -289},
+	{0xcdb02555653131b6ull, -263}, {0x993fe2c6d07b7facull, -236},
+	{0xe45c10c42a2b3b06ull, -210}, {0xaa242499697392d3ull, -183},
+	{0xfd87b5f28300ca0eull, -157}, {0xbce5086492111aebull, -130},
+	{0x8cbccc096f5088ccull, -103}, {0xd1b71758e219652cull, -77},
+	{0x9c40000000000000ull, -50}, {0xe8d4a51000000000ull, -24},
+	{0xad78ebc5ac620000ull, 3}, {0x813f3978f8940984ull, 30},
+	{0xc097ce7bc90715b3ull, 56}, {0x8f7e32ce7bea5c70ull, 83},
+	{0xd5d238a4abe98068ull, 109}, {0x9f4f2726179a2245ull, 136},
+	{0xed63a231d4c4fb27ull, 162}, {0xb0de65388cc8ada8ull, 189},
+	{0x83c7088e1aab65dbull, 216}, {0xc45d1df942711d9aull, 242},
+	{0x924d692ca61be758ull, 269}, {0xda01ee641a708deaull, 295},
+	{0xa26da3999aef774aull, 322}, {0xf209787bb47d6b85ull, 348},
+	{0xb454e4a179dd1877ull, 375}, {0x865b86925b9bc5c2ull, 402},
+	{0xc83553c5c8965d3dull, 428}, {0x952ab45cfa97a0b3ull, 455},
+	{0xde469fbd99a05fe3ull, 481}, {0xa59bc234db398c25ull, 508},
+	{0xf6c69a72a3989f5cull, 534}, {0xb7dcbf5354e9beceull, 561},
+	{0x88fcf317f22241e2ull, 588}, {0xcc20ce9bd35c78a5ull, 614},
+	{0x98165af37b2153dfull, 641}, {0xe2a0b5dc971f303aull, 667},
+	{0xa8d9d1535ce3b396ull, 694}, {0xfb9b7cd9a4a7443cull, 720},
+	{0xbb764c4ca7a44410ull, 747}, {0x8bab8eefb6409c1aull, 774},
+	{0xd01fef10a657842cull, 800}, {0x9b10a4e5e9913129ull, 827},
+	{0xe7109bfba19c0c9dull, 853}, {0xac2820d9623bf429ull, 880},
+	{0x80444b5e7aa7cf85ull, 907}, {0xbf21e44003acdd2dull, 933},
+	{0x8e679c2f5e44ff8full, 960}, {0xd433179d9c8cb841ull, 986},
+	{0x9e19db92b4e31ba9ull, 1013}, {0xeb96bf6ebadf77d9ull, 1039},
+	{0xaf87023b9bf0ee6bull, 1066},
+};
+
+static struct diyfp diyfp_normalize(struct diyfp x)
+{
+	int shift = __builtin_clzll(x.f);
+
+	x.f <<= shift;
+	x.e -= shift;
+	return x;
+}
+
+static struct diyfp diyfp_multiply(struct diyfp a, struct diyfp b)
+{
+	unsigned __int128 p = (unsigned __int128)a.f * b.f;
+	struct diyfp r;
+
+	r.f = (uint64_t)(p >> 64) + (uint64_t)((p >> 63) & 1);  // rounded
+	r.e = a.e + b.e + 64;
+	return r;
+}
+
+static struct diyfp cached_power(int e, int* k)
+{
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int i = (int)dk;
+
+	if(dk - i > 0.0)
+		i++;
+	i = (i >> 3) + 1;
+	*k = -(-348 + i * 8);
+	return cached_powers[i];
+}
+
+static void grisu_round(char* buffer, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+{
+	while(rest < wp_w && delta - rest >= ten_kappa
+		&& (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)){
+		buffer[len - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+/*! \fn static int grisu2(double value, char* buffer, int* k)
+		\brief
+		This function writes the digits of a positive finite double so that
+		value = digits * 10^k, and returns their number.
+*/
+static int grisu2(double value, char* buffer, int* k)
+{
+	uint64_t bits, mantissa;
+	int exponent, len = 0, kappa;
+	struct diyfp v, plus, minus, c, w, wp, wm, one;
+	uint64_t delta, wp_w, p2;
+	uint32_t p1;
+
+	memcpy(&bits, &value, sizeof(bits));
+	mantissa = bits & 0xFFFFFFFFFFFFFull;
+	exponent = (int)((bits >> 52) & 0x7FF);
+	if(exponent != 0){
+		v.f = mantissa | 0x10000000000000ull;
+		v.e = exponent - 1075;
+	}
+	else{
+		v.f = mantissa;
+		v.e = -1074;
+	}
+
+	// boundaries m+ and m- of the rounding interval of 'value', on a common exponent
+	plus.f = (v.f << 1) + 1;
+	plus.e = v.e - 1;
+	plus = diyfp_normalize(plus);
+	if(v.f == 0x10000000000000ull){
+		minus.f = (v.f << 2) - 1;
+		minus.e = v.e - 2;
+	}
+	else{
+		minus.f = (v.f << 1) - 1;
+		minus.e = v.e - 1;
+	}
+	minus.f <<= minus.e - plus.e;
+	minus.e = plus.e;
+
+	c = cached_power(plus.e, k);
+	w = diyfp_multiply(diyfp_normalize(v), c);
+	wp = diyfp_multiply(plus, c);
+	wm = diyfp_multiply(minus, c);
+	wm.f++;
+	wp.f--;
+
+	// digit generation
+	delta = wp.f - wm.f;
+	one.e = wp.e;
+	one.f = 1ull << -one.e;
+	wp_w = wp.f - w.f;
+	p1 = (uint32_t)(wp.f >> -one.e);
+	p2 = wp.f & (one.f - 1);
+	for(kappa = 1; kappa < 10 && p1 >= pow10_u64[kappa]; kappa++)
+		;
+
+	while(kappa > 0){
+		uint32_t d = p1 / (uint32_t)pow10_u64[kappa - 1];
+		uint64_t rest;
+
+		p1 %= (uint32_t)pow10_u64[kappa - 1];
+		if(d || len)
+			buffer[len++] = (char)('0' + d);
+		kappa--;
+		rest = ((uint64_t)p1 << -one.e) + p2;
+		if(rest <= delta){
+			*k += kappa;
+			grisu_round(buffer, len, delta, rest, pow10_u64[kappa] << -one.e, wp_w);
+			return len;
+		}
+	}
+	for(;;){
+		char d;
+
+		p2 *= 10;
+		delta *= 10;
+		d = (char)(p2 >> -one.e);
+		if(d || len)
+			buffer[len++] = (char)('0' + d);
+		p2 &= one.f - 1;
+		kappa--;
+		if(p2 < delta){
+			*k += kappa;
+			grisu_round(buffer, len, delta, p2, one.f, wp_w * pow10_u64[-kappa]);
+			return len;
+		}
+	}
+}
+
+static int format_special(double value, char* out)
+{
+	if(isnan(value))
+		return sprintf(out, "nan");
+	return sprintf(out, value < 0 ? "-inf" : "inf");
+}
+
+/*! \fn int format_shortest(double value, char* out)
+		\brief
+		This function writes the shortest decimal text that reads back as 'value'.
+		Numbers whose decimal exponent lies in [-6, 21) are written in positional
+		notation (0.1, 1234.5, 100), the others in scientific notation (1e+21,
+		1.5e-07), like the "%g" family but without a precision limit.
+
+		\param value the double to format.
+		\param out a buffer of at least FORMAT_MAX chars.
+		\return the length of the text written (not counting the final '\0').
+*/
+int format_shortest(double value, char* out)
+{
+	char digits[20];
+	char* p = out;
+	int len, k, point, i;
+
+	if(!isfinite(value))
+		return format_special(value, out);
+	if(signbit(value)){
+		*p++ = '-';
+		value = -value;
+	}
+	if(value == 0){
+		*p++ = '0';
+		*p = '\0';
+		return (int)(p - out);
+	}
+
+	len = grisu2(value, digits, &k);
+	point = len + k;  // 10^(point-1) <= value < 10^point
+
+	if(k >= 0 && point <= 21){
+		// 1234e7 -> 12340000000
+		memcpy(p, digits, len);
+		memset(p + len, '0', k);
+		p += point;
+	}
+	else if(point > 0 && point <= 21){
+		// 1234e-2 -> 12.34
+		memcpy(p, digits, point);
+		p[point] = '.';
+		memcpy(p + point + 1, digits + point, len - point);
+		p += len + 1;
+	}
+	else if(point > -6 && point <= 0){
+		// 1234e-6 -> 0.001234
+		*p++ = '0';
+		*p++ = '.';
+		for(i = point; i < 0; i++)
+			*p++ = '0';
+		memcpy(p, digits, len);
+		p += len;
+	}
+	else{
+		// 1234e30 -> 1.234e+33
+		*p++ = digits[0];
+		if(len > 1){
+			*p++ = '.';
+			memcpy(p, digits + 1, len - 1);
+			p += len - 1;
+		}
+		p += sprintf(p, "e%c%02d", point - 1 < 0 ? '-' : '+', abs(point - 1));
+	}
+	*p = '\0';
+	return (int)(p - out);
+}
+
+static int write_u128(unsigned __int128 n, char* out)
+{
+	char reversed[40];
+	int len = 0, i;
+
+	do{
+		reversed[len++] = (char)('0' + (int)(n % 10));
+		n /= 10;
+	}while(n != 0);
+	for(i = 0; i < len; i++)
+		out[i] = reversed[len - 1 - i];
+	return len;
+}
+
+/*! \fn int format_integer(int64_t value, int precision, char* out)
+		\brief
+		This function writes the exact result of an integer expression the way
+		format_fixed() or format_shortest() would write it as a double, but with
+		all its digits: 'precision' zero decimals, or none for FORMAT_SHORTEST.
+
+		\param out a buffer of at least FORMAT_MAX chars.
+		\return the length of the text written (not counting the final '\0').
+*/
+int format_integer(int64_t value, int precision, char* out)
+{
+	int n = 0;
+
+	if(value < 0)
+		out[n++] = '-';
+	n += write_u128(value < 0 ? (uint64_t)0 - (uint64_t)value : (uint64_t)value, out + n);
+	if(precision > 0){
+		out[n++] = '.';
+		memset(out + n, '0', (size_t)precision);
+		n += precision;
+	}
+	out[n] = '\0';
+	return n;
+}
+
+/*! \fn int format_fixed(double value, int precision, char* out)
+		\brief
+		This function writes 'value' with 'precision' decimals, correctly rounded to
+		nearest with ties to even, as glibc's "%.*f" does in the C locale. The value
+		m*2^e is scaled to m*10^precision/2^-e with 128-bit integers, which is exact
+		for every double below 2^75 and precisions up to 19; other values go through
+		snprintf().
+
+		\param value the double to format.
+		\param precision the number of decimals.
+		\param out a buffer of at least FORMAT_MAX chars.
+		\return the length of the text written (not counting the final '\0').
+*/
+int format_fixed(double value, int precision, char* out)
+{
+	unsigned __int128 scaled;
+	uint64_t bits, mantissa;
+	int exponent, len = 0, digits, i;
+	char text[48];
+
+	if(!isfinite(value))
+		return format_special(value, out);
+
+	memcpy(&bits, &value, sizeof(bits));
+	mantissa = bits & 0xFFFFFFFFFFFFFull;
+	exponent = (int)((bits >> 52) & 0x7FF);
+	if(exponent != 0){
+		mantissa |= 0x10000000000000ull;
+		exponent -= 1075;
+	}
+	else
+		exponent = -1074;
+
+	if(precision < 0 || precision > 19 || exponent > 74)
+		return snprintf(out, FORMAT_MAX, "%.*f", precision < 0 ? 6 : precision, value);
+
+	if(exponent >= 0)
+		scaled = (unsigned __int128)mantissa << exponent;  // an integer, no decimals to round
+	else{
+		unsigned __int128 product = (unsigned __int128)mantissa * pow10_u64[precision];  // < 2^117
+		int shift = -exponent;
+
+		if(shift >= 128)
+			scaled = 0;  // below 2^-127: rounds to 0 at any supported precision
+		else{
+			unsigned __int128 half = (unsigned __int128)1 << (shift - 1);
+			unsigned __int128 rest = product & ((half << 1) - 1);
+
+			scaled = product >> shift;
+			if(rest > half || (rest == half && (scaled & 1)))
+				scaled++;
+		}
+	}
+
+	if(bits >> 63)
+		out[len++] = '-';
+	digits = write_u128(scaled, text);
+	if(exponent >= 0){
+		memcpy(out + len, text, digits);
+		len += digits;
+		if(precision > 0){
+			out[len++] = '.';
+			memset(out + len, '0', precision);
+			len += precision;
+		}
+	}
+	else{
+		if(digits <= precision){
+			// pad 5 -> 0.005 for precision 3
+			memmove(text + precision + 1 - digits, text, digits);
+			for(i = 0; i < precision + 1 - digits; i++)
+				text[i] = '0';
+			digits = precision + 1;
+		}
+		memcpy(out + len, text, digits - precision);
+		len += digits - precision;
+		if(precision > 0){
+			out[len++] = '.';
+			memcpy(out + len, text + digits - precision, precision);
+			len += precision;
+		}
+	}
+	out[len] = '\0';
+	return len;
+}
+
+/*! \fn void outbuf_init(struct outbuf* out, int fd)
+		\brief
+		This function prepares an output buffer that writes to the file descriptor 'fd'.
+*/
+void outbuf_init(struct outbuf* out, int fd)
+{
+	out->fd = fd;
+	out->failed = 0;
+	out->len = 0;
+}
+
+/*! \fn char write_all(int fd, const char* data, size_t len)
+		\brief
+		This function writes 'len' bytes to 'fd', retrying short and interrupted writes.
+
+		\return 'n' on success, 'w' if a write failed.
+*/
+char write_all(int fd, const char* data, size_t len)
+{
+	ssize_t n;
+
+	while(len > 0){
+		n = write(fd, data, len);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return 'w';
+		data += n;
+		len -= (size_t)n;
+	}
+	return 'n';
+}
+
+/*! \fn char outbuf_flush(struct outbuf* out)
+		\brief
+		This function writes the buffered text with as few write() calls as the
+		kernel allows.
+
+		\param out the output buffer.
+		\return 'n' on success, 'w' if a write failed (the buffered text is dropped).
+*/
+char outbuf_flush(struct outbuf* out)
+{
+	if(write_all(out->fd, out->data, out->len) != 'n')
+		out->failed = 1;
+	out->len = 0;
+	return out->failed ? 'w' : 'n';
+}
+
+void outbuf_write(struct outbuf* out, const char* data, size_t len)
+{
+	if(out->len + len > OUTBUF_SIZE)
+		outbuf_flush(out);
+	if(len > OUTBUF_SIZE){
+		if(write_all(out->fd, data, len) != 'n')
+			out->failed = 1;
+		return;
+	}
+	memcpy(out->data + out->len, data, len);
+	out->len += len;
+}
+
+/*! \fn void outbuf_double(struct outbuf* out, double value, int precision)
+		\brief
+		This function formats 'value' straight into the buffer, with 'precision'
+		decimals or in the shortest round-trip form when 'precision' is FORMAT_SHORTEST.
+*/
+void outbuf_double(struct outbuf* out, double value, int precision)
+{
+	if(out->len + FORMAT_MAX > OUTBUF_SIZE)
+		outbuf_flush(out);
+	if(precision == FORMAT_SHORTEST)
+		out->len += (size_t)format_shortest(value, out->data + out->len);
+	else
+		out->len += (size_t)format_fixed(value, precision, out->data + out->len);
+}
+
+void outbuf_integer(struct outbuf* out, int64_t value, int precision)
+{
+	if(out->len + FORMAT_MAX > OUTBUF_SIZE)
+		outbuf_flush(out);
+	out->len += (size_t)format_integer(value, precision, out->data + out->len);
+}
@@ -0,0 +1,36 @@
+#ifndef FORMAT_MATH_EXPR_H
+#define FORMAT_MATH_EXPR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FORMAT_MAX 352          // longest text of a formatted double, '\0' included
+#define FORMAT_SHORTEST (-1)    // precision selecting the shortest round-trip form
+#define OUTBUF_SIZE (1 << 18)
+
+struct outbuf {
+	int fd;
+	char failed;
+	size_t len;
+	char data[OUTBUF_SIZE];
+};
+
+int format_shortest(double value, char* out);
+int format_fixed(double value, int precision, char* out);
+int format_integer(int64_t value, int precision, char* out);
+
+char write_all(int fd, const char* data, size_t len);
+void outbuf_init(struct outbuf* out, int fd);
+char outbuf_flush(struct outbuf* out);
+void outbuf_write(struct outbuf* out, const char* data, size_t len);
+void outbuf_double(struct outbuf* out, double value, int precision);
+void outbuf_integer(struct outbuf* out, int64_t value, int precision);
+
+static inline void outbuf_char(struct outbuf* out, char c)
+{
+	if(out->len == OUTBUF_SIZE)
+		outbuf_flush(out);
+	out->data[out->len++] = c;
+}
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef FUNCTION_MATH_EXPR_H
+#define FUNCTION_MATH_EXPR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define FUNCTION_SIN_REDUCE_MAX 823549.6  // 2^19 * pi/2: larger |x| are reduced by libm's sin()
+
+/* A built-in function of the expression grammar: name(arguments) compiles to
+   the evaluation of its arguments followed by 'opcode'. */
+struct plan_function {
+	const char* name;
+	uint8_t arity;
+	uint8_t opcode;
+};
+
+/* min() and max() ignore a NaN argument, like fmin() and fmax(), in the
+   scalar and vector evaluators alike. */
+static inline double function_min(double a, double b)
+{
+	return b < a || a != a ? b : a;
+}
+
+static inline double function_max(double a, double b)
+{
+	return b > a || a != a ? b : a;
+}
+
+/* The bodies of exp, log and sin (see function-math-expr.c), inline so that
+   every evaluator built for its own instruction set (kernel-math-expr.c)
+   compiles them for that set. */
+#define FUNCTION_SHIFT 0x1.8p52  // adding it rounds to an integer held in the low bits of the mantissa
+
+static inline uint64_t function_bits(double x)
+{
+	uint64_t u;
+
+	memcpy(&u, &x, sizeof(u));
+	return u;
+}
+
+static inline double function_from_bits(uint64_t u)
+{
+	double x;
+
+	memcpy(&x, &u, sizeof(x));
+	return x;
+}
+
+/* 2^k for an integer-valued k in [-1022, 1023] */
+static inline double function_power_of_two(double k)
+{
+	return function_from_bits((function_bits(k + FUNCTION_SHIFT) - function_bits(FUNCTION_SHIFT) + 1023) << 52);
+}
+
+static inline double function_exp_core(double x)
+{
+	const double ln2_hi = 6.93147180369123816490e-01, ln2_lo = 1.90821492927058770002e-10;
+	const double P1 = 1.66666666666666019037e-01, P2 = -2.77777777770155933842e-03,
+		P3 = 6.61375632143793436117e-05, P4 = -1.65339022054652515390e-06, P5 = 4.13813679705723846039e-08;
+	double k, k1, hi, lo, r, t, c, y;
+
+	x = x > 709.8 ? 709.8 : x;     // exp(709.8) overflows, exp(-745.2) rounds to 0
+	x = x < -745.2 ? -745.2 : x;   // and a NaN passes through both
+	k = (x * 1.44269504088896338700e+00 + FUNCTION_SHIFT) - FUNCTION_SHIFT;
+	hi = x - k * ln2_hi;            // exact: ln2_hi has 32 significant bits
+	lo = k * ln2_lo;
+	r = hi - lo;
+	t = r * r;
+	c = r - t * (P1 + t * (P2 + t * (P3 + t * (P4 + t * P5))));
+	y = 1.0 - ((lo - (r * c) / (2.0 - c)) - hi);
+	k1 = (k * 0.5 + FUNCTION_SHIFT) - FUNCTION_SHIFT;  // 2^k in two factors, so that subnormal results round once
+	return y * function_power_of_two(k1) * function_power_of_two(k - k1);
+}
+
+static inline double function_log_core(double x)
+{
+	const double ln2_hi = 6.93147180369123816490e-01, ln2_lo = 1.90821492927058770002e-10;
+	const double Lg1 = 6.666666666666735130e-01, Lg2 = 3.999999999940941908e-01,
+		Lg3 = 2.857142874366239149e-01, Lg4 = 2.222219843214978396e-01,
+		Lg5 = 1.818357216161805012e-01, Lg6 = 1.531383769920937332e-01, Lg7 = 1.479819860511658591e-01;
+	double subnormal = x < 0x1p-1022 ? 1 : 0;
+	double m, e, f, s, z, w, R, hfsq, result;
+	uint64_t u;
+
+	u = function_bits(subnormal != 0 ? x * 0x1p54 : x);
+	e = function_from_bits((u >> 52) | function_bits(0x1p52)) - (0x1p52 + 1023) - 54 * subnormal;
+	m = function_from_bits((u & 0x000fffffffffffffull) | 0x3ff0000000000000ull);
+	e = m > 1.41421356237309504880 ? e + 1 : e;
+	m = m > 1.41421356237309504880 ? m * 0.5 : m;
+	f = m - 1.0;
+	s = f / (2.0 + f);
+	z = s * s;
+	w = z * z;
+	R = z * (Lg1 + w * (Lg3 + w * (Lg5 + w * Lg7))) + w * (Lg2 + w * (Lg4 + w * Lg6));
+	hfsq = 0.5 * f * f;
+	result = e * ln2_hi - ((hfsq - (s * (hfsq + R) + e * ln2_lo)) - f);
+	result = x == INFINITY ? INFINITY : result;
+	result = x == 0 ? -INFINITY : result;
+	return x < 0 || x != x ? NAN : result;
+}
+
+static inline __attribute__((always_inline)) double function_sin_core(double x)  // too large to be inlined into the loop otherwise
+{
+	const double invpio2 = 6.36619772367581382433e-01;
+	const double pio2_1 = 1.57079632673412561417e+00;
+	const double pio2_2 = 6.07710050630396597660e-11;
+	const double pio2_3 = 2.02226624871116645580e-21, pio2_3t = 8.47842766036889956997e-32;
+	const double S1 = -1.66666666666666324348e-01, S2 = 8.33333333332248946124e-03,
+		S3 = -1.98412698298579493134e-04, S4 = 2.75573137070700676789e-06,
+		S5 = -2.50507602534068634195e-08, S6 = 1.58969099521155010221e-10;
+	const double C1 = 4.16666666666666019037e-02, C2 = -1.38888888888741095749e-03,
+		C3 = 2.48015872894767294178e-05, C4 = -2.75573143513906633035e-07,
+		C5 = 2.08757232129817482790e-09, C6 = -1.13596475577881948265e-11;
+	double n, nd, r, t, v, e, w, y0, y1, z, a, qx, sine, cosine;
+	uint64_t q, odd, result;
+
+	// x - n*pi/2 in three steps of 33 bits of pi/2, as y0 + y1 (fdlibm's __ieee754_rem_pio2)
+	nd = x * invpio2 + FUNCTION_SHIFT;
+	q = function_bits(nd) - function_bits(FUNCTION_SHIFT);
+	n = nd - FUNCTION_SHIFT;
+	r = x - n * pio2_1;             // exact
+	t = r;
+	v = n * pio2_2;
+	r = t - v;
+	e = (t - r) - v;                // the rounding error of each subtraction is carried over
+	t = r;
+	v = n * pio2_3;
+	r = t - v;
+	w = n * pio2_3t - ((t - r) - v) - e;
+	y0 = r - w;
+	y1 = (r - y0) - w;
+
+	z = y0 * y0;
+	v = z * y0;
+	sine = y0 - ((z * (0.5 * y1 - v * (S2 + z * (S3 + z * (S4 + z * (S5 + z * S6))))) - y1) - v * S1);
+	t = z * z * (C1 + z * (C2 + z * (C3 + z * (C4 + z * (C5 + z * C6)))));
+	a = fabs(y0);
+	qx = a > 0.78125 ? 0.28125 : function_from_bits(function_bits(a * 0.25) & 0xffffffff00000000ull);
+	qx = a < 0.3 ? 0 : qx;
+	cosine = (1.0 - qx) - ((0.5 * z - qx) - (t - y0 * y1));
+
+	// quadrant n mod 4: sin, cos, -sin, -cos
+	odd = 0 - (q & 1);
+	result = (function_bits(sine) & ~odd) | (function_bits(cosine) & odd);
+	return function_from_bits(result ^ ((q & 2) << 62));
+}
+
+const struct plan_function* plan_function(const char* name, size_t len);
+double function_exp(double x);
+double function_log(double x);
+double function_sin(double x);
+
+#endif
@@ -0,0 +1,174 @@
+/*!
+	\file histogram-math-expr.c
+	\brief
+	This file contains the latency histograms of the batch modes. Every
+	expression adds the time of its parse, compile and evaluate phases to one
+	histogram per phase; the percentiles read from them (p50, p99, p99.9) are
+	within 1/64 of the exact ones, at a fixed cost of one bucket increment per
+	value and a fixed size whatever the number of expressions.
+*/
+
+#include <string.h>
+#include <time.h>
+#include "histogram-math-expr.h"
+
+#define HALF (1u << (HISTOGRAM_SUB_BITS - 1))
+
+static unsigned int bucket_of(uint64_t value)
+{
+	unsigned int shift;
+
+	if(value < 2 * HALF)
+		return (unsigned int)value;
+	shift = (unsigned int)(63 - __builtin_clzll(value)) - HISTOGRAM_SUB_BITS + 1;
+	return shift * HALF + (unsigned int)(value >> shift);
+}
+
+/* the highest value that falls in a bucket */
+static uint64_t bucket_value(unsigned int bucket)
+{
+	unsigned int shift;
+
+	if(bucket < 2 * HALF)
+		return bucket;
+	shift = bucket / HALF - 1;
+	return ((uint64_t)(bucket - shift * HALF) << shift) + (((uint64_t)1 << shift) - 1);
+}
+
+/* the single writer stores with relaxed atomics, so a concurrent reader sees whole values */
+static void add(uint64_t* at, uint64_t value)
+{
+	__atomic_store_n(at, *at + value, __ATOMIC_RELAXED);
+}
+
+static uint64_t load(const uint64_t* at)
+{
+	return __atomic_load_n(at, __ATOMIC_RELAXED);
+}
+
+void histogram_init(struct histogram* histogram)
+{
+	memset(histogram, 0, sizeof(*histogram));
+	histogram->min = UINT64_MAX;
+}
+
+/*! \fn uint64_t histogram_now(void)
+		\brief
+		This function returns a monotonic time stamp in nanoseconds.
+*/
+uint64_t histogram_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/*! \fn void histogram_record(struct histogram* histogram, uint64_t value)
+		\brief
+		This function adds a value to a histogram. It must only be called by the
+		thread that owns the histogram.
+*/
+void histogram_record(struct histogram* histogram, uint64_t value)
+{
+	add(&histogram->counts[bucket_of(value)], 1);
+	add(&histogram->count, 1);
+	add(&histogram->total, value);
+	if(value < histogram->min)
+		__atomic_store_n(&histogram->min, value, __ATOMIC_RELAXED);
+	if(value > histogram->max)
+		__atomic_store_n(&histogram->max, value, __ATOMIC_RELAXED);
+}
+
+/*! \fn void histogram_merge(struct histogram* into, const struct histogram* from)
+		\brief
+		This function adds the values of 'from' to 'into'. 'from' may be recorded
+		by its owner at the same time: the result is then a snapshot whose count
+		may be off by the values being recorded.
+*/
+void histogram_merge(struct histogram* into, const struct histogram* from)
+{
+	unsigned int i;
+	uint64_t min = load(&from->min), max = load(&from->max);
+
+	for(i = 0; i < HISTOGRAM_BUCKETS; i++)
+		into->counts[i] += load(&from->counts[i]);
+	into->count += load(&from->count);
+	into->total += load(&from->total);
+	if(min < into->min)
+		into->min = min;
+	if(max > into->max)
+		into->max = max;
+}
+
+/*! \fn uint64_t histogram_value_at(const struct histogram* histogram, double percentile)
+		\brief
+		This function returns the value below which 'percentile' percent of the
+		values fall, to the precision of the buckets, and never above the maximum.
+
+		\return the value, 0 if the histogram is empty.
+*/
+uint64_t histogram_value_at(const struct histogram* histogram, double percentile)
+{
+	uint64_t rank, seen = 0, value;
+	unsigned int i;
+
+	if(histogram->count == 0)
+		return 0;
+	rank = (uint64_t)(percentile / 100 * (double)histogram->count + 0.5);
+	if(rank < 1)
+		rank = 1;
+	for(i = 0; i < HISTOGRAM_BUCKETS; i++){
+		seen += histogram->counts[i];
+		if(seen >= rank)
+			break;
+	}
+	value = i < HISTOGRAM_BUCKETS ? bucket_value(i) : histogram->max;
+	return value < histogram->max ? value : histogram->max;
+}
+
+/*! \fn void histogram_report(FILE* out, int format, const char* const* names, const struct histogram* histograms, int n, uint64_t expressions, double seconds)
+		\brief
+		This function prints the count, mean, percentiles and extremes of
+		histograms of nanoseconds, followed by the throughput of the run.
+
+		\param format an enum histogram_format.
+		\param names the name of each histogram.
+		\param expressions the number of expressions processed.
+		\param seconds the wall-clock time they took.
+*/
+void histogram_report(FILE* out, int format, const char* const* names, const struct histogram* histograms, int n, uint64_t expressions, double seconds)
+{
+	static const double percentiles[3] = {50, 99, 99.9};
+	const struct histogram* h;
+	int i;
+
+	if(format == HISTOGRAM_JSON)
+		fprintf(out, "{\"expressions\": %llu, \"seconds\": %.6f, \"expr_per_s\": %.0f, \"phases\": [",
+			(unsigned long long)expressions, seconds, seconds > 0 ? expressions / seconds : 0.0);
+	else
+		fprintf(out, "%-10s %12s %10s %10s %10s %10s %10s %10s\n", "phase", "count", "mean ns", "min", "p50", "p99", "p99.9", "max");
+
+	for(i = 0; i < n; i++){
+		h = &histograms[i];
+		if(format == HISTOGRAM_JSON)
+			fprintf(out, "%s\n  {\"phase\": \"%s\", \"count\": %llu, \"mean_ns\": %.1f, \"min_ns\": %llu, "
+				"\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}", i > 0 ? "," : "",
+				names[i], (unsigned long long)h->count, h->count ? (double)h->total / h->count : 0.0,
+				(unsigned long long)(h->count ? h->min : 0), (unsigned long long)histogram_value_at(h, percentiles[0]),
+				(unsigned long long)histogram_value_at(h, percentiles[1]), (unsigned long long)histogram_value_at(h, percentiles[2]),
+				(unsigned long long)h->max);
+		else
+			fprintf(out, "%-10s %12llu %10.1f %10llu %10llu %10llu %10llu %10llu\n",
+				names[i], (unsigned long long)h->count, h->count ? (double)h->total / h->count : 0.0,
+				(unsigned long long)(h->count ? h->min : 0), (unsigned long long)histogram_value_at(h, percentiles[0]),
+				(unsigned long long)histogram_value_at(h, percentiles[1]), (unsigned long long)histogram_value_at(h, percentiles[2]),
+				(unsigned long long)h->max);
+	}
+	if(format == HISTOGRAM_JSON)
+		fprintf(out, "]}\n");
+	else
+		fprintf(out, "%llu expressions in %.6f s, %.0f expressions/s\n",
+			(unsigned long long)expressions, seconds, seconds > 0 ? expressions / seconds : 0.0);
+	fflush(out);
+}
@@ -0,0 +1,35 @@
+#ifndef HISTOGRAM_MATH_EXPR_H
+#define HISTOGRAM_MATH_EXPR_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define HISTOGRAM_SUB_BITS 7  // values are kept with 7 significant bits, within 1/64 of their value
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 2) << (HISTOGRAM_SUB_BITS - 1))
+
+enum histogram_format {
+	HISTOGRAM_TEXT = 1,
+	HISTOGRAM_JSON
+};
+
+/* An HDR histogram of nanoseconds: the values below 2^HISTOGRAM_SUB_BITS have
+   a bucket each, then every power of two is split into 2^(HISTOGRAM_SUB_BITS-1)
+   buckets, so the relative error is the same at every magnitude and any
+   uint64_t fits without allocating. A histogram has a single writer, but may
+   be read by another thread while it is recorded (see histogram_merge()). */
+struct histogram {
+	uint64_t count;
+	uint64_t total;
+	uint64_t min;
+	uint64_t max;
+	uint64_t counts[HISTOGRAM_BUCKETS];
+};
+
+void histogram_init(struct histogram* histogram);
+uint64_t histogram_now(void);
+void histogram_record(struct histogram* histogram, uint64_t value);
+void histogram_merge(struct histogram* into, const struct histogram* from);
+uint64_t histogram_value_at(const struct histogram* histogram, double percentile);
+void histogram_report(FILE* out, int format, const char* const* names, const struct histogram* histograms, int n, uint64_t expressions, double seconds);
+
+#endif
@@ -0,0 +1,513 @@
+/*!
+	\file interval-math-expr.c
+	\brief
+	This file contains the interval evaluator. It runs the same plans as
+	evaluate_plan(), but every value is an interval [lo, hi] guaranteed to
+	contain the exact result, whatever the rounding errors of the operations.
+
+	The bounds are rounded outward with the FPU in round-upward mode: each
+	interval is one SSE2 register (-lo, hi), so a single packed operation rounds
+	-lo up (lo down) and hi up. Sums are one addpd; products and quotients take
+	the extremes of the four endpoint products as (-x, x) * (y, y) pairs. The
+	rounding mode is switched once per call of evaluate_interval_batch(), so a
+	batch of inputs pays for it once. This file must be compiled with
+	-frounding-math, so that the compiler keeps the operations between the
+	fesetround() calls.
+
+	Literals are converted from their exact text (see emit_exact_plan()): 0.1
+	becomes the two doubles around 1/10, not the double nearest to it.
+
+	A division by an interval containing zero gives [-inf, +inf], the only
+	interval holding every quotient; a product takes 0 * inf as 0. A power with
+	an integer exponent is computed by repeated products, with even powers taken
+	on |x| so that (-1..2)^2 is 0..4. Other powers are defined for a base of at
+	least zero; their bounds are libm's pow() at the corners, widened by two ulps.
+
+	exp and log are increasing: their bounds are libm's values at the bounds,
+	widened by two ulps too. sqrt, correctly rounded, is only widened by one ulp
+	downward. sin adds the extrema of the sine that fall inside the interval;
+	an interval wider than 2*pi, or beyond FUNCTION_SIN_REDUCE_MAX, gives [-1, 1].
+	min and max take the minimum or maximum of the bounds.
+
+	sqrt, log and the powers with a non-integer exponent keep the part of their
+	argument that lies in their domain, so sqrt(-1..4) is 0..2. An argument with
+	no point in the domain has no value: its result has NaN bounds, which every
+	operation propagates (see interval_defined()).
+*/
+
+#include <fenv.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "format-math-expr.h"
+#include "function-math-expr.h"
+#include "interval-math-expr.h"
+
+static const double pow10_exact[23] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline __m128d negate(__m128d a)
+{
+	return _mm_shuffle_pd(a, a, 1);
+}
+
+static inline __m128d flip_sign(__m128d a)
+{
+	return _mm_xor_pd(a, _mm_set1_pd(-0.0));
+}
+
+/* one candidate of extremes(): the intrinsics are inline only, so they are selected, not passed.
+   A NaN candidate is 0 * inf, which counts as 0, or inf / inf, which counts as unbounded. */
+static inline __m128d apply(char op, __m128d x, __m128d y)
+{
+	__m128d r = op == '*' ? _mm_mul_pd(x, y) : _mm_div_pd(x, y);
+	__m128d nan = _mm_cmpunord_pd(r, r);
+
+	return _mm_or_pd(_mm_andnot_pd(nan, r), _mm_and_pd(nan, _mm_set1_pd(op == '*' ? 0 : INFINITY)));
+}
+
+/*! \fn static inline __m128d extremes(__m128d a, __m128d b, char op)
+		\brief
+		This function returns the interval of x op y for x and y among the bounds
+		of 'a' and 'b', where op is '*' or '/'. Each of the four candidates is
+		computed as (-x, x) op (y, y), which gives (-(x op y), x op y) both rounded
+		up, and the packed maximum of the candidates is (-lo, hi).
+*/
+static inline __m128d extremes(__m128d a, __m128d b, char op)
+{
+	__m128d neg_a = flip_sign(a), neg_b = flip_sign(b);
+	__m128d x_lo = _mm_unpacklo_pd(a, neg_a);      // (-a.lo, a.lo)
+	__m128d x_hi = _mm_unpackhi_pd(neg_a, a);      // (-a.hi, a.hi)
+	__m128d y_lo = _mm_unpacklo_pd(neg_b, neg_b);  // (b.lo, b.lo)
+	__m128d y_hi = _mm_unpackhi_pd(b, b);          // (b.hi, b.hi)
+
+	return _mm_max_pd(_mm_max_pd(apply(op, x_lo, y_lo), apply(op, x_lo, y_hi)), _mm_max_pd(apply(op, x_hi, y_lo), apply(op, x_hi, y_hi)));
+}
+
+static __m128d add(__m128d a, __m128d b)
+{
+	return _mm_add_pd(a, b);
+}
+
+static __m128d multiply(__m128d a, __m128d b)
+{
+	if(!interval_defined(a) || !interval_defined(b))
+		return _mm_set1_pd(NAN);
+	return extremes(a, b, '*');
+}
+
+static __m128d divide(__m128d a, __m128d b)
+{
+	if(!interval_defined(a) || !interval_defined(b))
+		return _mm_set1_pd(NAN);
+	if(interval_lo(b) <= 0 && interval_hi(b) >= 0)
+		return interval_make(-INFINITY, INFINITY);
+	return extremes(a, b, '/');
+}
+
+static __m128d magnitude(__m128d a)  // {|x| : x in a}
+{
+	double lo = interval_lo(a), hi = interval_hi(a);
+
+	if(lo >= 0)
+		return a;
+	if(hi <= 0)
+		return negate(a);
+	return interval_make(0, hi > -lo ? hi : -lo);
+}
+
+static __m128d power_integer(__m128d a, double exponent)
+{
+	__m128d result = interval_make(1, 1), square;
+	uint64_t n;
+
+	if(exponent < 0){
+		a = divide(interval_make(1, 1), a);
+		exponent = -exponent;
+	}
+	n = (uint64_t)exponent;
+	if(n % 2 == 1){
+		result = a;
+		n--;
+	}
+	square = multiply(magnitude(a), magnitude(a));
+	for(n /= 2; n != 0; n >>= 1){
+		if(n & 1)
+			result = multiply(result, square);
+		if(n > 1)
+			square = multiply(square, square);
+	}
+	return result;
+}
+
+static double widen(double value, int ulps, double direction)
+{
+	while(ulps-- > 0)
+		value = nextafter(value, direction);
+	return value;
+}
+
+static __m128d power(__m128d a, __m128d b)
+{
+	double lo = interval_lo(b), hi = interval_hi(b);
+	double corners[4], low, high, base;
+	int i;
+
+	if(lo == hi && lo == rint(lo) && fabs(lo) < 9007199254740992.0)
+		return power_integer(a, lo);
+	if(!(interval_hi(a) >= 0) || !interval_defined(a) || !interval_defined(b))
+		return _mm_set1_pd(NAN);
+	base = interval_lo(a) > 0 ? interval_lo(a) : 0;
+	corners[0] = pow(base, lo);
+	corners[1] = pow(base, hi);
+	corners[2] = pow(interval_hi(a), lo);
+	corners[3] = pow(interval_hi(a), hi);
+	low = high = corners[0];
+	for(i = 1; i < 4; i++){
+		low = corners[i] < low ? corners[i] : low;
+		high = corners[i] > high ? corners[i] : high;
+	}
+	low = widen(low, 2, -INFINITY);
+	return interval_make(low < 0 ? 0 : low, widen(high, 2, INFINITY));  // a power of a base of at least 0 is at least 0
+}
+
+static __m128d increasing(__m128d a, double (*f)(double), double floor)
+{
+	double lo = widen(f(interval_lo(a)), 2, -INFINITY);
+
+	return interval_make(lo < floor ? floor : lo, widen(f(interval_hi(a)), 2, INFINITY));
+}
+
+static __m128d square_root(__m128d a)  // sqrt() is correctly rounded in the current mode, upward
+{
+	double lo;
+
+	if(!(interval_hi(a) >= 0) || !interval_defined(a))
+		return _mm_set1_pd(NAN);
+	lo = interval_lo(a) > 0 ? widen(sqrt(interval_lo(a)), 1, -INFINITY) : 0;
+	return interval_make(lo < 0 ? 0 : lo, sqrt(interval_hi(a)));
+}
+
+static __m128d logarithm(__m128d a)
+{
+	if(!(interval_hi(a) > 0) || !interval_defined(a))
+		return _mm_set1_pd(NAN);
+	if(interval_lo(a) < 0)
+		a = interval_make(0, interval_hi(a));
+	return increasing(a, log, -INFINITY);
+}
+
+static __m128d exponential(__m128d a)
+{
+	return increasing(a, exp, 0);
+}
+
+/*! \fn static __m128d sine(__m128d a)
+		\brief
+		This function returns the interval of sin() over 'a': the values at the
+		bounds, widened by two ulps, extended to 1 or -1 when a maximum
+		pi/2 + 2k*pi or a minimum -pi/2 + 2k*pi of the sine lies in 'a'. The
+		extrema are located with rounding errors far below the width of the
+		interval around them where the sine is within an ulp of +-1, which the
+		widening covers.
+*/
+static __m128d sine(__m128d a)
+{
+	double lo = interval_lo(a), hi = interval_hi(a), low, high, k;
+
+	if(lo != lo || hi != hi)
+		return _mm_set1_pd(NAN);
+	if(!(hi - lo < 2 * M_PI) || fabs(lo) > FUNCTION_SIN_REDUCE_MAX || fabs(hi) > FUNCTION_SIN_REDUCE_MAX)
+		return interval_make(-1, 1);
+	low = sin(lo);
+	high = sin(hi);
+	if(low > high){
+		k = low;
+		low = high;
+		high = k;
+	}
+	low = widen(low, 2, -INFINITY);
+	high = widen(high, 2, INFINITY);
+	k = ceil((lo - M_PI_2) / (2 * M_PI));
+	if(M_PI_2 + 2 * M_PI * k <= hi)
+		high = 1;
+	k = ceil((lo + M_PI_2) / (2 * M_PI));
+	if(-M_PI_2 + 2 * M_PI * k <= hi)
+		low = -1;
+	return interval_make(low < -1 ? -1 : low, high > 1 ? 1 : high);
+}
+
+static __m128d minimum(__m128d a, __m128d b)  // (-lo, hi): the largest -lo, the smallest hi
+{
+	if(!interval_defined(a) || !interval_defined(b))
+		return _mm_set1_pd(NAN);
+	return _mm_move_sd(_mm_min_pd(a, b), _mm_max_pd(a, b));
+}
+
+static __m128d maximum(__m128d a, __m128d b)
+{
+	if(!interval_defined(a) || !interval_defined(b))
+		return _mm_set1_pd(NAN);
+	return _mm_move_sd(_mm_max_pd(a, b), _mm_min_pd(a, b));
+}
+
+/*! \fn static __m128d decimal_interval(const char* digits, uint32_t n_digits, uint32_t fraction, int negative, char* text)
+		\brief
+		This function returns the smallest interval of doubles around a decimal
+		number, in round-upward mode. A number whose digits fit in 53 bits with at
+		most 22 decimals is m / 10^f with both exact, and (-m, m) / (10^f, 10^f)
+		rounds both bounds at once. Others go through strtod(), which follows the
+		rounding mode: strtod(text) is hi and strtod("-text") is -lo.
+
+		\param text a buffer of at least n_digits + 3 chars for strtod().
+*/
+static __m128d decimal_interval(const char* digits, uint32_t n_digits, uint32_t fraction, int negative, char* text)
+{
+	__m128d value;
+	uint64_t m = 0;
+	uint32_t i;
+
+	for(i = 0; i < n_digits && m <= (1ull << 53); i++)
+		m = m * 10 + (uint64_t)(digits[i] - '0');
+	if(i == n_digits && m <= (1ull << 53) && fraction <= 22){
+		double x = (double)m;
+
+		value = _mm_div_pd(_mm_set_pd(x, -x), _mm_set1_pd(pow10_exact[fraction]));
+	}
+	else{
+		text[0] = '-';
+		memcpy(text + 1, digits, n_digits - fraction);
+		text[n_digits - fraction + 1] = '.';
+		memcpy(text + n_digits - fraction + 2, digits + n_digits - fraction, fraction);
+		text[n_digits + 2] = '\0';
+		value = _mm_set_pd(strtod(text + 1, NULL), strtod(text, NULL));
+	}
+	return negative ? negate(value) : value;
+}
+
+/*! \fn char interval_constants(struct plan_context* ctx, const struct plan* plan, const struct plan_literal* literals, const __m128d** constants)
+		\brief
+		This function converts the literals of a plan to intervals, once for all
+		the evaluations of the plan. The intervals are allocated from the arena of
+		'ctx', like the plan.
+
+		\param ctx the context the plan was compiled in.
+		\param plan a plan compiled by compile_exact_plan().
+		\param literals the literals kept with the plan.
+		\param constants a pointer that receives the plan->n_constants intervals.
+		\return 'n' on success, 'm' when the arena is out of memory.
+*/
+char interval_constants(struct plan_context* ctx, const struct plan* plan, const struct plan_literal* literals, const __m128d** constants)
+{
+	__m128d* intervals = arena_alloc(&ctx->arena, (plan->n_constants + 1) * sizeof(__m128d), 16);
+	uint32_t longest = 0, i;
+	char* text;
+	int mode;
+
+	for(i = 0; i < plan->n_constants; i++)
+		longest = literals[i].n_digits > longest ? literals[i].n_digits : longest;
+	text = arena_alloc(&ctx->arena, longest + 3, 1);
+	if(intervals == NULL || text == NULL)
+		return 'm';
+
+	mode = fegetround();
+	fesetround(FE_UPWARD);
+	for(i = 0; i < plan->n_constants; i++)
+		intervals[i] = decimal_interval(literals[i].digits, literals[i].n_digits, literals[i].fraction, literals[i].negative, text);
+	fesetround(mode);
+	*constants = intervals;
+	return 'n';
+}
+
+/*! \fn char interval_parse(const char* text, size_t len, __m128d* value)
+		\brief
+		This function reads an interval, such as the value of a '--var': a number,
+		which gives the smallest interval of doubles around it, or "lo:hi".
+
+		\return 'n' on success, 's' if the text is malformed or lo > hi.
+*/
+char interval_parse(const char* text, size_t len, __m128d* value)
+{
+	char digits[2][128], buffer[128 + 3];
+	uint32_t n_digits[2] = {0, 0}, fraction[2] = {0, 0};
+	int negative[2] = {0, 0}, dot, part = 0, mode;
+	size_t i = 0;
+	__m128d bounds[2];
+
+	for(part = 0; part < 2 && i <= len; part++){
+		dot = 0;
+		if(i < len && (text[i] == '-' || text[i] == '+'))
+			negative[part] = text[i++] == '-';
+		for(; i < len && text[i] != ':'; i++){
+			if(text[i] == '.' && !dot)
+				dot = 1;
+			else if(text[i] >= '0' && text[i] <= '9' && n_digits[part] < sizeof(digits[part])){
+				digits[part][n_digits[part]++] = text[i];
+				fraction[part] += (uint32_t)dot;
+			}
+			else
+				return 's';
+		}
+		if(n_digits[part] == 0)
+			return 's';
+		if(i == len)
+			break;
+		i++;
+	}
+	if(part == 2)
+		return 's';
+
+	mode = fegetround();
+	fesetround(FE_UPWARD);
+	bounds[0] = decimal_interval(digits[0], n_digits[0], fraction[0], negative[0], buffer);
+	bounds[1] = part == 0 ? bounds[0] : decimal_interval(digits[1], n_digits[1], fraction[1], negative[1], buffer);
+	fesetround(mode);
+	*value = _mm_move_sd(bounds[1], bounds[0]);  // (-lo of the first, hi of the second)
+	return interval_lo(*value) <= interval_hi(*value) ? 'n' : 's';
+}
+
+/*! \fn int interval_format(__m128d value, char* out)
+		\brief
+		This function writes an interval as "[lo, hi]", with each bound in the
+		shortest form that reads back as the same double. There is no fixed
+		precision: fewer decimals would have to round the bounds outward.
+
+		\param out a buffer of at least INTERVAL_FORMAT_MAX chars.
+		\return the length written, without the terminating NUL.
+*/
+int interval_format(__m128d value, char* out)
+{
+	int n = 0;
+
+	out[n++] = '[';
+	n += format_shortest(interval_lo(value) + 0.0, out + n);  // + 0.0 turns a -0 bound into 0
+	out[n++] = ',';
+	out[n++] = ' ';
+	n += format_shortest(interval_hi(value) + 0.0, out + n);
+	out[n++] = ']';
+	out[n] = '\0';
+	return n;
+}
+
+/*! \fn __m128d evaluate_interval(const struct plan* plan, const __m128d* constants, const __m128d* vars)
+		\brief
+		This function evaluates a plan over intervals. It must run in round-upward
+		mode; use evaluate_interval_batch() unless the caller sets it. The operand
+		stack lives on the C stack, so evaluation performs no heap allocation.
+
+		\param plan a plan compiled by compile_exact_plan().
+		\param constants the intervals of its literals (see interval_constants()).
+		\param vars the intervals of the variables, indexed by slot.
+		\return an interval holding the exact result.
+*/
+__m128d evaluate_interval(const struct plan* plan, const __m128d* constants, const __m128d* vars)
+{
+	__m128d stack[PLAN_MAX_STACK];
+	const uint16_t* slot = plan_slots(plan);
+	const uint8_t* code = plan_code(plan);
+	int top = -1;
+	uint32_t i;
+
+	stack[0] = _mm_setzero_pd();
+	for(i = 0; i < plan->length; i++){
+		switch(code[i]){
+			case PLAN_CONST:
+			case PLAN_ICONST:
+				stack[++top] = *constants++;
+				break;
+			case PLAN_VAR:
+				stack[++top] = vars[*slot++];
+				break;
+			case PLAN_NEG:
+			case PLAN_INEG:
+				stack[top] = negate(stack[top]);
+				break;
+			case PLAN_ADD:
+			case PLAN_IADD:
+				top--;
+				stack[top] = add(stack[top], stack[top+1]);
+				break;
+			case PLAN_SUB:
+			case PLAN_ISUB:
+				top--;
+				stack[top] = add(stack[top], negate(stack[top+1]));
+				break;
+			case PLAN_MUL:
+			case PLAN_IMUL:
+				top--;
+				stack[top] = multiply(stack[top], stack[top+1]);
+				break;
+			case PLAN_DIV:
+				top--;
+				stack[top] = divide(stack[top], stack[top+1]);
+				break;
+			case PLAN_POW:
+			case PLAN_IPOW:
+				top--;
+				stack[top] = power(stack[top], stack[top+1]);
+				break;
+			case PLAN_FLOAT:
+			case PLAN_FLOAT_NEXT:
+				break;
+			case PLAN_SQRT:
+				stack[top] = square_root(stack[top]);
+				break;
+			case PLAN_EXP:
+				stack[top] = exponential(stack[top]);
+				break;
+			case PLAN_LOG:
+				stack[top] = logarithm(stack[top]);
+				break;
+			case PLAN_SIN:
+				stack[top] = sine(stack[top]);
+				break;
+			case PLAN_ABS:
+				stack[top] = magnitude(stack[top]);
+				break;
+			case PLAN_MIN:
+				top--;
+				stack[top] = minimum(stack[top], stack[top+1]);
+				break;
+			case PLAN_MAX:
+				top--;
+				stack[top] = maximum(stack[top], stack[top+1]);
+				break;
+			case PLAN_ARG:
+				top++;
+				stack[top] = stack[code[++i]];
+				break;
+			case PLAN_RETURN:
+			case PLAN_IRETURN:
+				top--;
+				stack[top] = stack[top+1];
+				break;
+		}
+	}
+	return stack[0];
+}
+
+/*! \fn void evaluate_interval_batch(const struct plan* plan, const __m128d* constants, const __m128d* vars, size_t stride, size_t count, __m128d* out)
+		\brief
+		This function evaluates a plan over intervals for 'count' inputs, switching
+		the rounding mode once for the whole batch.
+
+		\param plan a plan compiled by compile_exact_plan().
+		\param constants the intervals of its literals (see interval_constants()).
+		\param vars the variables of the inputs: input k uses vars[k * stride + slot].
+		\param stride the number of variables of an input.
+		\param count the number of inputs.
+		\param out an array that receives the 'count' results.
+*/
+void evaluate_interval_batch(const struct plan* plan, const __m128d* constants, const __m128d* vars, size_t stride, size_t count, __m128d* out)
+{
+	int mode = fegetround();
+	size_t k;
+
+	fesetround(FE_UPWARD);
+	for(k = 0; k < count; k++)
+		out[k] = evaluate_interval(plan, constants, vars + k * stride);
+	fesetround(mode);
+}
@@ -0,0 +1,41 @@
+#ifndef INTERVAL_MATH_EXPR_H
+#define INTERVAL_MATH_EXPR_H
+
+#include <stddef.h>
+#include <emmintrin.h>
+#include "plan-math-expr.h"
+
+#define INTERVAL_FORMAT_MAX (2 * 32 + 5)  // longest "[lo, hi]", '\0' included
+
+/* An interval [lo, hi] is held in one SSE2 register as (-lo, hi). With the
+   FPU rounding upward, rounding -lo up is rounding lo down, so one packed
+   instruction computes both bounds with the right directed rounding. */
+static inline __m128d interval_make(double lo, double hi)
+{
+	return _mm_set_pd(hi, -lo);
+}
+
+static inline double interval_lo(__m128d x)
+{
+	return -_mm_cvtsd_f64(x);
+}
+
+static inline double interval_hi(__m128d x)
+{
+	return _mm_cvtsd_f64(_mm_unpackhi_pd(x, x));
+}
+
+/* An interval with NaN bounds has no value: it is the result of sqrt, log or a
+   power over an argument outside their domain. */
+static inline int interval_defined(__m128d x)
+{
+	return _mm_movemask_pd(_mm_cmpunord_pd(x, x)) == 0;
+}
+
+char interval_parse(const char* text, size_t len, __m128d* value);
+int interval_format(__m128d value, char* out);
+char interval_constants(struct plan_context* ctx, const struct plan* plan, const struct plan_literal* literals, const __m128d** constants);
+__m128d evaluate_interval(const struct plan* plan, const __m128d* constants, const __m128d* vars);
+void evaluate_interval_batch(const struct plan* plan, const __m128d* constants, const __m128d* vars, size_t stride, size_t count, __m128d* out);
+
+#endif
@@ -0,0 +1,462 @@
+/*!
+	\file kernel-math-expr.c
+	\brief
+	This file contains the block evaluator of the column mode. It is compiled
+	once per instruction set, with KERNEL_ISA set to sse2, avx2 or avx512 and
+	the matching -m flags (see the Makefile), and every function it exports
+	takes the name of the set as a suffix. column-math-expr.c picks one set at
+	run time. The exp, log and sin bodies of function-math-expr.h are inlined
+	here, so they are compiled for the set too. Without contraction into FMAs,
+	every set gives the same results, row for row, as evaluate_plan().
+*/
+
+#include <string.h>
+#include <math.h>
+#include "plan-math-expr.h"
+#include "function-math-expr.h"
+#include "column-math-expr.h"
+#include "kernel-math-expr.h"
+
+#ifndef KERNEL_ISA
+#error "kernel-math-expr.c is compiled once per instruction set, with KERNEL_ISA defined"
+#endif
+
+#define KERNEL_JOIN(name, isa) name##_##isa
+#define KERNEL_EXPAND(name, isa) KERNEL_JOIN(name, isa)
+#define KERNEL(name) KERNEL_EXPAND(name, KERNEL_ISA)
+
+/* The built-in functions over a block run on the doubles of the stack, x[j]
+   being the member 'f' of row j: the vectorizer gives up on loops that go
+   through the union members. */
+static void block_sqrt(double* x, unsigned int n)
+{
+	unsigned int j;
+
+	for(j = 0; j < n; j++)
+		x[j] = sqrt(x[j]);
+}
+
+static void block_exp(double* x, unsigned int n)
+{
+	unsigned int j;
+
+	for(j = 0; j < n; j++)
+		x[j] = function_exp_core(x[j]);
+}
+
+static void block_log(double* x, unsigned int n)
+{
+	unsigned int j;
+
+	for(j = 0; j < n; j++)
+		x[j] = function_log_core(x[j]);
+}
+
+/* sin() over a block: the branch-free kernel for every row, then libm for the
+   rare arguments beyond FUNCTION_SIN_REDUCE_MAX (or infinite, or NaN) */
+static void block_sin(double* x, unsigned int n)
+{
+	double in[COLUMN_BLOCK];
+	unsigned int j;
+
+	for(j = 0; j < n; j++){
+		in[j] = x[j];
+		x[j] = function_sin_core(in[j]);
+	}
+	for(j = 0; j < n; j++)
+		if(!(fabs(in[j]) <= FUNCTION_SIN_REDUCE_MAX))
+			x[j] = sin(in[j]);
+}
+
+static void block_abs(double* x, unsigned int n)
+{
+	unsigned int j;
+
+	for(j = 0; j < n; j++)
+		x[j] = fabs(x[j]);
+}
+
+/* min() and max(): y[j] = f(y[j], x[j]) */
+static void block_min(double* y, const double* x, unsigned int n)
+{
+	unsigned int j;
+
+	for(j = 0; j < n; j++)
+		y[j] = function_min(y[j], x[j]);
+}
+
+static void block_max(double* y, const double* x, unsigned int n)
+{
+	unsigned int j;
+
+	for(j = 0; j < n; j++)
+		y[j] = function_max(y[j], x[j]);
+}
+
+static inline int fusable(uint8_t op)
+{
+	return op == PLAN_ADD || op == PLAN_SUB || op == PLAN_MUL || op == PLAN_DIV;
+}
+
+/*! \fn static inline void fuse(uint8_t op, union plan_value* y, const double* x, const int x_step, const double* z, const int z_step, unsigned int n)
+		\brief
+		This function computes y = x op z over a block, for the superinstructions
+		of run_block(). An operand is either a row of values (step 1), from the
+		stack or straight from a column, or a constant broadcast to every row
+		(step 0). The steps are constants at every call, so each call becomes
+		its own vectorized loop.
+*/
+static inline __attribute__((always_inline)) void fuse(uint8_t op, union plan_value* y, const double* x, const int x_step, const double* z, const int z_step, unsigned int n)
+{
+	unsigned int j;
+
+	switch(op){
+		case PLAN_ADD:
+			for(j = 0; j < n; j++)
+				y[j].f = x[j * x_step] + z[j * z_step];
+			break;
+		case PLAN_SUB:
+			for(j = 0; j < n; j++)
+				y[j].f = x[j * x_step] - z[j * z_step];
+			break;
+		case PLAN_MUL:
+			for(j = 0; j < n; j++)
+				y[j].f = x[j * x_step] * z[j * z_step];
+			break;
+		default:
+			for(j = 0; j < n; j++)
+				y[j].f = x[j * x_step] / z[j * z_step];
+	}
+}
+
+/*! \fn static inline char run_block(const struct plan* plan, const double* const* columns, uint64_t row, unsigned int n, const int widen, union plan_value (*stack)[COLUMN_BLOCK])
+		\brief
+		This function evaluates a plan on the 'n' rows of a block starting at
+		'row': every opcode runs over the whole block before the next one, so its
+		loop is vectorized, the built-in functions included. It follows run_plan() in plan-math-expr.c, including the integer
+		opcodes and their rerun in double after an overflow ('widen'). Integer
+		subexpressions hold no variable, so without 'widen' they are computed in
+		the first row of the block only and broadcast when made doubles.
+
+		A variable or a constant followed by an arithmetic operator is not copied
+		to the stack: the pair runs as one superinstruction that reads it in place,
+		and so does a pair of them followed by an operator. a*b+c*d-e then takes
+		four passes over the block instead of nine, all within the L1 cache, and
+		the columns are read once.
+
+		\param stack the operand stack, plan->max_depth levels of COLUMN_BLOCK values.
+		\return 'i' for an integer result (in stack[0][0]), 'f' for doubles, 'v' if an integer operation overflowed.
+*/
+static inline char run_block(const struct plan* plan, const double* const* columns, uint64_t row, unsigned int n, const int widen, union plan_value (*stack)[COLUMN_BLOCK])
+{
+	const double* constant = plan_constants(plan);
+	const uint16_t* slot = plan_slots(plan);
+	const uint8_t* code = plan_code(plan);
+	int top = -1, overflow = 0;
+	unsigned int j;
+	uint32_t i;
+
+	for(i = 0; i < plan->length; i++){
+		union plan_value* a = stack[top > 0 ? top - 1 : 0];
+		union plan_value* b = stack[top >= 0 ? top : 0];
+		const double* column;
+
+		switch(code[i]){
+			case PLAN_CONST:
+			case PLAN_VAR:
+				if(top >= 0 && i + 1 < plan->length && fusable(code[i + 1])){
+					// "x c op" or "x v op": the operand is read in place by the operator
+					if(code[i] == PLAN_VAR)
+						fuse(code[i + 1], b, &b[0].f, 1, columns[*slot++] + row, 1, n);
+					else
+						fuse(code[i + 1], b, &b[0].f, 1, constant++, 0, n);
+					i++;
+					break;
+				}
+				column = code[i] == PLAN_VAR ? columns[*slot++] + row : constant++;
+				top++;
+				if(i + 2 < plan->length && (code[i + 1] == PLAN_VAR || code[i + 1] == PLAN_CONST) && fusable(code[i + 2])){
+					// "v v op", "v c op", "c v op" or "c c op": both operands are read in place
+					const int step = code[i] == PLAN_VAR;
+
+					if(code[i + 1] == PLAN_VAR && step)
+						fuse(code[i + 2], stack[top], column, 1, columns[*slot++] + row, 1, n);
+					else if(code[i + 1] == PLAN_VAR)
+						fuse(code[i + 2], stack[top], column, 0, columns[*slot++] + row, 1, n);
+					else if(step)
+						fuse(code[i + 2], stack[top], column, 1, constant++, 0, n);
+					else
+						fuse(code[i + 2], stack[top], column, 0, constant++, 0, n);
+					i += 2;
+					break;
+				}
+				if(code[i] == PLAN_VAR)
+					for(j = 0; j < n; j++)
+						stack[top][j].f = column[j];
+				else
+					for(j = 0; j < n; j++)
+						stack[top][j].f = *column;
+				break;
+			case PLAN_NEG:
+				for(j = 0; j < n; j++)
+					b[j].f = -b[j].f;
+				break;
+			case PLAN_ADD:
+				top--;
+				for(j = 0; j < n; j++)
+					a[j].f += b[j].f;
+				break;
+			case PLAN_SUB:
+				top--;
+				for(j = 0; j < n; j++)
+					a[j].f -= b[j].f;
+				break;
+			case PLAN_MUL:
+				top--;
+				for(j = 0; j < n; j++)
+					a[j].f *= b[j].f;
+				break;
+			case PLAN_DIV:
+				top--;
+				for(j = 0; j < n; j++)
+					a[j].f /= b[j].f;
+				break;
+			case PLAN_POW:
+				top--;
+				for(j = 0; j < n; j++)
+					a[j].f = pow(a[j].f, b[j].f);
+				break;
+			case PLAN_ICONST:
+				top++;
+				if(!widen)
+					stack[top][0].i = *(const int64_t*)constant;
+				else
+					for(j = 0; j < n; j++)
+						stack[top][j].f = (double)*(const int64_t*)constant;
+				constant++;
+				break;
+			case PLAN_INEG:
+				if(!widen)
+					overflow |= __builtin_sub_overflow((int64_t)0, b[0].i, &b[0].i);
+				else
+					for(j = 0; j < n; j++)
+						b[j].f = -b[j].f;
+				break;
+			case PLAN_IADD:
+			case PLAN_ISUB:
+			case PLAN_IMUL:
+			case PLAN_IPOW:
+				top--;
+				if(!widen){
+					if(code[i] == PLAN_IADD)
+						overflow |= __builtin_add_overflow(a[0].i, b[0].i, &a[0].i);
+					else if(code[i] == PLAN_ISUB)
+						overflow |= __builtin_sub_overflow(a[0].i, b[0].i, &a[0].i);
+					else if(code[i] == PLAN_IMUL)
+						overflow |= __builtin_mul_overflow(a[0].i, b[0].i, &a[0].i);
+					else
+						overflow |= plan_power_int(&a[0].i, b[0].i);
+				}
+				else if(code[i] == PLAN_IADD)
+					for(j = 0; j < n; j++)
+						a[j].f += b[j].f;
+				else if(code[i] == PLAN_ISUB)
+					for(j = 0; j < n; j++)
+						a[j].f -= b[j].f;
+				else if(code[i] == PLAN_IMUL)
+					for(j = 0; j < n; j++)
+						a[j].f *= b[j].f;
+				else
+					for(j = 0; j < n; j++)
+						a[j].f = pow(a[j].f, b[j].f);
+				break;
+			case PLAN_FLOAT:
+			case PLAN_FLOAT_NEXT:
+				if(!widen){
+					union plan_value* x = code[i] == PLAN_FLOAT ? b : a;
+					double value = (double)x[0].i;
+
+					for(j = 0; j < n; j++)
+						x[j].f = value;
+				}
+				break;
+			case PLAN_SQRT:
+				block_sqrt(&b[0].f, n);
+				break;
+			case PLAN_EXP:
+				block_exp(&b[0].f, n);
+				break;
+			case PLAN_LOG:
+				block_log(&b[0].f, n);
+				break;
+			case PLAN_SIN:
+				block_sin(&b[0].f, n);
+				break;
+			case PLAN_ABS:
+				block_abs(&b[0].f, n);
+				break;
+			case PLAN_MIN:
+				top--;
+				block_min(&a[0].f, &b[0].f, n);
+				break;
+			case PLAN_MAX:
+				top--;
+				block_max(&a[0].f, &b[0].f, n);
+				break;
+			case PLAN_ARG:
+				top++;
+				memcpy(stack[top], stack[code[++i]], n * sizeof(union plan_value));
+				break;
+			case PLAN_RETURN:
+			case PLAN_IRETURN:
+				top--;
+				memcpy(a, b, n * sizeof(union plan_value));
+				break;
+		}
+	}
+	if(overflow)
+		return 'v';
+	if(widen)
+		return 'f';
+	switch(code[plan->length - 1]){
+		case PLAN_ICONST: case PLAN_INEG: case PLAN_IADD: case PLAN_ISUB: case PLAN_IMUL: case PLAN_IPOW: case PLAN_IRETURN:
+			return 'i';
+		default:
+			return 'f';
+	}
+}
+
+/*! \fn void evaluate_plan_rows_ISA(const struct plan* plan, const double* const* columns, uint32_t ncols, uint64_t first, uint64_t last, double* out)
+		\brief
+		This function is evaluate_plan_rows() for the instruction set of this
+		build. The operand stack of a block is on the C stack, at most
+		PLAN_MAX_STACK * COLUMN_BLOCK doubles.
+*/
+void KERNEL(evaluate_plan_rows)(const struct plan* plan, const double* const* columns, uint32_t ncols, uint64_t first, uint64_t last, double* out)
+{
+	union plan_value stack[plan->max_depth][COLUMN_BLOCK];
+	int widen = 0;  // set for good after an integer overflow, which happens in every block alike
+	unsigned int n, j;
+	uint64_t row;
+	char type;
+
+	(void)ncols;
+	for(row = first; row < last; row += n){
+		n = last - row < COLUMN_BLOCK ? (unsigned int)(last - row) : COLUMN_BLOCK;
+		type = widen ? run_block(plan, columns, row, n, 1, stack) : run_block(plan, columns, row, n, 0, stack);
+		if(type == 'v'){
+			widen = 1;
+			type = run_block(plan, columns, row, n, 1, stack);
+		}
+		if(type == 'i')
+			for(j = 0; j < n; j++)
+				out[row + j] = (double)stack[0][0].i;
+		else
+			for(j = 0; j < n; j++)
+				out[row + j] = stack[0][j].f;
+	}
+}
+
+static inline void kahan_step(double* sum, double* compensation, unsigned int k, double x)
+{
+	double y = x - compensation[k];
+	double t = sum[k] + y;
+
+	compensation[k] = (t - sum[k]) - y;
+	sum[k] = t;
+}
+
+/* x[j] is the member 'f' of row j of the stack, as for the block_* functions.
+   The lanes are kept in local arrays over the block, which the vectorizer
+   knows do not alias 'x'. */
+static void reduce_block(struct column_reduction* r, const double* x, unsigned int n, int summation)
+{
+	double min[COLUMN_LANES], max[COLUMN_LANES], sum[COLUMN_LANES], compensation[COLUMN_LANES], tree[COLUMN_BLOCK];
+	unsigned int j, k, width;
+	uint64_t level;
+
+	memcpy(min, r->min, sizeof(min));
+	memcpy(max, r->max, sizeof(max));
+	for(j = 0; j + COLUMN_LANES <= n; j += COLUMN_LANES)
+		for(k = 0; k < COLUMN_LANES; k++){
+			min[k] = function_min(min[k], x[j + k]);
+			max[k] = function_max(max[k], x[j + k]);
+		}
+	for(k = 0; j + k < n; k++){
+		min[k] = function_min(min[k], x[j + k]);
+		max[k] = function_max(max[k], x[j + k]);
+	}
+	memcpy(r->min, min, sizeof(min));
+	memcpy(r->max, max, sizeof(max));
+	r->count += n;
+
+	switch(summation){
+		case SUMMATION_PLAIN:
+			memcpy(sum, r->sum, sizeof(sum));
+			for(j = 0; j + COLUMN_LANES <= n; j += COLUMN_LANES)
+				for(k = 0; k < COLUMN_LANES; k++)
+					sum[k] += x[j + k];
+			for(k = 0; j + k < n; k++)
+				sum[k] += x[j + k];
+			memcpy(r->sum, sum, sizeof(sum));
+			break;
+		case SUMMATION_KAHAN:
+			memcpy(sum, r->sum, sizeof(sum));
+			memcpy(compensation, r->compensation, sizeof(compensation));
+			for(j = 0; j + COLUMN_LANES <= n; j += COLUMN_LANES)
+				for(k = 0; k < COLUMN_LANES; k++)
+					kahan_step(sum, compensation, k, x[j + k]);
+			for(k = 0; j + k < n; k++)
+				kahan_step(sum, compensation, k, x[j + k]);
+			memcpy(r->sum, sum, sizeof(sum));
+			memcpy(r->compensation, compensation, sizeof(compensation));
+			break;
+		default:
+			// the block is summed as a tree of halves, then the block sums as a binary counter
+			for(j = 0; j < n; j++)
+				tree[j] = x[j];
+			for(; j < COLUMN_BLOCK; j++)
+				tree[j] = 0;
+			for(width = COLUMN_BLOCK / 2; width > 0; width /= 2)
+				for(j = 0; j < width; j++)
+					tree[j] += tree[j + width];
+			for(level = 0; r->blocks & ((uint64_t)1 << level); level++)
+				tree[0] += r->levels[level];
+			r->levels[level] = tree[0];
+			r->blocks++;
+	}
+}
+
+/*! \fn void reduce_plan_rows_ISA(const struct plan* plan, const double* const* columns, uint32_t ncols, uint64_t first, uint64_t last, int summation, struct column_reduction* reduction)
+		\brief
+		This function is reduce_plan_rows() for the instruction set of this build.
+*/
+void KERNEL(reduce_plan_rows)(const struct plan* plan, const double* const* columns, uint32_t ncols, uint64_t first, uint64_t last, int summation, struct column_reduction* reduction)
+{
+	union plan_value stack[plan->max_depth][COLUMN_BLOCK];
+	int widen = 0;
+	unsigned int n, j;
+	uint64_t row;
+	char type;
+
+	(void)ncols;
+	memset(reduction, 0, sizeof(*reduction));
+	for(j = 0; j < COLUMN_LANES; j++)
+		reduction->min[j] = reduction->max[j] = NAN;  // ignored by function_min() and function_max()
+	for(row = first; row < last; row += n){
+		n = last - row < COLUMN_BLOCK ? (unsigned int)(last - row) : COLUMN_BLOCK;
+		type = widen ? run_block(plan, columns, row, n, 1, stack) : run_block(plan, columns, row, n, 0, stack);
+		if(type == 'v'){
+			widen = 1;
+			type = run_block(plan, columns, row, n, 1, stack);
+		}
+		if(type == 'i'){
+			double value = (double)stack[0][0].i;
+
+			for(j = 0; j < n; j++)
+				stack[0][j].f = value;
+		}
+		reduce_block(reduction, &stack[0][0].f, n, summation);
+	}
+}
+
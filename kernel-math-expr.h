@@ -0,0 +1,18 @@
+#ifndef KERNEL_MATH_EXPR_H
+#define KERNEL_MATH_EXPR_H
+
+#include <stdint.h>
+#include "plan-math-expr.h"
+#include "column-math-expr.h"
+
+/* The block evaluator built for each instruction set by kernel-math-expr.c;
+   column-math-expr.c dispatches evaluate_plan_rows() and reduce_plan_rows()
+   to one of them. */
+void evaluate_plan_rows_sse2(const struct plan* plan, const double* const* columns, uint32_t ncols, uint64_t first, uint64_t last, double* out);
+void evaluate_plan_rows_avx2(const struct plan* plan, const double* const* columns, uint32_t ncols, uint64_t first, uint64_t last, double* out);
+void evaluate_plan_rows_avx512(const struct plan* plan, const double* const* columns, uint32_t ncols, uint64_t first, uint64_t last, double* out);
+void reduce_plan_rows_sse2(const struct plan* plan, const double* const* columns, uint32_t ncols, uint64_t first, uint64_t last, int summation, struct column_reduction* reduction);
+void reduce_plan_rows_avx2(const struct plan* plan, const double* const* columns, uint32_t ncols, uint64_t first, uint64_t last, int summation, struct column_reduction* reduction);
+void reduce_plan_rows_avx512(const struct plan* plan, const double* const* columns, uint32_t ncols, uint64_t first, uint64_t last, int summation, struct column_reduction* reduction);
+
+#endif
@@ -1,9 +1,251 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
 #include "compute-math-expr.h"
+#include "alloc-hook-math-expr.h"
+#include "batch-math-expr.h"
+#include "format-math-expr.h"
+#include "column-math-expr.h"
+#include "pipeline-math-expr.h"
+#include "trace-math-expr.h"
 
-int main(void)
+int main(int argc, char** argv)
 {
-	double calculate(char* status);
+	static const struct option options[] = {
+		{"batch", no_argument, NULL, 'b'},
+		{"alloc-check", no_argument, NULL, 'A'},
+		{"var", required_argument, NULL, 'v'},
+		{"profile", no_argument, NULL, 'P'},
+		{"precision", required_argument, NULL, 'p'},
+		{"shortest", no_argument, NULL, 'S'},
+		{"expr", required_argument, NULL, 'e'},
+		{"input", required_argument, NULL, 'i'},
+		{"column", required_argument, NULL, 'c'},
+		{"output", required_argument, NULL, 'o'},
+		{"raw-output", no_argument, NULL, 'R'},
+		{"pipeline", no_argument, NULL, 'T'},
+		{"workers", required_argument, NULL, 'w'},
+		{"decimal", required_argument, NULL, 'D'},
+		{"rounding", required_argument, NULL, 'r'},
+		{"rational", no_argument, NULL, 'Q'},
+		{"interval", no_argument, NULL, 'I'},
+		{"gradient", no_argument, NULL, 'G'},
+		{"define", required_argument, NULL, 'F'},
+		{"summation", required_argument, NULL, 's'},
+		{"isa", required_argument, NULL, 'X'},
+		{"no-numa", no_argument, NULL, 'N'},
+		{"affinity", required_argument, NULL, 'a'},
+		{"io-cpus", required_argument, NULL, 'O'},
+		{"latency", required_argument, NULL, 'L'},
+		{"trace", required_argument, NULL, 't'},
+		{"errors", required_argument, NULL, 'E'},
+		{"check", no_argument, NULL, 'C'},
+		{NULL, 0, NULL, 0}
+	};
+	static struct batch_options batch_options;
+	static struct column_options column_options;
+	const char* trace_path = NULL;
+	char batch = 0, check = 0, isa;
+	char text[FORMAT_MAX];
+	char* end;
+	unsigned long workers;
+	int opt;
+
+	batch_options.precision = 3;
+	while((opt = getopt_long(argc, argv, "bv:e:i:c:o:", options, NULL)) != -1){
+		switch(opt){
+			case 'b':
+				batch = 1;
+				break;
+			case 'A':
+				batch_options.alloc_check = 1;
+				break;
+			case 'P':
+				batch_options.profile = 1;
+				break;
+			case 'p':
+				batch_options.precision = atoi(optarg);
+				if(batch_options.precision >= 0 && batch_options.precision <= 19)
+					break;
+				fprintf(stderr, "--precision must be between 0 and 19\n");
+				return -1;
+			case 'S':
+				batch_options.precision = FORMAT_SHORTEST;
+				break;
+			case 'e':
+				column_options.expression = optarg;
+				break;
+			case 'i':
+				column_options.input = optarg;
+				break;
+			case 'c':
+				if(bind_column(&column_options, optarg) == 'n')
+					break;
+				fprintf(stderr, "Invalid column binding '%s'\n", optarg);
+				return -1;
+			case 'o':
+				column_options.output = optarg;
+				break;
+			case 'R':
+				column_options.raw_output = 1;
+				break;
+			case 'T':
+				batch_options.pipeline = 1;
+				break;
+			case 'w':
+				workers = strtoul(optarg, &end, 10);
+				if(*optarg >= '0' && *optarg <= '9' && *end == '\0' && workers >= 1 && workers <= PIPELINE_MAX_WORKERS){
+					batch_options.workers = (unsigned int)workers;
+					break;
+				}
+				fprintf(stderr, "--workers must be between 1 and %d\n", PIPELINE_MAX_WORKERS);
+				return -1;
+			case 'a':
+				batch_options.affinity = optarg;
+				break;
+			case 'O':
+				batch_options.io_cpus = optarg;
+				break;
+			case 'C':
+				check = 1;
+				break;
+			case 'E':
+				batch_options.errors = optarg;
+				break;
+			case 't':
+				trace_path = optarg;
+				break;
+			case 'L':
+				batch_options.latency = strcmp(optarg, "text") == 0 ? HISTOGRAM_TEXT : strcmp(optarg, "json") == 0 ? HISTOGRAM_JSON : 0;
+				if(batch_options.latency)
+					break;
+				fprintf(stderr, "--latency must be text or json\n");
+				return -1;
+			case 'D':
+				batch_options.arithmetic = ARITHMETIC_DECIMAL;
+				batch_options.decimal.scale = atoi(optarg);
+				if(batch_options.decimal.scale >= 0 && batch_options.decimal.scale <= DECIMAL_MAX_SCALE)
+					break;
+				fprintf(stderr, "--decimal must be between 0 and %d\n", DECIMAL_MAX_SCALE);
+				return -1;
+			case 'r':
+				if(decimal_rounding_mode(optarg, &batch_options.decimal.rounding) == 'n')
+					break;
+				fprintf(stderr, "--rounding must be half-even, half-up, down, floor or ceiling\n");
+				return -1;
+			case 'Q':
+				batch_options.arithmetic = ARITHMETIC_RATIONAL;
+				break;
+			case 'I':
+				batch_options.arithmetic = ARITHMETIC_INTERVAL;
+				break;
+			case 'G':
+				batch_options.gradient = 1;
+				break;
+			case 'F':
+				if(batch_options.n_definitions < MAX_DEFINITIONS){
+					batch_options.definitions[batch_options.n_definitions++] = optarg;
+					break;
+				}
+				fprintf(stderr, "At most %d --define\n", MAX_DEFINITIONS);
+				return -1;
+			case 's':
+				if(column_summation_mode(optarg, &column_options.summation) == 'n')
+					break;
+				fprintf(stderr, "--summation must be plain, pairwise or kahan\n");
+				return -1;
+			case 'N':
+				column_options.no_numa = 1;
+				break;
+			case 'X':
+				isa = column_isa(optarg);
+				if(isa == 'n')
+					break;
+				if(isa == 'u')
+					fprintf(stderr, "This CPU does not support --isa %s\n", optarg);
+				else
+					fprintf(stderr, "--isa must be sse2, avx2 or avx512\n");
+				return -1;
+			case 'v':
+				if(bind_var(&batch_options.vars, optarg) == 'n')
+					break;
+				fprintf(stderr, "Invalid variable binding '%s'\n", optarg);
+				return -1;
+			default:
+				fprintf(stderr, "Usage: %s [--batch [--var name=value]... [--define 'f(x)=body']... [--alloc-check] [--profile] [--latency text|json]\n"
+					"                 [--errors FILE] [--precision N | --shortest] [--decimal SCALE [--rounding MODE] | --rational | --interval | --gradient]\n"
+					"                 [--pipeline [--workers N] [--affinity CPUS|cores] [--io-cpus R,W] [--trace FILE]]]\n"
+					"       %s --check [--define 'f(x)=body']... [--errors FILE]\n"
+					"       %s --expr EXPR [--input TABLE] [--column name=FILE]... [--define 'f(x)=body']... [--workers N [--no-numa]] [--isa ISA] [--profile] [--trace FILE]\n"
+					"                 [--output FILE [--raw-output]] [--summation MODE] [--precision N | --shortest]\n", argv[0], argv[0], argv[0]);
+				return -1;
+		}
+	}
+
+	if(batch_options.alloc_check && !alloc_hook_enabled()){
+		fprintf(stderr, "--alloc-check needs a build with MATH_EXPR_ALLOC_HOOK defined\n");
+		return -1;
+	}
+	if(bind_values(&batch_options.vars, batch_options.arithmetic) != 'n'){
+		fprintf(stderr, "Invalid variable value\n");
+		return -1;
+	}
+	if(batch_options.gradient && (batch_options.arithmetic != ARITHMETIC_DOUBLE || batch_options.pipeline)){
+		fprintf(stderr, "--gradient cannot be combined with an exact arithmetic or --pipeline\n");
+		return -1;
+	}
+	if(trace_path != NULL && !(batch && batch_options.pipeline) && column_options.expression == NULL){
+		fprintf(stderr, "--trace needs --batch --pipeline or --expr\n");
+		return -1;
+	}
+	if(trace_path != NULL && trace_open(trace_path) != 'n'){
+		fprintf(stderr, "Cannot start tracing\n");
+		return -1;
+	}
+	if(check){
+		if(batch || column_options.expression != NULL){
+			fprintf(stderr, "--check cannot be combined with --batch or --expr\n");
+			return -1;
+		}
+		return run_check(&batch_options);
+	}
+	if((batch_options.latency || batch_options.errors != NULL) && !batch){
+		fprintf(stderr, "--latency and --errors need --batch\n");
+		return -1;
+	}
+	if((batch_options.affinity != NULL || batch_options.io_cpus != NULL) && !(batch && batch_options.pipeline)){
+		fprintf(stderr, "--affinity and --io-cpus need --batch --pipeline\n");
+		return -1;
+	}
+	if(column_options.expression != NULL){
+		size_t start, end, comma;
+
+		if(column_options.input == NULL && column_options.n_raw == 0){
+			fprintf(stderr, "--expr needs --input or --column\n");
+			return -1;
+		}
+		if(column_options.output == NULL && column_aggregate(column_options.expression, &start, &end, &comma) == AGGREGATE_NONE){
+			fprintf(stderr, "--expr needs --output, unless it is an aggregate\n");
+			return -1;
+		}
+		column_options.definitions = batch_options.definitions;
+		column_options.n_definitions = batch_options.n_definitions;
+		column_options.precision = batch_options.precision;
+		column_options.workers = batch_options.workers;
+		column_options.profile = batch_options.profile;
+		return run_columns(&column_options);
+	}
+	if(batch && batch_options.pipeline){
+		if(batch_options.alloc_check || batch_options.profile){
+			fprintf(stderr, "--pipeline cannot be combined with --alloc-check or --profile\n");
+			return -1;
+		}
+		return run_pipeline(&batch_options);
+	}
+	if(batch)
+		return run_batch(&batch_options);
+
 	char status ='\0';
 
 	double result = calculate(&status);
@@ -13,8 +255,12 @@ int main(void)
 		return -1;
 	}
 
-	printf("\n%.3lf\n", result);
+	if(batch_options.precision == FORMAT_SHORTEST)
+		format_shortest(result, text);
+	else
+		format_fixed(result, batch_options.precision, text);
+	printf("\n%s\n", text);
 
 	return 0;
 }
-//Next step: creating a graphical user interface!
\ No newline at end of file
+//Next step: creating a graphical user interface!
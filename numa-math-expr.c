@@ -0,0 +1,249 @@
+/*!
+	\file numa-math-expr.c
+	\brief
+	This file contains the placement of the column workers on multi-socket
+	machines. The nodes and their CPUs are read from sysfs, so no NUMA library
+	is needed. A worker pins itself to the CPUs of its node and then touches
+	its share of the input before evaluating it: Linux places a page on the
+	node of the thread that first faults it in, so the rows a worker reads
+	(and the output rows it writes) end up in its local memory instead of all
+	on the node of the thread that mapped the files.
+	It also lists the CPUs the batch pipeline pins its threads to, from a CPU
+	list given by the user or one CPU per physical core.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sched.h>
+#include <pthread.h>
+#include "numa-math-expr.h"
+
+#define NODE_DIR "/sys/devices/system/node"
+#define CPU_DIR "/sys/devices/system/cpu"
+
+/* reads a CPU list such as "0-3,8-11" into a bitmap; returns the number of CPUs */
+static unsigned int parse_cpulist(const char* text, uint64_t* cpus)
+{
+	unsigned long first, last, cpu;
+	unsigned int count = 0;
+	char* end;
+
+	while(*text >= '0' && *text <= '9'){
+		first = last = strtoul(text, &end, 10);
+		if(*end == '-')
+			last = strtoul(end + 1, &end, 10);
+		for(cpu = first; cpu <= last && cpu < NUMA_MAX_CPUS; cpu++, count++)
+			cpus[cpu / 64] |= (uint64_t)1 << (cpu % 64);
+		text = *end == ',' ? end + 1 : end;
+	}
+	return count;
+}
+
+/* reads a small sysfs file into 'text'; returns 0 if it cannot be read */
+static size_t read_text(const char* path, char* text, size_t capacity)
+{
+	FILE* file = fopen(path, "r");
+	size_t len;
+
+	if(file == NULL)
+		return 0;
+	len = fread(text, 1, capacity - 1, file);
+	fclose(file);
+	text[len] = '\0';
+	return len;
+}
+
+static int compare_ids(const void* a, const void* b)
+{
+	return (int)*(const unsigned int*)a - (int)*(const unsigned int*)b;
+}
+
+/*! \fn char numa_discover(struct numa_topology* topology)
+		\brief
+		This function reads the NUMA nodes that have CPUs from sysfs, in the
+		order of their numbers. Memory-only nodes are left out.
+
+		\return 'n' with the nodes found, 'u' when sysfs has no node information:
+		the topology is then a single node with the CPUs of the process.
+*/
+char numa_discover(struct numa_topology* topology)
+{
+	DIR* dir = opendir(NODE_DIR);
+	struct dirent* entry;
+	unsigned int i, id, ids[NUMA_MAX_NODES], n_ids = 0;
+	char path[64], text[4096];
+	cpu_set_t set;
+
+	memset(topology, 0, sizeof(*topology));
+	while(dir != NULL && (entry = readdir(dir)) != NULL && n_ids < NUMA_MAX_NODES)
+		if(sscanf(entry->d_name, "node%u", &id) == 1)
+			ids[n_ids++] = id;
+	if(dir != NULL)
+		closedir(dir);
+	qsort(ids, n_ids, sizeof(ids[0]), compare_ids);
+
+	for(i = 0; i < n_ids; i++){
+		snprintf(path, sizeof(path), NODE_DIR "/node%u/cpulist", ids[i]);
+		if(read_text(path, text, sizeof(text)) == 0)
+			continue;
+		topology->ids[topology->n_nodes] = ids[i];
+		if(parse_cpulist(text, topology->cpus[topology->n_nodes]) > 0)
+			topology->n_nodes++;
+		else
+			memset(topology->cpus[topology->n_nodes], 0, sizeof(topology->cpus[0]));
+	}
+	if(topology->n_nodes > 0)
+		return 'n';
+
+	topology->n_nodes = 1;
+	if(sched_getaffinity(0, sizeof(set), &set) == 0){
+		for(i = 0; i < NUMA_MAX_CPUS && i < CPU_SETSIZE; i++)
+			if(CPU_ISSET(i, &set))
+				topology->cpus[0][i / 64] |= (uint64_t)1 << (i % 64);
+	}
+	return 'u';
+}
+
+/*! \fn char numa_pin(const struct numa_topology* topology, unsigned int node)
+		\brief
+		This function restricts the calling thread to the CPUs of a node.
+
+		\param node the index of the node in 'topology' (not its number).
+		\return 'n' on success, 'u' if the affinity cannot be set.
+*/
+char numa_pin(const struct numa_topology* topology, unsigned int node)
+{
+	cpu_set_t set;
+	unsigned int cpu;
+
+	CPU_ZERO(&set);
+	for(cpu = 0; cpu < NUMA_MAX_CPUS && cpu < CPU_SETSIZE; cpu++)
+		if(topology->cpus[node][cpu / 64] & ((uint64_t)1 << (cpu % 64)))
+			CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 'n' : 'u';
+}
+
+/*! \fn void numa_touch(const void* data, size_t bytes)
+		\brief
+		This function reads a byte of every page of 'data', so that the pages
+		not yet in memory are faulted in by the calling thread, on its node.
+*/
+void numa_touch(const void* data, size_t bytes)
+{
+	const volatile char* p = data;
+	size_t at;
+
+	for(at = 0; at < bytes; at += NUMA_PAGE)
+		(void)p[at];
+	if(bytes > 0)
+		(void)p[bytes - 1];  // the last page, when 'data' does not start on a page
+}
+
+/*! \fn char numa_cpu_list(const char* text, unsigned int* cpus, unsigned int* count, unsigned int max)
+		\brief
+		This function reads a CPU list given by the user, such as "0-3,8,10", in
+		the order it is written. Unlike the lists of sysfs it is checked: every
+		CPU must be below NUMA_MAX_CPUS and every range must be increasing.
+
+		\param cpus receives at most 'max' CPUs, the further ones are dropped.
+		\param count receives the number of CPUs kept.
+		\return 'n' on success, 's' if the list is malformed or empty.
+*/
+char numa_cpu_list(const char* text, unsigned int* cpus, unsigned int* count, unsigned int max)
+{
+	unsigned long first, last, cpu;
+	char* end;
+
+	*count = 0;
+	do{
+		if(*text < '0' || *text > '9')
+			return 's';
+		first = last = strtoul(text, &end, 10);
+		if(*end == '-'){
+			if(end[1] < '0' || end[1] > '9')
+				return 's';
+			last = strtoul(end + 1, &end, 10);
+		}
+		if(last < first || last >= NUMA_MAX_CPUS || (*end != ',' && *end != '\0'))
+			return 's';
+		for(cpu = first; cpu <= last && *count < max; cpu++)
+			cpus[(*count)++] = (unsigned int)cpu;
+		text = end + 1;
+	}while(*end == ',');
+	return 'n';
+}
+
+/*! \fn unsigned int numa_physical_cores(unsigned int* cpus, unsigned int max)
+		\brief
+		This function lists one CPU per physical core among the CPUs the process
+		may run on: the lowest of the hardware threads of each core, as given by
+		the thread_siblings_list of sysfs. Without that information every CPU is
+		taken as a core of its own.
+
+		\param cpus receives at most 'max' CPUs, in increasing order.
+		\return the number of CPUs written.
+*/
+unsigned int numa_physical_cores(unsigned int* cpus, unsigned int max)
+{
+	uint64_t siblings[NUMA_MAX_CPUS / 64];
+	unsigned int cpu, sibling, count = 0;
+	char path[80], text[4096];
+	cpu_set_t set;
+
+	if(sched_getaffinity(0, sizeof(set), &set) != 0)
+		return 0;
+	for(cpu = 0; cpu < NUMA_MAX_CPUS && cpu < CPU_SETSIZE && count < max; cpu++){
+		if(!CPU_ISSET(cpu, &set))
+			continue;
+		memset(siblings, 0, sizeof(siblings));
+		snprintf(path, sizeof(path), CPU_DIR "/cpu%u/topology/thread_siblings_list", cpu);
+		if(read_text(path, text, sizeof(text)) > 0)
+			parse_cpulist(text, siblings);
+		for(sibling = 0; sibling < cpu; sibling++)
+			if((siblings[sibling / 64] & ((uint64_t)1 << (sibling % 64))) && CPU_ISSET(sibling, &set))
+				break;
+		if(sibling == cpu)
+			cpus[count++] = cpu;
+	}
+	return count;
+}
+
+/*! \fn unsigned int numa_allowed_cpus(unsigned int* cpus, unsigned int max)
+		\brief
+		This function lists the CPUs the calling thread may run on.
+
+		\param cpus receives at most 'max' CPUs, in increasing order.
+		\return the number of CPUs written.
+*/
+unsigned int numa_allowed_cpus(unsigned int* cpus, unsigned int max)
+{
+	unsigned int cpu, count = 0;
+	cpu_set_t set;
+
+	if(sched_getaffinity(0, sizeof(set), &set) != 0)
+		return 0;
+	for(cpu = 0; cpu < NUMA_MAX_CPUS && cpu < CPU_SETSIZE && count < max; cpu++)
+		if(CPU_ISSET(cpu, &set))
+			cpus[count++] = cpu;
+	return count;
+}
+
+/*! \fn char numa_pin_cpu(unsigned int cpu)
+		\brief
+		This function restricts the calling thread to a single CPU.
+
+		\return 'n' on success, 'u' if the affinity cannot be set.
+*/
+char numa_pin_cpu(unsigned int cpu)
+{
+	cpu_set_t set;
+
+	if(cpu >= CPU_SETSIZE)
+		return 'u';
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 'n' : 'u';
+}
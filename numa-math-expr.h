@@ -0,0 +1,28 @@
+#ifndef NUMA_MATH_EXPR_H
+#define NUMA_MATH_EXPR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NUMA_MAX_NODES 64
+#define NUMA_MAX_CPUS 1024
+#define NUMA_PAGE 4096  // the stride of numa_touch(), the smallest page size
+
+/* The NUMA nodes of the machine that have CPUs, and their CPUs as bitmaps,
+   read from sysfs. A machine without node information is one node holding
+   the CPUs the process may run on. */
+struct numa_topology {
+	unsigned int n_nodes;
+	unsigned int ids[NUMA_MAX_NODES];  // the node numbers, which may have gaps
+	uint64_t cpus[NUMA_MAX_NODES][NUMA_MAX_CPUS / 64];
+};
+
+char numa_discover(struct numa_topology* topology);
+char numa_pin(const struct numa_topology* topology, unsigned int node);
+void numa_touch(const void* data, size_t bytes);
+char numa_cpu_list(const char* text, unsigned int* cpus, unsigned int* count, unsigned int max);
+unsigned int numa_physical_cores(unsigned int* cpus, unsigned int max);
+unsigned int numa_allowed_cpus(unsigned int* cpus, unsigned int max);
+char numa_pin_cpu(unsigned int cpu);
+
+#endif
@@ -98,7 +98,7 @@ char parse_expr(double* operands, char* operators, char* window_at)
 
 	while( (*window_at) < 3){
 		c = getchar();
-		c = parse_operand(c, &operands[*window_at]);
+		c = parse_operand(c, &operands[(unsigned char)*window_at]);
 
 		if(c == 's')
 			return 's'; // syntaxError status
@@ -108,22 +108,22 @@ char parse_expr(double* operands, char* operators, char* window_at)
 
 		switch(c){
 			case '^':
-				operators[*window_at] = '^';
+				operators[(unsigned char)*window_at] = '^';
 				break;
 			case '+':
-				operators[*window_at] = '+';
+				operators[(unsigned char)*window_at] = '+';
 				break;
 			case '-':
-				operators[*window_at] = '-';
+				operators[(unsigned char)*window_at] = '-';
 				break;
 			case '*':
-				operators[*window_at] = '*';
+				operators[(unsigned char)*window_at] = '*';
 				break;
 			case '/':
-				operators[*window_at] = '/';
+				operators[(unsigned char)*window_at] = '/';
 				break;
 			case '(':
-				operators[*window_at] = '(';
+				operators[(unsigned char)*window_at] = '(';
 				return 'o'; //OpeningParenthesis status (e.g. 89(90+10) )
 			case 'o':
 				return 'o'; //OpeningParenthesis status. We have an operator before the parathensis '(' (e.g. 89 * (90+10) )
@@ -0,0 +1,158 @@
+/*!
+	\file perf-math-expr.c
+	\brief
+	This file contains the profiling mode: it reads hardware performance counters
+	(cycles, instructions, branch misses, L1 data and last-level cache misses)
+	with perf_event_open() around the phases of a batch run, so the time spent
+	reading input, parsing, compiling, evaluating and writing can be told apart
+	without external tools. The counters are opened as one group that counts user
+	space only, so a sample costs a single read(). When the kernel refuses the
+	counters (perf_event_paranoid, containers), only wall-clock time is reported.
+*/
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perf-math-expr.h"
+
+static const char* counter_names[PERF_VALUES] = {
+	"cycles", "instructions", "branch-misses", "L1d-misses", "LLC-misses", "ns"
+};
+
+static int open_counter(uint32_t type, uint64_t config, int leader)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = leader == -1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP;
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+/*! \fn char perf_open(struct perf_session* session)
+		\brief
+		This function opens the counters of the calling thread as one group and
+		starts them. Counters the CPU or the kernel do not provide are skipped.
+
+		\param session a pointer to the session to open.
+		\return 'n' if at least one counter is counting, 'u' if none is available.
+*/
+char perf_open(struct perf_session* session)
+{
+	static const struct { uint32_t type; uint64_t config; } events[PERF_COUNTERS] = {
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+		{PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+		{PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)}
+	};
+	int i;
+
+	session->leader = -1;
+	session->opened = 0;
+	for(i = 0; i < PERF_COUNTERS; i++){
+		session->fds[i] = open_counter(events[i].type, events[i].config, session->leader);
+		session->index[i] = -1;
+		if(session->fds[i] < 0)
+			continue;
+		if(session->leader == -1)
+			session->leader = session->fds[i];
+		session->index[i] = session->opened++;
+	}
+	if(session->leader == -1)
+		return 'u';
+	ioctl(session->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(session->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return 'n';
+}
+
+void perf_close(struct perf_session* session)
+{
+	int i;
+
+	for(i = 0; i < PERF_COUNTERS; i++)
+		if(session->fds[i] >= 0)
+			close(session->fds[i]);
+	session->leader = -1;
+}
+
+/*! \fn void perf_sample(const struct perf_session* session, uint64_t values[PERF_VALUES])
+		\brief
+		This function reads the current value of every counter of the group and of
+		the monotonic clock. Missing counters read as 0.
+
+		\param session the open session.
+		\param values the array receiving the values, indexed by enum perf_counter.
+*/
+void perf_sample(const struct perf_session* session, uint64_t values[PERF_VALUES])
+{
+	uint64_t group[1 + PERF_COUNTERS];
+	struct timespec ts;
+	int i;
+
+	if(session->leader < 0 || read(session->leader, group, sizeof(group)) <= 0)
+		memset(group, 0, sizeof(group));
+	for(i = 0; i < PERF_COUNTERS; i++)
+		values[i] = session->index[i] < 0 ? 0 : group[1 + session->index[i]];
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	values[PERF_NANOSECONDS] = (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/*! \fn void perf_account(struct perf_phase* phase, const uint64_t before[PERF_VALUES], const uint64_t after[PERF_VALUES])
+		\brief
+		This function adds the counts between two samples to the totals of a phase.
+*/
+void perf_account(struct perf_phase* phase, const uint64_t before[PERF_VALUES], const uint64_t after[PERF_VALUES])
+{
+	int i;
+
+	for(i = 0; i < PERF_VALUES; i++)
+		phase->totals[i] += after[i] - before[i];
+	phase->calls++;
+}
+
+/*! \fn void perf_report(FILE* out, const struct perf_session* session, const struct perf_phase* phases, int n_phases, uint64_t expressions)
+		\brief
+		This function prints, for every phase, the totals of each counter and their
+		average per expression, followed by the instructions per cycle.
+
+		\param out the stream to print to.
+		\param session the session the phases were measured with.
+		\param phases the phases to report.
+		\param n_phases the number of phases.
+		\param expressions the number of expressions processed, for the averages.
+*/
+void perf_report(FILE* out, const struct perf_session* session, const struct perf_phase* phases, int n_phases, uint64_t expressions)
+{
+	int p, i;
+	const char* name;
+
+	if(session->leader < 0)
+		fprintf(out, "profile: hardware counters unavailable, reporting wall-clock time only\n");
+	fprintf(out, "%-10s %14s", "phase", "metric");
+	fprintf(out, " %18s %14s\n", "total", "per-expr");
+
+	for(p = 0; p < n_phases; p++){
+		name = phases[p].name;
+		for(i = 0; i < PERF_VALUES; i++){
+			if(i < PERF_COUNTERS && session->index[i] < 0)
+				continue;
+			fprintf(out, "%-10s %14s %18llu %14.1f\n", name,
+				counter_names[i], (unsigned long long)phases[p].totals[i],
+				expressions ? (double)phases[p].totals[i] / expressions : 0.0);
+			name = "";
+		}
+		if(session->index[PERF_CYCLES] >= 0 && session->index[PERF_INSTRUCTIONS] >= 0 && phases[p].totals[PERF_CYCLES] > 0)
+			fprintf(out, "%-10s %14s %18.2f\n", "", "IPC",
+				(double)phases[p].totals[PERF_INSTRUCTIONS] / phases[p].totals[PERF_CYCLES]);
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef PERF_MATH_EXPR_H
+#define PERF_MATH_EXPR_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+enum perf_counter {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_BRANCH_MISSES,
+	PERF_L1D_MISSES,
+	PERF_LLC_MISSES,
+	PERF_COUNTERS,
+	PERF_NANOSECONDS = PERF_COUNTERS,  // wall-clock time, always available
+	PERF_VALUES
+};
+
+struct perf_session {
+	int leader;                 // group leader fd, -1 when no counter could be opened
+	int fds[PERF_COUNTERS];
+	int index[PERF_COUNTERS];   // position of each counter in the group read, -1 if missing
+	int opened;
+};
+
+struct perf_phase {
+	const char* name;
+	uint64_t totals[PERF_VALUES];
+	uint64_t calls;
+};
+
+char perf_open(struct perf_session* session);
+void perf_close(struct perf_session* session);
+void perf_sample(const struct perf_session* session, uint64_t values[PERF_VALUES]);
+void perf_account(struct perf_phase* phase, const uint64_t before[PERF_VALUES], const uint64_t after[PERF_VALUES]);
+void perf_report(FILE* out, const struct perf_session* session, const struct perf_phase* phases, int n_phases, uint64_t expressions);
+
+#endif
@@ -0,0 +1,511 @@
+/*!
+	\file pipeline-math-expr.c
+	\brief
+	This file contains the streaming mode of the batch calculator. Input is cut
+	into batches of whole lines that flow through three stages running in their
+	own threads:
+		- the reader (the calling thread) fills batches from stdin with read(),
+		- the workers compile, evaluate and format the lines of a batch,
+		- the writer writes the output of the batches to stdout in input order.
+	Every worker owns PIPELINE_DEPTH batches and three single-producer
+	single-consumer rings: 'todo' (reader to worker), 'done' (worker to writer)
+	and 'spare' (writer back to reader). The reader hands batch n to worker
+	n % workers and the writer collects them in the same order, so the output
+	keeps the input order without any sorting. Memory is fixed by the number of
+	batches, whatever the size of the input, and a full stage makes the previous
+	one wait (backpressure). Only a line longer than a batch grows the batch that
+	carries it, until the batch is reused.
+	The threads may be pinned: the workers round-robin over a list of CPUs (or
+	one CPU per physical core) and the reader and writer on CPUs of their own,
+	which are then taken out of the list of the workers. A pinned worker keeps
+	its plan context and batches in the caches of its core.
+	With latencies on, every worker times its lines into histograms of its own,
+	which the writer merges into a report when SIGUSR1 arrives and run_pipeline()
+	at the end of the run. The reader numbers the lines of every batch, so that
+	the workers can write the records of the error column, which the writer
+	writes in input order like the results. With tracing on, every stage records its reads,
+	evaluations, writes and the times it waits on a ring (see trace-math-expr.c).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "plan-math-expr.h"
+#include "format-math-expr.h"
+#include "ring-math-expr.h"
+#include "numa-math-expr.h"
+#include "trace-math-expr.h"
+#include "pipeline-math-expr.h"
+
+struct pipeline_batch {
+	size_t len;        // bytes of whole lines in 'text'
+	size_t out_len;
+	size_t errors_len;
+	uint64_t number;   // the number of the first line of the batch, from 1
+	size_t capacity;   // of 'text': PIPELINE_BATCH_BYTES, more while it holds a longer line
+	char end;          // marks the end of the input
+	char* text;
+	char out[PIPELINE_BATCH_LINES * BATCH_LINE_MAX];
+	char errors[PIPELINE_BATCH_LINES * BATCH_ERROR_MAX];  // the records of the error column
+};
+
+struct pipeline_worker {
+	struct ring todo;
+	struct ring done;
+	struct ring spare;
+	struct plan_context ctx;
+	struct batch_options* options;
+	struct pipeline_batch* batches;
+	pthread_t thread;
+	unsigned int index;
+	int cpu;       // the CPU the worker is pinned to, -1 when it is not
+	char unpinned; // the affinity could not be set
+	struct batch_latency latency;
+};
+
+struct pipeline {
+	struct pipeline_worker* workers;
+	unsigned int n_workers;
+	int writer_cpu;
+	int errors_fd;     // the file of the error column, -1 when it is not written
+	uint64_t started;  // histogram_now() at the start of the run
+	char failed;
+};
+
+/* 'span' names the wait in the trace, recorded only when the ring was empty */
+static void* pop_wait(struct ring* ring, const char* span)
+{
+	unsigned int spins = 0;
+	uint64_t start;
+	void* item = ring_pop(ring);
+
+	if(item != NULL)
+		return item;
+	start = trace_begin();
+	while((item = ring_pop(ring)) == NULL)
+		ring_wait(&spins);
+	trace_end(span, start, 0);
+	return item;
+}
+
+/* 'span' names the wait in the trace, recorded only when the ring was full */
+static void push_wait(struct ring* ring, void* item, const char* span)
+{
+	unsigned int spins = 0;
+	uint64_t start;
+
+	if(ring_push(ring, item))
+		return;
+	start = trace_begin();
+	while(!ring_push(ring, item))
+		ring_wait(&spins);
+	trace_end(span, start, 0);
+}
+
+static void* run_worker(void* arg)
+{
+	struct pipeline_worker* worker = arg;
+	struct pipeline_batch* batch;
+	struct batch_error error;
+	uint64_t start, lines;
+
+	if(worker->cpu >= 0 && numa_pin_cpu((unsigned int)worker->cpu) != 'n')
+		worker->unpinned = 1;
+	trace_thread("worker", worker->index);
+	for(;;){
+		batch = pop_wait(&worker->todo, "wait for input");
+		if(batch->end){
+			push_wait(&worker->done, batch, "writer behind");
+			return NULL;
+		}
+		start = trace_begin();
+		lines = 0;
+
+		plan_context_reset(&worker->ctx);
+		batch->out_len = 0;
+		batch->errors_len = 0;
+		const char* line = batch->text;
+		const char* end = batch->text + batch->len;
+
+		while(line < end){
+			const char* newline = memchr(line, '\n', end - line);
+			size_t len = newline ? (size_t)(newline - line) : (size_t)(end - line);
+
+			batch->out_len += batch_line(&worker->ctx, line, len, worker->options, &worker->latency, &error, batch->out + batch->out_len);
+			if(error.status != 'n' && worker->options->errors != NULL)
+				batch->errors_len += batch_error_format(&error, batch->number + lines, line, batch->errors + batch->errors_len);
+			line += len + 1;
+			lines++;
+		}
+		trace_end("evaluate", start, lines);
+		push_wait(&worker->done, batch, "writer behind");
+	}
+}
+
+/*! \fn static void report_latency(const struct pipeline* pipeline)
+		\brief
+		This function prints the latencies of all the workers together. The
+		workers may still be recording, the report is then a snapshot.
+*/
+static void report_latency(const struct pipeline* pipeline)
+{
+	static struct batch_latency total;
+	unsigned int w;
+
+	batch_latency_init(&total);
+	for(w = 0; w < pipeline->n_workers; w++)
+		batch_latency_merge(&total, &pipeline->workers[w].latency);
+	batch_latency_report(&total, pipeline->workers[0].options->latency, pipeline->started);
+}
+
+static void* run_writer(void* arg)
+{
+	struct pipeline* pipeline = arg;
+	struct pipeline_batch* batch;
+	unsigned long seq;
+	uint64_t start;
+
+	trace_thread("writer", 0);
+	if(pipeline->writer_cpu >= 0 && numa_pin_cpu((unsigned int)pipeline->writer_cpu) != 'n')
+		fprintf(stderr, "Cannot pin the writer to CPU %d\n", pipeline->writer_cpu);
+	for(seq = 0; ; seq++){
+		struct pipeline_worker* worker = &pipeline->workers[seq % pipeline->n_workers];
+
+		batch = pop_wait(&worker->done, "wait for results");
+		if(batch->end)
+			return NULL;
+		start = trace_begin();
+		if(!pipeline->failed && write_all(1, batch->out, batch->out_len) != 'n')
+			pipeline->failed = 1;
+		if(!pipeline->failed && batch->errors_len > 0 && write_all(pipeline->errors_fd, batch->errors, batch->errors_len) != 'n')
+			pipeline->failed = 1;
+		trace_end("write", start, batch->out_len);
+		push_wait(&worker->spare, batch, "reader behind");
+		if(worker->options->latency && batch_latency_requested())
+			report_latency(pipeline);
+	}
+}
+
+static char fill(char* text, size_t* len, size_t capacity, char* eof)
+{
+	ssize_t n;
+
+	while(*len < capacity && !*eof){
+		n = read(0, text + *len, capacity - *len);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n < 0)
+			return 'i';
+		if(n == 0)
+			*eof = 1;
+		*len += (size_t)n;
+	}
+	return 'n';
+}
+
+/*! \fn static size_t cut_lines(const char* text, size_t len, unsigned int* lines)
+		\brief
+		This function returns the length of the longest prefix of 'text' made of at
+		most PIPELINE_BATCH_LINES whole lines, 0 if there is no newline, and the
+		number of those lines in 'lines'.
+*/
+static size_t cut_lines(const char* text, size_t len, unsigned int* lines)
+{
+	const char* at = text;
+	const char* newline;
+	size_t cut = 0;
+
+	for(*lines = 0; *lines < PIPELINE_BATCH_LINES; ++*lines){
+		newline = memchr(at, '\n', len - (size_t)(at - text));
+		if(newline == NULL)
+			break;
+		at = newline + 1;
+		cut = (size_t)(at - text);
+	}
+	return cut;
+}
+
+/*! \fn static char resize(char** text, size_t* capacity, size_t size)
+		\brief
+		This function reallocates the buffer 'text' of 'capacity' bytes to 'size'
+		bytes, and leaves it untouched when out of memory.
+
+		\return 'n' on success, 'm' when out of memory.
+*/
+static char resize(char** text, size_t* capacity, size_t size)
+{
+	char* resized;
+
+	if(size == *capacity)
+		return 'n';
+	resized = realloc(*text, size);
+	if(resized == NULL)
+		return 'm';
+	*text = resized;
+	*capacity = size;
+	return 'n';
+}
+
+/*! \fn static char read_input(struct pipeline* pipeline)
+		\brief
+		This function is the reader stage. The bytes read past the last whole line
+		of a batch are carried over to the next one. A batch that holds no whole
+		line doubles until it holds the first one, so that a line of any length is
+		evaluated as in run_batch(); a grown batch shrinks back to
+		PIPELINE_BATCH_BYTES when it is reused.
+*/
+static char read_input(struct pipeline* pipeline)
+{
+	char* carry = malloc(PIPELINE_BATCH_BYTES);
+	size_t carry_len = 0, carry_capacity = PIPELINE_BATCH_BYTES, cut;
+	unsigned long seq = 0;
+	uint64_t number = 1;
+	unsigned int i, lines;
+	char eof = 0, status = 'n';
+
+	if(carry == NULL)
+		return 'm';
+	trace_thread("reader", 0);
+
+	while(status == 'n' && (!eof || carry_len > 0)){
+		struct pipeline_worker* worker = &pipeline->workers[seq++ % pipeline->n_workers];
+		struct pipeline_batch* batch = pop_wait(&worker->spare, "wait for a spare batch");
+		size_t size = PIPELINE_BATCH_BYTES;
+		uint64_t start;
+
+		while(size < carry_len)
+			size *= 2;
+		batch->len = 0;
+		status = resize(&batch->text, &batch->capacity, size);
+		if(status == 'n'){
+			memcpy(batch->text, carry, carry_len);
+			batch->len = carry_len;
+			start = trace_begin();
+			status = fill(batch->text, &batch->len, batch->capacity, &eof);
+			trace_end("read", start, batch->len - carry_len);  // the bytes read, without the carried ones
+			carry_len = 0;
+		}
+
+		cut = cut_lines(batch->text, batch->len, &lines);
+		while(cut == 0 && !eof && status == 'n'){
+			// a line longer than the batch
+			status = resize(&batch->text, &batch->capacity, 2 * batch->capacity);
+			if(status == 'n'){
+				size_t before = batch->len;
+
+				start = trace_begin();
+				status = fill(batch->text, &batch->len, batch->capacity, &eof);
+				trace_end("read", start, batch->len - before);
+			}
+			cut = cut_lines(batch->text, batch->len, &lines);
+		}
+		if(cut == 0 && eof){
+			cut = batch->len;  // last line without newline
+			lines = batch->len > 0;
+		}
+		if(status == 'n' && batch->len - cut > carry_capacity)
+			status = resize(&carry, &carry_capacity, batch->len - cut);
+		if(status != 'n')
+			cut = lines = 0;  // the run stops: no line of the batch is evaluated
+		else{
+			carry_len = batch->len - cut;
+			memcpy(carry, batch->text + cut, carry_len);
+		}
+		batch->len = cut;
+		batch->number = number;
+		number += lines;
+		push_wait(&worker->todo, batch, "worker queue full");
+	}
+
+	for(i = 0; i < pipeline->n_workers; i++){
+		struct pipeline_worker* worker = &pipeline->workers[seq++ % pipeline->n_workers];
+		struct pipeline_batch* batch = pop_wait(&worker->spare, "wait for a spare batch");
+
+		batch->end = 1;
+		push_wait(&worker->todo, batch, "worker queue full");
+	}
+	free(carry);
+	return status;
+}
+
+/*! \fn static void stop_workers(struct pipeline* pipeline, unsigned int started)
+		\brief
+		This function stops the first 'started' workers when the pipeline cannot
+		start: each one gets an end batch, as at the end of the input, and passes
+		it to its 'done' ring, where no writer waits for it.
+*/
+static void stop_workers(struct pipeline* pipeline, unsigned int started)
+{
+	unsigned int w;
+
+	for(w = 0; w < started; w++){
+		struct pipeline_worker* worker = &pipeline->workers[w];
+		struct pipeline_batch* batch = ring_pop(&worker->spare);
+
+		batch->end = 1;
+		ring_push(&worker->todo, batch);
+	}
+}
+
+/*! \fn static char place_threads(const struct batch_options* options, unsigned int* cpus, unsigned int* n_cpus, int* reader_cpu, int* writer_cpu)
+		\brief
+		This function reads the affinity options: the CPUs of the workers, and
+		those of the reader and the writer (both on the same CPU when io_cpus
+		names only one). The reader and writer CPUs are removed from the list of
+		the workers, so that the stages never share a core: with io_cpus and no
+		affinity, the list of the workers is the CPUs the process may run on.
+
+		\param cpus receives the CPUs of the workers, PIPELINE_MAX_CPUS at most.
+		\param n_cpus receives their number, 0 when the workers are not pinned.
+		\param reader_cpu receives the CPU of the reader, -1 when it is not pinned.
+		\param writer_cpu the same for the writer.
+		\return 'n' on success, 's' if a list is malformed, 'd' if no CPU is
+		left for the workers.
+*/
+static char place_threads(const struct batch_options* options, unsigned int* cpus, unsigned int* n_cpus, int* reader_cpu, int* writer_cpu)
+{
+	unsigned int io[2], n_io = 0, i, kept = 0;
+
+	*n_cpus = 0;
+	*reader_cpu = *writer_cpu = -1;
+	if(options->io_cpus != NULL){
+		if(numa_cpu_list(options->io_cpus, io, &n_io, 2) != 'n')
+			return 's';
+		*reader_cpu = (int)io[0];
+		*writer_cpu = (int)io[n_io - 1];
+	}
+	if(options->affinity == NULL && options->io_cpus == NULL)
+		return 'n';
+	if(options->affinity == NULL)
+		*n_cpus = numa_allowed_cpus(cpus, PIPELINE_MAX_CPUS);
+	else if(strcmp(options->affinity, "cores") == 0)
+		*n_cpus = numa_physical_cores(cpus, PIPELINE_MAX_CPUS);
+	else if(numa_cpu_list(options->affinity, cpus, n_cpus, PIPELINE_MAX_CPUS) != 'n')
+		return 's';
+
+	for(i = 0; i < *n_cpus; i++)
+		if((int)cpus[i] != *reader_cpu && (int)cpus[i] != *writer_cpu)
+			cpus[kept++] = cpus[i];
+	*n_cpus = kept;
+	return kept > 0 ? 'n' : 'd';
+}
+
+/*! \fn int run_pipeline(struct batch_options* options)
+		\brief
+		This function runs the batch mode as a pipeline of one reader, 'workers'
+		worker threads and one writer. When 'workers' is 0 there is one worker per
+		CPU of the affinity list, or a single one without a list. The reader is
+		pinned last, once every thread has been created, so that no thread inherits
+		its CPU. The output is the same as the one of run_batch(). When the
+		pipeline cannot start, the threads already created are stopped and joined
+		before returning.
+
+		\param options the options of the run.
+		\return 0 on success, -1 on failure.
+*/
+int run_pipeline(struct batch_options* options)
+{
+	static unsigned int cpus[PIPELINE_MAX_CPUS];
+	struct pipeline pipeline;
+	pthread_t writer;
+	unsigned int w, b, n_cpus, started = 0;
+	int reader_cpu;
+	char status, read_status = 'n';
+
+	status = place_threads(options, cpus, &n_cpus, &reader_cpu, &pipeline.writer_cpu);
+	if(status != 'n'){
+		fprintf(stderr, status == 's' ? "Invalid CPU list\n" : "No CPU is left for the workers after --io-cpus\n");
+		return -1;
+	}
+
+	pipeline.n_workers = options->workers ? options->workers : options->affinity != NULL ? n_cpus : 1;
+	if(pipeline.n_workers > PIPELINE_MAX_WORKERS)
+		pipeline.n_workers = PIPELINE_MAX_WORKERS;
+	pipeline.failed = 0;
+	pipeline.errors_fd = -1;
+	if(options->errors != NULL && (pipeline.errors_fd = batch_errors_open(options)) < 0)
+		return -1;
+	pipeline.started = histogram_now();
+	if(options->latency)
+		batch_latency_watch();
+	// the rings of a worker start on cache lines of their own, which calloc() does not guarantee
+	pipeline.workers = aligned_alloc(CACHE_LINE, pipeline.n_workers * sizeof(struct pipeline_worker));
+	if(pipeline.workers != NULL)
+		memset(pipeline.workers, 0, pipeline.n_workers * sizeof(struct pipeline_worker));
+	if(pipeline.workers == NULL){
+		fprintf(stderr, "Out of memory!\n");
+		return -1;
+	}
+
+	for(w = 0; w < pipeline.n_workers && status == 'n'; w++){
+		struct pipeline_worker* worker = &pipeline.workers[w];
+
+		worker->options = options;
+		worker->index = w;
+		worker->cpu = n_cpus > 0 ? (int)cpus[w % n_cpus] : -1;
+		batch_latency_init(&worker->latency);
+		worker->batches = calloc(PIPELINE_DEPTH, sizeof(struct pipeline_batch));
+		if(worker->batches == NULL || ring_init(&worker->todo, PIPELINE_DEPTH) != 'n' || ring_init(&worker->done, PIPELINE_DEPTH) != 'n'
+			|| ring_init(&worker->spare, PIPELINE_DEPTH) != 'n' || plan_context_init(&worker->ctx) != 'n'
+			|| declare_vars(&worker->ctx, &options->vars) != 'n')
+			status = 'm';
+		else if(declare_functions(&worker->ctx, options->definitions, options->n_definitions) != 'n')
+			status = 's';
+		for(b = 0; b < PIPELINE_DEPTH && status == 'n'; b++){
+			struct pipeline_batch* batch = &worker->batches[b];
+
+			if((batch->text = malloc(PIPELINE_BATCH_BYTES)) == NULL)
+				status = 'm';
+			batch->capacity = PIPELINE_BATCH_BYTES;
+			ring_push(&worker->spare, batch);
+		}
+		if(status == 'n' && pthread_create(&worker->thread, NULL, run_worker, worker) != 0)
+			status = 't';
+		if(status == 'n')
+			started++;
+	}
+	if(status == 'n' && pthread_create(&writer, NULL, run_writer, &pipeline) != 0)
+		status = 't';
+
+	if(status != 'n'){
+		fprintf(stderr, "Cannot start the pipeline (status '%c')\n", status);
+		stop_workers(&pipeline, started);
+	}
+	else{
+		if(reader_cpu >= 0 && numa_pin_cpu((unsigned int)reader_cpu) != 'n')
+			fprintf(stderr, "Cannot pin the reader to CPU %d\n", reader_cpu);
+		read_status = read_input(&pipeline);
+		pthread_join(writer, NULL);
+		if(options->latency)
+			report_latency(&pipeline);
+	}
+	for(w = 0; w < pipeline.n_workers; w++){
+		struct pipeline_worker* worker = &pipeline.workers[w];
+
+		if(w < started)
+			pthread_join(worker->thread, NULL);
+		if(worker->unpinned)
+			fprintf(stderr, "Cannot pin worker %u to CPU %d\n", w, worker->cpu);
+		plan_context_release(&worker->ctx);
+		ring_free(&worker->todo);
+		ring_free(&worker->done);
+		ring_free(&worker->spare);
+		for(b = 0; b < PIPELINE_DEPTH && worker->batches != NULL; b++)
+			free(worker->batches[b].text);
+		free(worker->batches);
+	}
+	free(pipeline.workers);
+	if(pipeline.errors_fd >= 0 && close(pipeline.errors_fd) != 0)
+		pipeline.failed = 1;
+
+	if(status != 'n')
+		return -1;
+	if(read_status != 'n' || pipeline.failed){
+		fprintf(stderr, read_status == 'm' ? "Out of memory!\n" : read_status != 'n' ? "Cannot read the input!\n" : "Cannot write the results!\n");
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,14 @@
+#ifndef PIPELINE_MATH_EXPR_H
+#define PIPELINE_MATH_EXPR_H
+
+#include "batch-math-expr.h"
+
+#define PIPELINE_BATCH_BYTES 65536   // input slice of a batch, grown for a longer line
+#define PIPELINE_BATCH_LINES 512
+#define PIPELINE_DEPTH 4             // batches in flight per worker
+#define PIPELINE_MAX_WORKERS 64
+#define PIPELINE_MAX_CPUS 1024       // CPUs of an --affinity list
+
+int run_pipeline(struct batch_options* options);
+
+#endif
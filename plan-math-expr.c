@@ -0,0 +1,1292 @@
+/*!
+	\file plan-math-expr.c
+	\brief
+	This file contains the plan compiler and evaluator. Unlike calculate(), which
+	reads the expression from stdin and computes it while parsing, compile_plan()
+	turns an expression held in a buffer into a plan: a postfix program that
+	evaluate_plan() runs over a small operand stack. Compilation is done in two
+	passes over the text: parse_plan() checks the syntax and measures the plan,
+	then emit_plan() allocates it from the context's arena with its exact size and
+	writes it. Evaluation never allocates memory.
+
+	Identifiers are variables. Each distinct name gets a slot in the context's
+	symbol table and evaluate_plan() reads its value from vars[slot].
+
+	The compiler types every subexpression. Integer literals that fit in an
+	int64_t, and the sums, differences, products and powers of integers, are
+	integers: they are evaluated with 64-bit integer instructions, which are
+	exact where a double would round. Any overflow (or a negative integer
+	exponent) makes evaluate_plan() run the whole plan again in double, so the
+	result is never worse than with doubles alone. Division, variables and
+	literals with a dot are doubles.
+
+	The grammar follows calculate(): '+' and '-' bind weakest, then '*' and '/',
+	then '^' which is right associative. A sign belongs to its operand, so -2^2 is
+	(-2)^2, and an operand directly followed by '(' is multiplied by it (2(3+4)).
+	The name of a built-in function (see function-math-expr.h) directly followed
+	by '(' is a call, sqrt(x) or min(x, 1); its arguments and result are doubles.
+	Elsewhere the name is a variable, and so is any other name followed by '(',
+	which multiplies the parenthesis.
+
+	plan_define() adds user functions to a context, f(x, y) = x*x + y, which
+	every later plan of the context may call. Calls are inlined, so a plan stays
+	a flat program and the evaluators of every arithmetic run it unchanged.
+	Arguments that compile to a single push (a literal, a variable or an
+	argument of the enclosing function) are substituted for the parameter;
+	other arguments are computed once onto the stack, read by PLAN_ARG and
+	dropped by PLAN_RETURN after the body. A function body of at most
+	PLAN_INLINE_MAX opcodes is compiled again from its text at each call, so its
+	integer literal operations fold with the substituted arguments (f(3, 1)
+	compiles to the single constant 10); a larger body is compiled once by
+	plan_define() and copied into the caller, its arguments converted to double.
+	A body may call the functions defined before it, which rules out recursion.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "plan-math-expr.h"
+#include "function-math-expr.h"
+
+struct operand {
+	char type;             // 'i' integer or 'f' double
+	char literal;          // a lone integer literal, which can become a double constant in place
+	uint32_t code_at;      // its PLAN_ICONST
+	uint32_t constant_at;  // its entry in the pool
+	int64_t value;         // its value, for constant folding
+};
+
+struct plan_definition {
+	const struct plan_definition* next;  // the functions defined before, the only ones the body may call
+	const char* text;                    // the definition, copied to the definition arena
+	size_t len;
+	size_t body_at;                      // where the body starts in 'text'
+	const char* name;
+	size_t name_len;
+	const char* params[PLAN_MAX_PARAMS];
+	size_t param_lens[PLAN_MAX_PARAMS];
+	unsigned int arity;
+	char type;                           // the type of the result, when compiled once
+	const struct plan* fragment;         // the body compiled once, NULL if it is inlined from its text
+	const struct plan_literal* literals; // the literals of the fragment
+};
+
+/* The arguments of a user function call while its body is being compiled. */
+struct frame {
+	const struct plan_definition* function;
+	const struct frame* parent;   // the frame of the caller, where the arguments are written
+	const char* src;              // the text of the caller
+	size_t len;
+	size_t at[PLAN_MAX_PARAMS];   // where a substituted argument starts in 'src'
+	uint8_t index[PLAN_MAX_PARAMS];  // the stack entry of an argument computed once
+	char stacked[PLAN_MAX_PARAMS];
+	char type[PLAN_MAX_PARAMS];
+};
+
+struct compiler {
+	const char* src;
+	size_t len;
+	size_t pos;
+	unsigned int nest;
+	unsigned int depth;
+	struct plan_shape shape;
+	struct plan* plan;           // NULL while measuring (parse_plan)
+	struct plan_context* ctx;
+	double* constants;
+	uint16_t* slots;
+	uint8_t* code;
+	struct plan_literal* literals;  // NULL unless emitting an exact plan
+	struct operand last;            // the last subexpression compiled
+	struct arena* arena;            // where literal texts go, the context's or its definition arena
+	const struct frame* frame;      // the innermost call being inlined, NULL at the top level
+};
+
+static char compile_sum(struct compiler* cc);
+
+static void skip_spaces(struct compiler* cc)
+{
+	while(cc->pos < cc->len && (cc->src[cc->pos] == ' ' || cc->src[cc->pos] == '\t' || cc->src[cc->pos] == '\r'))
+		cc->pos++;
+}
+
+static char peek(struct compiler* cc)
+{
+	skip_spaces(cc);
+	return cc->pos < cc->len ? cc->src[cc->pos] : '\0';
+}
+
+static void emit(struct compiler* cc, uint8_t op)
+{
+	if(cc->plan != NULL)
+		cc->code[cc->shape.length] = op;
+	cc->shape.length++;
+
+	switch(op){
+		case PLAN_CONST:
+		case PLAN_VAR:
+		case PLAN_ICONST:
+		case PLAN_ARG:
+			if(++cc->depth > cc->shape.max_depth)
+				cc->shape.max_depth = cc->depth;
+			break;
+		case PLAN_NEG:
+		case PLAN_INEG:
+		case PLAN_FLOAT:
+		case PLAN_FLOAT_NEXT:
+		case PLAN_SQRT:
+		case PLAN_EXP:
+		case PLAN_LOG:
+		case PLAN_SIN:
+		case PLAN_ABS:
+			break;
+		default:
+			cc->depth--;
+	}
+}
+
+static void emit_constant(struct compiler* cc, double value)
+{
+	if(cc->plan != NULL)
+		cc->constants[cc->shape.n_constants] = value;
+	if(cc->literals != NULL)
+		cc->literals[cc->shape.n_constants].negative = value < 0 || (value == 0 && signbit(value));
+	cc->shape.n_constants++;
+	cc->last.type = 'f';
+	cc->last.literal = 0;
+	emit(cc, PLAN_CONST);
+}
+
+static void emit_integer(struct compiler* cc, int64_t value)
+{
+	if(cc->plan != NULL)
+		((int64_t*)cc->constants)[cc->shape.n_constants] = value;
+	if(cc->literals != NULL)
+		cc->literals[cc->shape.n_constants].negative = value < 0;
+	cc->last.type = 'i';
+	cc->last.literal = 1;
+	cc->last.code_at = cc->shape.length;
+	cc->last.constant_at = cc->shape.n_constants;
+	cc->last.value = value;
+	cc->shape.n_constants++;
+	emit(cc, PLAN_ICONST);
+}
+
+static void emit_arg(struct compiler* cc, unsigned int index, char type)
+{
+	emit(cc, PLAN_ARG);
+	if(cc->plan != NULL)
+		cc->code[cc->shape.length] = (uint8_t)index;
+	cc->shape.length++;
+	cc->last.type = type;
+	cc->last.literal = 0;
+}
+
+/*! \fn static void to_double(struct compiler* cc, const struct operand* operand, uint8_t conversion)
+		\brief
+		This function makes an integer operand a double: a lone literal is turned
+		into a double constant in place, so that mixing integer literals with
+		doubles costs nothing at run time; any other integer subexpression gets the
+		'conversion' opcode.
+*/
+static void to_double(struct compiler* cc, const struct operand* operand, uint8_t conversion)
+{
+	if(!operand->literal)
+		emit(cc, conversion);
+	else if(cc->plan != NULL){
+		cc->code[operand->code_at] = PLAN_CONST;
+		cc->constants[operand->constant_at] = (double)((int64_t*)cc->constants)[operand->constant_at];
+	}
+}
+
+static void note_peaks(struct compiler* cc)  // called before entries are taken back
+{
+	if(cc->shape.length > cc->shape.peak_length)
+		cc->shape.peak_length = cc->shape.length;
+	if(cc->shape.n_constants > cc->shape.peak_constants)
+		cc->shape.peak_constants = cc->shape.n_constants;
+	if(cc->shape.n_slots > cc->shape.peak_slots)
+		cc->shape.peak_slots = cc->shape.n_slots;
+}
+
+static char fold(uint8_t op, int64_t a, int64_t b, int64_t* value)  // returns 1 if the result does not fit
+{
+	switch(op){
+		case PLAN_ADD:
+			return __builtin_add_overflow(a, b, value);
+		case PLAN_SUB:
+			return __builtin_sub_overflow(a, b, value);
+		case PLAN_MUL:
+			return __builtin_mul_overflow(a, b, value);
+		default:
+			*value = a;
+			return plan_power_int(value, b);
+	}
+}
+
+/*! \fn static char integer_text(struct compiler* cc, int64_t value, struct plan_literal* literal)
+		\brief
+		This function writes the digits of a folded integer constant for
+		emit_exact_plan(), which reads constants from their text.
+*/
+static char integer_text(struct compiler* cc, int64_t value, struct plan_literal* literal)
+{
+	uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+	char* digits = arena_alloc(cc->arena, 20, 1);
+	char reversed[20];
+	uint32_t n = 0;
+
+	if(digits == NULL)
+		return 'm';
+	do{
+		reversed[n++] = (char)('0' + magnitude % 10);
+		magnitude /= 10;
+	}while(magnitude != 0);
+	literal->digits = digits;
+	literal->n_digits = n;
+	literal->fraction = 0;
+	literal->value = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+	literal->negative = value < 0;
+	while(n > 0)
+		*digits++ = reversed[--n];
+	return 'n';
+}
+
+/*! \fn static char emit_binary(struct compiler* cc, const struct operand* left, uint8_t op)
+		\brief
+		This function emits the operator 'op' (a double opcode) between the left
+		operand and the right operand just compiled. Two integers give an integer,
+		except through '/'; otherwise integer operands are made doubles first. Two
+		lone integer literals are folded into one when the result fits.
+
+		\return 'n' on success, 'm' when out of memory.
+*/
+static char emit_binary(struct compiler* cc, const struct operand* left, uint8_t op)
+{
+	int64_t value;
+
+	if(left->literal && cc->last.literal && op != PLAN_DIV && left->code_at + 1 == cc->last.code_at
+		&& left->constant_at + 1 == cc->last.constant_at && !fold(op, left->value, cc->last.value, &value)){
+		note_peaks(cc);
+		cc->shape.length--;  // drop the right literal, the left one takes the result
+		cc->shape.n_constants--;
+		cc->depth--;
+		cc->last = *left;
+		cc->last.value = value;
+		if(cc->plan != NULL)
+			((int64_t*)cc->constants)[left->constant_at] = value;
+		if(cc->literals != NULL)
+			return integer_text(cc, value, &cc->literals[left->constant_at]);
+		return 'n';
+	}
+	if(left->type == 'i' && cc->last.type == 'i' && op != PLAN_DIV){
+		emit(cc, op == PLAN_ADD ? PLAN_IADD : (op == PLAN_SUB ? PLAN_ISUB : (op == PLAN_MUL ? PLAN_IMUL : PLAN_IPOW)));
+		cc->last.literal = 0;
+		return 'n';
+	}
+	if(left->type == 'i')
+		to_double(cc, left, PLAN_FLOAT_NEXT);
+	if(cc->last.type == 'i')
+		to_double(cc, &cc->last, PLAN_FLOAT);
+	emit(cc, op);
+	cc->last.type = 'f';
+	cc->last.literal = 0;
+	return 'n';
+}
+
+static void emit_var(struct compiler* cc, unsigned int slot)
+{
+	if(cc->plan != NULL){
+		cc->slots[cc->shape.n_slots] = (uint16_t)slot;
+		if(slot > cc->plan->max_slot)
+			cc->plan->max_slot = (uint16_t)slot;
+	}
+	cc->shape.n_slots++;
+	cc->last.type = 'f';
+	cc->last.literal = 0;
+	emit(cc, PLAN_VAR);
+}
+
+static char is_name_start(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static char is_name_char(char c)
+{
+	return is_name_start(c) || (c >= '0' && c <= '9');
+}
+
+/*! \fn static char literal_value(struct compiler* cc, size_t start, uint64_t mantissa, int fraction, double* value)
+		\brief
+		This function converts the literal src[start..pos) to a double. When its
+		digits fit in the 53 bits of a double and it has at most 22 decimals, both
+		'mantissa' and 10^fraction are exact doubles and a single division rounds
+		correctly (Clinger's fast path). Other literals go through strtod(), which
+		rounds correctly too; they have already been checked to hold only digits and
+		at most one dot, so strtod() cannot read past them. Literals too long for
+		the local buffer are copied to the arena.
+
+		\param mantissa the digits of the literal, or UINT64_MAX if they did not fit.
+		\param fraction the number of digits after the dot.
+*/
+static char literal_value(struct compiler* cc, size_t start, uint64_t mantissa, int fraction, double* value)
+{
+	static const double pow10[23] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	char local[64];
+	size_t n = cc->pos - start;
+	char* text = local;
+
+	if(mantissa <= (1ull << 53) && fraction <= 22){
+		*value = (double)mantissa / pow10[fraction];
+		return 'n';
+	}
+	if(n >= sizeof(local)){
+		text = arena_alloc(cc->arena, n + 1, 1);
+		if(text == NULL)
+			return 'm';
+	}
+	memcpy(text, cc->src + start, n);
+	text[n] = '\0';
+	*value = strtod(text, NULL);
+	return 'n';
+}
+
+/*! \fn static char literal_text(struct compiler* cc, size_t start, struct plan_literal* literal)
+		\brief
+		This function records the exact digits of the literal src[start..pos) for
+		emit_exact_plan(). The sign is filled by emit_constant().
+*/
+static char literal_text(struct compiler* cc, size_t start, struct plan_literal* literal)
+{
+	char* digits = arena_alloc(cc->arena, cc->pos - start, 1);
+	size_t i;
+
+	if(digits == NULL)
+		return 'm';
+	literal->digits = digits;
+	literal->n_digits = literal->fraction = 0;
+	literal->value = 0;
+	for(i = start; i < cc->pos; i++){
+		if(cc->src[i] == '.'){
+			literal->fraction = (uint32_t)(cc->pos - i - 1);
+			continue;
+		}
+		digits[literal->n_digits++] = cc->src[i];
+		literal->value = literal->value * 10 + (uint64_t)(cc->src[i] - '0');
+	}
+	return 'n';
+}
+
+/*! \fn static char compile_call(struct compiler* cc, const struct plan_function* function)
+		\brief
+		This function compiles the arguments of a call, from the '(' that follows
+		the name of 'function', then the call itself.
+*/
+static char compile_call(struct compiler* cc, const struct plan_function* function)
+{
+	unsigned int i;
+	char status;
+
+	if(++cc->nest > PLAN_MAX_NEST)
+		return 'd';
+	cc->pos++;
+	for(i = 0; i < function->arity; i++){
+		if(i > 0 && peek(cc) != ',')
+			return 's'; // SyntaxError: missing argument (e.g. min(1) )
+		if(i > 0)
+			cc->pos++;
+		if((status = compile_sum(cc)) != 'n')
+			return status;
+		if(cc->last.type == 'i')
+			to_double(cc, &cc->last, PLAN_FLOAT);
+	}
+	if(peek(cc) != ')')
+		return 's'; // SyntaxError: missing ')' or too many arguments
+	cc->pos++;
+	cc->nest--;
+	emit(cc, function->opcode);
+	cc->last.type = 'f';
+	cc->last.literal = 0;
+	return 'n';
+}
+
+static const struct plan_definition* user_function(const struct compiler* cc, const char* name, size_t len)
+{
+	const struct plan_definition* f = cc->frame != NULL ? cc->frame->function->next : (cc->ctx != NULL ? cc->ctx->definitions : NULL);
+
+	for(; f != NULL; f = f->next)
+		if(f->name_len == len && memcmp(f->name, name, len) == 0)
+			return f;
+	return NULL;
+}
+
+static int parameter(const struct frame* frame, const char* name, size_t len)
+{
+	unsigned int i;
+
+	for(i = 0; i < frame->function->arity; i++)
+		if(frame->function->param_lens[i] == len && memcmp(frame->function->params[i], name, len) == 0)
+			return (int)i;
+	return -1;
+}
+
+/*! \fn static char compile_argument(struct compiler* cc, unsigned int i)
+		\brief
+		This function compiles a reference to the parameter 'i' of the function
+		being inlined: a copy of its stack entry, or its argument compiled again
+		in the text and the frame of the caller.
+*/
+static char compile_argument(struct compiler* cc, unsigned int i)
+{
+	const struct frame* frame = cc->frame;
+	const char* src = cc->src;
+	size_t len = cc->len, pos = cc->pos;
+	char status;
+
+	if(frame->stacked[i]){
+		emit_arg(cc, frame->index[i], frame->type[i]);
+		return 'n';
+	}
+	cc->src = frame->src;
+	cc->len = frame->len;
+	cc->pos = frame->at[i];
+	cc->frame = frame->parent;
+	status = compile_sum(cc);
+	cc->src = src;
+	cc->len = len;
+	cc->pos = pos;
+	cc->frame = frame;
+	return status;
+}
+
+/*! \fn static char compile_body(struct compiler* cc, const struct frame* frame, unsigned int n_stacked)
+		\brief
+		This function compiles the body of the function of 'frame' from its text,
+		then drops the 'n_stacked' arguments below its result. On failure, cc->pos
+		is left in the body.
+*/
+static char compile_body(struct compiler* cc, const struct frame* frame, unsigned int n_stacked)
+{
+	const struct frame* outer = cc->frame;
+	const char* src = cc->src;
+	size_t len = cc->len, pos = cc->pos;
+	unsigned int i;
+	char status;
+
+	cc->src = frame->function->text;
+	cc->len = frame->function->len;
+	cc->pos = frame->function->body_at;
+	cc->frame = frame;
+	status = compile_sum(cc);
+	if(status == 'n' && peek(cc) != '\0')
+		status = 's'; // SyntaxError: unexpected character in the body
+	cc->frame = outer;
+	if(status != 'n')
+		return status;
+	cc->src = src;
+	cc->len = len;
+	cc->pos = pos;
+	for(i = 0; i < n_stacked; i++)
+		emit(cc, cc->last.type == 'i' ? PLAN_IRETURN : PLAN_RETURN);
+	if(n_stacked > 0)
+		cc->last.literal = 0;
+	return 'n';
+}
+
+/*! \fn static void splice(struct compiler* cc, const struct plan_definition* function, unsigned int base)
+		\brief
+		This function copies the body of 'function', compiled once by
+		plan_define(), after its arguments, which start at the stack entry 'base'.
+		The body reads them with PLAN_ARG relative to entry 0, hence the shift.
+*/
+static void splice(struct compiler* cc, const struct plan_definition* function, unsigned int base)
+{
+	const struct plan* fragment = function->fragment;
+	const uint8_t* code = plan_code(fragment);
+	uint32_t i;
+
+	if(cc->plan != NULL){
+		memcpy(cc->constants + cc->shape.n_constants, plan_constants(fragment), fragment->n_constants * sizeof(double));
+		memcpy(cc->slots + cc->shape.n_slots, plan_slots(fragment), fragment->n_slots * sizeof(uint16_t));
+		memcpy(cc->code + cc->shape.length, code, fragment->length);
+		for(i = 0; i < fragment->length; i++)
+			if(code[i] == PLAN_ARG){
+				i++;
+				cc->code[cc->shape.length + i] = (uint8_t)(code[i] + base);
+			}
+		if(fragment->n_slots > 0 && fragment->max_slot > cc->plan->max_slot)
+			cc->plan->max_slot = fragment->max_slot;
+		if(cc->literals != NULL)
+			memcpy(cc->literals + cc->shape.n_constants, function->literals, fragment->n_constants * sizeof(struct plan_literal));
+	}
+	cc->shape.length += fragment->length;
+	cc->shape.n_constants += fragment->n_constants;
+	cc->shape.n_slots += fragment->n_slots;
+	if(base + fragment->max_depth > cc->shape.max_depth)
+		cc->shape.max_depth = base + fragment->max_depth;
+	cc->depth = base + 1;
+	cc->last.type = function->type;
+	cc->last.literal = 0;
+}
+
+/*! \fn static char compile_user_call(struct compiler* cc, const struct plan_definition* function)
+		\brief
+		This function inlines a call to a user function, from the '(' that
+		follows its name. An argument that compiled to a single push is taken
+		back and substituted for its parameter; the others stay on the stack.
+*/
+static char compile_user_call(struct compiler* cc, const struct plan_definition* function)
+{
+	struct frame frame;
+	struct plan_shape before;
+	unsigned int base = cc->depth, n_stacked = 0, i;
+	char status;
+
+	if(++cc->nest > PLAN_MAX_NEST)
+		return 'd';
+	cc->pos++;
+	frame.function = function;
+	frame.parent = cc->frame;
+	frame.src = cc->src;
+	frame.len = cc->len;
+	for(i = 0; i < function->arity; i++){
+		if(i > 0 && peek(cc) != ',')
+			return 's'; // SyntaxError: missing argument
+		if(i > 0)
+			cc->pos++;
+		frame.at[i] = cc->pos;
+		before = cc->shape;
+		if((status = compile_sum(cc)) != 'n')
+			return status;
+		frame.stacked[i] = function->fragment != NULL || (cc->shape.length - before.length > 1
+			&& (cc->shape.length - before.length > 2 || cc->shape.n_constants != before.n_constants || cc->shape.n_slots != before.n_slots));
+		if(!frame.stacked[i]){
+			note_peaks(cc);
+			cc->shape.length = before.length;  // a constant, a variable or a PLAN_ARG: taken back
+			cc->shape.n_constants = before.n_constants;
+			cc->shape.n_slots = before.n_slots;
+			cc->depth--;
+			continue;
+		}
+		if(function->fragment != NULL && cc->last.type == 'i')
+			to_double(cc, &cc->last, PLAN_FLOAT);
+		frame.index[i] = (uint8_t)(cc->depth - 1);
+		frame.type[i] = cc->last.type;
+		n_stacked++;
+	}
+	if(peek(cc) != ')')
+		return 's'; // SyntaxError: missing ')' or too many arguments
+	cc->pos++;
+	if(function->fragment != NULL)
+		splice(cc, function, base);
+	else if((status = compile_body(cc, &frame, n_stacked)) != 'n')
+		return status;
+	if(cc->shape.length > PLAN_MAX_LENGTH)
+		return 'd';
+	cc->nest--;
+	return 'n';
+}
+
+static char compile_operand(struct compiler* cc)
+{
+	char negate = 0;
+	char c = peek(cc);
+	char status;
+
+	while(c == '-' || c == '+'){
+		if(c == '-')
+			negate = !negate;
+		cc->pos++;
+		c = peek(cc);
+	}
+
+	if((c >= '0' && c <= '9') || c == '.'){
+		size_t start = cc->pos;
+		char hasFractionalPart = 0;
+		char hasDigits = 0;
+		uint64_t mantissa = 0;   // the digits read so far, UINT64_MAX once they overflow
+		int fraction = 0;
+		double value = 0;
+
+		for(; cc->pos < cc->len; cc->pos++){
+			c = cc->src[cc->pos];
+			if(c >= '0' && c <= '9'){
+				hasDigits = 1;
+				fraction += hasFractionalPart;
+				if(mantissa > (UINT64_MAX - 10) / 10)
+					mantissa = UINT64_MAX;
+				else
+					mantissa = mantissa * 10 + (uint64_t)(c - '0');
+			}
+			else if(c == '.' && !hasFractionalPart)
+				hasFractionalPart = 1;
+			else if(c == '.')
+				return 's'; // SyntaxError: two dots in the operand (e.g. 12.8.9)
+			else
+				break;
+		}
+		if(!hasDigits)
+			return 's'; // SyntaxError: a lone dot
+		if(cc->literals != NULL && (status = literal_text(cc, start, &cc->literals[cc->shape.n_constants])) != 'n')
+			return status;
+		if(!hasFractionalPart && mantissa <= INT64_MAX){
+			emit_integer(cc, negate ? -(int64_t)mantissa : (int64_t)mantissa);
+			return 'n';
+		}
+		if(cc->plan != NULL && (status = literal_value(cc, start, mantissa, fraction, &value)) != 'n')
+			return status;
+		emit_constant(cc, negate ? -value : value);
+		return 'n';
+	}
+	if(is_name_start(c)){
+		const struct plan_function* function;
+		const struct plan_definition* definition;
+		size_t start = cc->pos, len;
+		unsigned int slot = 0;
+		int param;
+
+		while(cc->pos < cc->len && is_name_char(cc->src[cc->pos]))
+			cc->pos++;
+		len = cc->pos - start;  // before peek() moves past the spaces
+		if(cc->frame != NULL && (param = parameter(cc->frame, cc->src + start, len)) >= 0)
+			status = compile_argument(cc, (unsigned int)param);
+		else if(peek(cc) == '(' && (function = plan_function(cc->src + start, len)) != NULL)
+			status = compile_call(cc, function);
+		else if(peek(cc) == '(' && (definition = user_function(cc, cc->src + start, len)) != NULL)
+			status = compile_user_call(cc, definition);
+		else{
+			if(cc->plan != NULL && (status = plan_symbol(cc->ctx, cc->src + start, len, &slot)) != 'n')
+				return status;
+			emit_var(cc, slot);
+			status = 'n';
+		}
+		if(status == 'n' && negate){
+			emit(cc, cc->last.type == 'i' ? PLAN_INEG : PLAN_NEG);
+			cc->last.literal = 0;
+		}
+		return status;
+	}
+	if(c == '('){
+		if(++cc->nest > PLAN_MAX_NEST)
+			return 'd';
+		cc->pos++;
+		if((status = compile_sum(cc)) != 'n')
+			return status;
+		if(peek(cc) != ')')
+			return 's'; // SyntaxError: missing ')'
+		cc->pos++;
+		cc->nest--;
+		if(negate){
+			emit(cc, cc->last.type == 'i' ? PLAN_INEG : PLAN_NEG);
+			cc->last.literal = 0;
+		}
+		return 'n';
+	}
+	return 's';
+}
+
+static char compile_power(struct compiler* cc)
+{
+	char status = compile_operand(cc);
+	struct operand base = cc->last;
+
+	if(status != 'n' || peek(cc) != '^')
+		return status;
+	if(++cc->nest > PLAN_MAX_NEST)
+		return 'd';
+	cc->pos++;
+	if((status = compile_power(cc)) != 'n')
+		return status;
+	cc->nest--;
+	return emit_binary(cc, &base, PLAN_POW);
+}
+
+static char compile_product(struct compiler* cc)
+{
+	char status = compile_power(cc);
+	struct operand left;
+	char c;
+
+	while(status == 'n'){
+		c = peek(cc);
+		if(c == '*' || c == '/')
+			cc->pos++;
+		else if(c == '(')
+			c = '*'; // implicit multiplication (e.g. 89(90+10) )
+		else
+			break;
+		left = cc->last;
+		if((status = compile_power(cc)) == 'n')
+			status = emit_binary(cc, &left, c == '*' ? PLAN_MUL : PLAN_DIV);
+	}
+	return status;
+}
+
+static char compile_sum(struct compiler* cc)
+{
+	char status = compile_product(cc);
+	struct operand left;
+	char c;
+
+	while(status == 'n'){
+		c = peek(cc);
+		if(c != '+' && c != '-')
+			break;
+		cc->pos++;
+		left = cc->last;
+		if((status = compile_product(cc)) == 'n')
+			status = emit_binary(cc, &left, c == '+' ? PLAN_ADD : PLAN_SUB);
+	}
+	return status;
+}
+
+static char run_compiler(struct compiler* cc)
+{
+	char status = compile_sum(cc);
+
+	if(status == 'n' && peek(cc) != '\0')
+		status = 's'; // SyntaxError: unexpected character (e.g. 34 + 78 @ 90 or a stray ')')
+	if(status == 'n' && cc->shape.max_depth > PLAN_MAX_STACK)
+		status = 'd';
+	note_peaks(cc);
+	return status;
+}
+
+/*! \fn char plan_context_init(struct plan_context* ctx)
+		\brief
+		This function initializes a compilation context and its arena.
+
+		\param ctx a pointer to the context.
+		\return 'n' on success, 'm' when out of memory.
+*/
+char plan_context_init(struct plan_context* ctx)
+{
+	ctx->symbols.names = NULL;
+	ctx->symbols.count = ctx->symbols.capacity = 0;
+	ctx->definitions = NULL;
+	ctx->definition_arena.head = ctx->definition_arena.current = NULL;
+	return arena_init(&ctx->arena, 0);
+}
+
+/*! \fn void plan_context_reset(struct plan_context* ctx)
+		\brief
+		This function discards, in O(1), every plan compiled in the context since the
+		last reset. The memory is kept for the next batch.
+
+		\param ctx a pointer to the context.
+*/
+void plan_context_reset(struct plan_context* ctx)
+{
+	arena_reset(&ctx->arena);
+}
+
+void plan_context_release(struct plan_context* ctx)
+{
+	unsigned int i;
+
+	for(i = 0; i < ctx->symbols.count; i++)
+		free(ctx->symbols.names[i]);
+	free(ctx->symbols.names);
+	arena_release(&ctx->arena);
+	arena_release(&ctx->definition_arena);
+}
+
+/*! \fn char plan_symbol(struct plan_context* ctx, const char* name, size_t len, unsigned int* slot)
+		\brief
+		This function returns the variable slot of 'name', adding it to the symbol
+		table of the context if it is new. Symbols survive plan_context_reset(), so a
+		name keeps its slot for the lifetime of the context; callers may also declare
+		their variables up front to choose the slot order.
+
+		\param ctx a pointer to the compilation context.
+		\param name the variable name (not necessarily NUL-terminated).
+		\param len the length of the name.
+		\param slot a pointer that receives the slot of the variable.
+		\return 'n' on success, 'm' when out of memory, 'd' when PLAN_MAX_VARS is exceeded.
+*/
+char plan_symbol(struct plan_context* ctx, const char* name, size_t len, unsigned int* slot)
+{
+	struct plan_symbols* symbols = &ctx->symbols;
+	unsigned int i;
+
+	for(i = 0; i < symbols->count; i++){
+		if(strncmp(symbols->names[i], name, len) == 0 && symbols->names[i][len] == '\0'){
+			*slot = i;
+			return 'n';
+		}
+	}
+	if(symbols->count == PLAN_MAX_VARS)
+		return 'd';
+	if(symbols->count == symbols->capacity){
+		unsigned int capacity = symbols->capacity ? 2 * symbols->capacity : 16;
+		char** names = realloc(symbols->names, capacity * sizeof(char*));
+
+		if(names == NULL)
+			return 'm';
+		symbols->names = names;
+		symbols->capacity = capacity;
+	}
+	if((symbols->names[i] = malloc(len + 1)) == NULL)
+		return 'm';
+	memcpy(symbols->names[i], name, len);
+	symbols->names[i][len] = '\0';
+	symbols->count++;
+	*slot = i;
+	return 'n';
+}
+
+/*! \fn static char start_plan(struct compiler* cc, struct arena* arena, const struct plan_shape* shape, struct plan_literal** literals)
+		\brief
+		This function allocates the plan measured by 'shape' from 'arena' for the
+		emitting pass, and its literals when 'literals' is not NULL. The slots and
+		the code are written after the peak sizes of the sections, so that entries
+		taken back never overwrite the next section, and compact_plan() moves
+		them into place at the end.
+*/
+static char start_plan(struct compiler* cc, struct arena* arena, const struct plan_shape* shape, struct plan_literal** literals)
+{
+	cc->arena = arena;
+	cc->plan = arena_alloc(arena, plan_size(shape), 64);
+	if(cc->plan == NULL)
+		return 'm';
+	cc->plan->length = shape->length;
+	cc->plan->n_constants = shape->n_constants;
+	cc->plan->n_slots = shape->n_slots;
+	cc->plan->max_depth = (uint16_t)shape->max_depth;
+	cc->plan->max_slot = 0;
+	cc->constants = (double*)plan_constants(cc->plan);
+	cc->slots = (uint16_t*)(cc->constants + shape->peak_constants);
+	cc->code = (uint8_t*)(cc->slots + shape->peak_slots);
+	if(literals != NULL){
+		cc->literals = arena_alloc(arena, (shape->peak_constants + 1) * sizeof(struct plan_literal), 8);
+		if(cc->literals == NULL)
+			return 'm';
+		*literals = cc->literals;
+	}
+	return 'n';
+}
+
+static void compact_plan(struct compiler* cc)
+{
+	memmove((uint16_t*)plan_slots(cc->plan), cc->slots, cc->shape.n_slots * sizeof(uint16_t));
+	memmove((uint8_t*)plan_code(cc->plan), cc->code, cc->shape.length);
+}
+
+/*! \fn char plan_define(struct plan_context* ctx, const char* src, size_t len, size_t* error_at)
+		\brief
+		This function defines a user function, "name(p1, p2) = body", that the
+		plans compiled in 'ctx' afterwards may call. Its name may be neither a
+		built-in function nor an existing user function, and its body may call
+		the functions defined before it only. The definition survives
+		plan_context_reset(): it lives in the definition arena of the context,
+		with the body compiled once when it is too large to be inlined from its
+		text (see PLAN_INLINE_MAX).
+
+		\param ctx a pointer to the compilation context.
+		\param src the definition (not necessarily NUL-terminated).
+		\param len the length of the definition in bytes.
+		\param error_at a pointer to the byte offset of the error, may be NULL.
+		\return a char indicating the status of the definition:
+			- 'n' on success
+			- 's' for a syntax error, or a name already taken
+			- 'd' for more than PLAN_MAX_PARAMS parameters, or a body beyond the limits of parse_plan()
+			- 'm' when out of memory
+*/
+char plan_define(struct plan_context* ctx, const char* src, size_t len, size_t* error_at)
+{
+	struct compiler cc = {NULL, len, 0, 0, 0, {0, 0, 0, 0, 0, 0, 0}, NULL, ctx, NULL, NULL, NULL, NULL, {'f', 0, 0, 0, 0}, NULL, NULL};
+	struct plan_definition* def;
+	struct plan_literal* literals = NULL;
+	struct frame frame;
+	char* text;
+	size_t start;
+	unsigned int i;
+	char status = 's';
+
+	if(ctx->definition_arena.head == NULL && arena_init(&ctx->definition_arena, 4096) != 'n')
+		return 'm';
+	def = arena_alloc(&ctx->definition_arena, sizeof(struct plan_definition), 8);
+	text = arena_alloc(&ctx->definition_arena, len + 1, 1);
+	if(def == NULL || text == NULL)
+		return 'm';
+	memcpy(text, src, len);
+	text[len] = '\0';
+	cc.src = text;
+
+	if(!is_name_start(peek(&cc)))
+		goto done; // SyntaxError: no function name
+	start = cc.pos;
+	while(cc.pos < len && is_name_char(text[cc.pos]))
+		cc.pos++;
+	def->name = text + start;
+	def->name_len = cc.pos - start;
+	if(plan_function(def->name, def->name_len) != NULL || user_function(&cc, def->name, def->name_len) != NULL || peek(&cc) != '(')
+		goto done; // SyntaxError: a name already taken, or no parameter list
+	cc.pos++;
+	for(def->arity = 0; peek(&cc) != ')'; def->arity++){
+		if(def->arity > 0 && peek(&cc) != ',')
+			goto done; // SyntaxError: missing ',' or ')'
+		if(def->arity > 0)
+			cc.pos++;
+		if(!is_name_start(peek(&cc)))
+			goto done; // SyntaxError: a parameter is not a name
+		if(def->arity == PLAN_MAX_PARAMS){
+			status = 'd';
+			goto done;
+		}
+		start = cc.pos;
+		while(cc.pos < len && is_name_char(text[cc.pos]))
+			cc.pos++;
+		def->params[def->arity] = text + start;
+		def->param_lens[def->arity] = cc.pos - start;
+		for(i = 0; i < def->arity; i++)
+			if(def->param_lens[i] == cc.pos - start && memcmp(def->params[i], text + start, cc.pos - start) == 0)
+				goto done; // SyntaxError: a parameter named twice
+	}
+	cc.pos++;
+	if(peek(&cc) != '=')
+		goto done; // SyntaxError: missing '='
+	cc.pos++;
+	def->next = ctx->definitions;
+	def->text = text;
+	def->len = len;
+	def->body_at = cc.pos;
+	def->fragment = NULL;
+	def->literals = NULL;
+
+	// measure the body with its arguments on the stack, as it is compiled once
+	frame.function = def;
+	frame.parent = NULL;
+	for(i = 0; i < def->arity; i++){
+		frame.stacked[i] = 1;
+		frame.index[i] = (uint8_t)i;
+		frame.type[i] = 'f';
+	}
+	cc.depth = cc.shape.max_depth = def->arity;
+	if((status = compile_body(&cc, &frame, def->arity)) == 'n' && cc.shape.max_depth > PLAN_MAX_STACK)
+		status = 'd';
+	note_peaks(&cc);
+	def->type = cc.last.type;
+	if(status == 'n' && cc.shape.length > PLAN_INLINE_MAX){
+		struct plan_shape shape = cc.shape;
+
+		cc.pos = cc.nest = 0;
+		cc.depth = cc.shape.max_depth = def->arity;
+		cc.shape.length = cc.shape.n_constants = cc.shape.n_slots = 0;
+		if((status = start_plan(&cc, &ctx->definition_arena, &shape, &literals)) == 'n'
+			&& (status = compile_body(&cc, &frame, def->arity)) == 'n')
+			compact_plan(&cc);
+		def->fragment = cc.plan;
+		def->literals = literals;
+	}
+	if(status == 'n')
+		ctx->definitions = def;
+done:
+	if(error_at != NULL)
+		*error_at = cc.pos;
+	return status;
+}
+
+/*! \fn char parse_plan(struct plan_context* ctx, const char* src, size_t len, struct plan_shape* shape, size_t* error_at)
+		\brief
+		This function is the first compilation pass. It checks the syntax of the
+		expression and measures the plan it compiles to, without allocating.
+
+		\param ctx the context whose user functions the expression may call, may be NULL.
+		\param src the expression (not necessarily NUL-terminated).
+		\param len the length of the expression in bytes.
+		\param shape a pointer to the plan_shape filled on success.
+		\param error_at a pointer to the byte offset of the error, may be NULL.
+		\return a char indicating the status of the parsing process:
+			- 'n' if the expression is valid
+			- 's' for syntax error
+			- 'd' if the expression nests deeper than PLAN_MAX_NEST or PLAN_MAX_STACK,
+			  or its inlined calls grow it beyond PLAN_MAX_LENGTH
+*/
+char parse_plan(struct plan_context* ctx, const char* src, size_t len, struct plan_shape* shape, size_t* error_at)
+{
+	struct compiler cc = {src, len, 0, 0, 0, {0, 0, 0, 0, 0, 0, 0}, NULL, ctx, NULL, NULL, NULL, NULL, {'f', 0, 0, 0, 0}, NULL, NULL};
+	char status = run_compiler(&cc);
+
+	*shape = cc.shape;
+	if(error_at != NULL)
+		*error_at = cc.pos;
+	return status;
+}
+
+static char emit_into(struct plan_context* ctx, const char* src, size_t len, const struct plan_shape* shape, struct plan** plan, struct plan_literal** literals)
+{
+	struct compiler cc = {src, len, 0, 0, 0, {0, 0, 0, 0, 0, 0, 0}, NULL, ctx, NULL, NULL, NULL, NULL, {'f', 0, 0, 0, 0}, NULL, NULL};
+	char status = start_plan(&cc, &ctx->arena, shape, literals);
+
+	if(status != 'n')
+		return status;
+	*plan = cc.plan;
+	if((status = run_compiler(&cc)) == 'n')
+		compact_plan(&cc);
+	return status;
+}
+
+/*! \fn char emit_plan(struct plan_context* ctx, const char* src, size_t len, const struct plan_shape* shape, struct plan** plan)
+		\brief
+		This function is the second compilation pass. It allocates the plan measured
+		by parse_plan() from the arena of 'ctx' and writes it.
+
+		\param ctx a pointer to the compilation context.
+		\param src the expression already accepted by parse_plan().
+		\param len the length of the expression in bytes.
+		\param shape the plan_shape returned by parse_plan().
+		\param plan a pointer that receives the compiled plan.
+		\return 'n' on success, 'm' when the arena is out of memory.
+*/
+char emit_plan(struct plan_context* ctx, const char* src, size_t len, const struct plan_shape* shape, struct plan** plan)
+{
+	return emit_into(ctx, src, len, shape, plan, NULL);
+}
+
+/*! \fn char emit_exact_plan(struct plan_context* ctx, const char* src, size_t len, const struct plan_shape* shape, struct plan** plan, struct plan_literal** literals)
+		\brief
+		This function works like emit_plan() and also keeps the exact text of every
+		constant of the plan, for the decimal and rational evaluators.
+
+		\param literals a pointer that receives the array of plan->n_constants literals.
+		\return 'n' on success, 'm' when the arena is out of memory.
+*/
+char emit_exact_plan(struct plan_context* ctx, const char* src, size_t len, const struct plan_shape* shape, struct plan** plan, struct plan_literal** literals)
+{
+	return emit_into(ctx, src, len, shape, plan, literals);
+}
+
+/*! \fn size_t plan_size(const struct plan_shape* shape)
+		\brief
+		This function returns the size in bytes of the block holding a plan.
+
+		\param shape the plan_shape returned by parse_plan().
+		\return the size of the plan, header included.
+*/
+size_t plan_size(const struct plan_shape* shape)
+{
+	return sizeof(struct plan) + shape->peak_constants * sizeof(double)
+		+ shape->peak_slots * sizeof(uint16_t) + shape->peak_length;
+}
+
+/*! \fn char compile_plan(struct plan_context* ctx, const char* src, size_t len, struct plan** plan, size_t* error_at)
+		\brief
+		This function compiles an expression into a plan allocated from the arena of
+		'ctx'. It runs parse_plan() then emit_plan().
+
+		\param ctx a pointer to the compilation context.
+		\param src the expression (not necessarily NUL-terminated).
+		\param len the length of the expression in bytes.
+		\param plan a pointer that receives the compiled plan.
+		\param error_at a pointer to the byte offset of the error, may be NULL.
+		\return the status of parse_plan() or emit_plan() ('n' on success).
+*/
+char compile_plan(struct plan_context* ctx, const char* src, size_t len, struct plan** plan, size_t* error_at)
+{
+	struct plan_shape shape;
+	char status = parse_plan(ctx, src, len, &shape, error_at);
+
+	if(status != 'n')
+		return status;
+	return emit_plan(ctx, src, len, &shape, plan);
+}
+
+/*! \fn char compile_exact_plan(struct plan_context* ctx, const char* src, size_t len, struct plan** plan, struct plan_literal** literals, size_t* error_at)
+		\brief
+		This function compiles an expression like compile_plan(), keeping the exact
+		text of its literals (see emit_exact_plan()).
+*/
+char compile_exact_plan(struct plan_context* ctx, const char* src, size_t len, struct plan** plan, struct plan_literal** literals, size_t* error_at)
+{
+	struct plan_shape shape;
+	char status = parse_plan(ctx, src, len, &shape, error_at);
+
+	if(status != 'n')
+		return status;
+	return emit_exact_plan(ctx, src, len, &shape, plan, literals);
+}
+
+/*! \fn static inline char run_plan(const struct plan* plan, const double* vars, const int widen, union plan_value* result)
+		\brief
+		This function is the evaluation loop. With 'widen' set, the integer opcodes
+		run in double instead, which is how a plan is evaluated again after an
+		integer overflow. It is inlined with a constant 'widen' in both callers.
+
+		\return 'i' for an integer result, 'f' for a double one, 'v' if an integer operation overflowed.
+*/
+static inline char run_plan(const struct plan* plan, const double* vars, const int widen, union plan_value* result)
+{
+	union plan_value stack[PLAN_MAX_STACK];
+	const double* constant = plan_constants(plan);
+	const uint16_t* slot = plan_slots(plan);
+	const uint8_t* code = plan_code(plan);
+	int top = -1;
+	int overflow = 0;
+	uint32_t i;
+
+	stack[0].i = 0;
+	for(i = 0; i < plan->length; i++){
+		switch(code[i]){
+			case PLAN_CONST:
+				stack[++top].f = *constant++;
+				break;
+			case PLAN_VAR:
+				stack[++top].f = vars[*slot++];
+				break;
+			case PLAN_NEG:
+				stack[top].f = -stack[top].f;
+				break;
+			case PLAN_ADD:
+				top--;
+				stack[top].f += stack[top+1].f;
+				break;
+			case PLAN_SUB:
+				top--;
+				stack[top].f -= stack[top+1].f;
+				break;
+			case PLAN_MUL:
+				top--;
+				stack[top].f *= stack[top+1].f;
+				break;
+			case PLAN_DIV:
+				top--;
+				stack[top].f /= stack[top+1].f;
+				break;
+			case PLAN_POW:
+				top--;
+				stack[top].f = pow(stack[top].f, stack[top+1].f);
+				break;
+			case PLAN_ICONST:
+				if(widen)
+					stack[++top].f = (double)*(const int64_t*)constant++;
+				else
+					stack[++top].i = *(const int64_t*)constant++;
+				break;
+			case PLAN_INEG:
+				if(widen)
+					stack[top].f = -stack[top].f;
+				else
+					overflow |= __builtin_sub_overflow((int64_t)0, stack[top].i, &stack[top].i);
+				break;
+			case PLAN_IADD:
+				top--;
+				if(widen)
+					stack[top].f += stack[top+1].f;
+				else
+					overflow |= __builtin_add_overflow(stack[top].i, stack[top+1].i, &stack[top].i);
+				break;
+			case PLAN_ISUB:
+				top--;
+				if(widen)
+					stack[top].f -= stack[top+1].f;
+				else
+					overflow |= __builtin_sub_overflow(stack[top].i, stack[top+1].i, &stack[top].i);
+				break;
+			case PLAN_IMUL:
+				top--;
+				if(widen)
+					stack[top].f *= stack[top+1].f;
+				else
+					overflow |= __builtin_mul_overflow(stack[top].i, stack[top+1].i, &stack[top].i);
+				break;
+			case PLAN_IPOW:
+				top--;
+				if(widen)
+					stack[top].f = pow(stack[top].f, stack[top+1].f);
+				else
+					overflow |= plan_power_int(&stack[top].i, stack[top+1].i);
+				break;
+			case PLAN_FLOAT:
+				if(!widen)
+					stack[top].f = (double)stack[top].i;
+				break;
+			case PLAN_FLOAT_NEXT:
+				if(!widen)
+					stack[top-1].f = (double)stack[top-1].i;
+				break;
+			case PLAN_SQRT:
+				stack[top].f = sqrt(stack[top].f);
+				break;
+			case PLAN_EXP:
+				stack[top].f = function_exp(stack[top].f);
+				break;
+			case PLAN_LOG:
+				stack[top].f = function_log(stack[top].f);
+				break;
+			case PLAN_SIN:
+				stack[top].f = function_sin(stack[top].f);
+				break;
+			case PLAN_ABS:
+				stack[top].f = fabs(stack[top].f);
+				break;
+			case PLAN_MIN:
+				top--;
+				stack[top].f = function_min(stack[top].f, stack[top+1].f);
+				break;
+			case PLAN_MAX:
+				top--;
+				stack[top].f = function_max(stack[top].f, stack[top+1].f);
+				break;
+			case PLAN_ARG:
+				top++;
+				stack[top] = stack[code[++i]];
+				break;
+			case PLAN_RETURN:
+			case PLAN_IRETURN:
+				top--;
+				stack[top] = stack[top+1];
+				break;
+		}
+	}
+	*result = stack[0];
+	if(overflow)
+		return 'v';
+	if(widen)
+		return 'f';
+	switch(code[plan->length - 1]){
+		case PLAN_ICONST: case PLAN_INEG: case PLAN_IADD: case PLAN_ISUB: case PLAN_IMUL: case PLAN_IPOW: case PLAN_IRETURN:
+			return 'i';
+		default:
+			return 'f';
+	}
+}
+
+/*! \fn char evaluate_plan_typed(const struct plan* plan, const double* vars, union plan_value* result)
+		\brief
+		This function evaluates a compiled plan and keeps the type of its result:
+		an integer expression that did not overflow gives its exact int64_t value.
+		The operand stack lives on the C stack, so evaluation performs no heap
+		allocation.
+
+		\param plan the plan returned by compile_plan().
+		\param vars the values of the variables, indexed by slot (may be NULL if the plan has none).
+		\param result a pointer that receives the result.
+		\return 'i' if result->i holds the result, 'f' if result->f does.
+*/
+char evaluate_plan_typed(const struct plan* plan, const double* vars, union plan_value* result)
+{
+	char type = run_plan(plan, vars, 0, result);
+
+	return type != 'v' ? type : run_plan(plan, vars, 1, result);
+}
+
+/*! \fn double evaluate_plan(const struct plan* plan, const double* vars)
+		\brief
+		This function evaluates a compiled plan. The operand stack lives on the C
+		stack, so evaluation performs no heap allocation.
+
+		\param plan the plan returned by compile_plan().
+		\param vars the values of the variables, indexed by slot (may be NULL if the plan has none).
+		\return the result of the expression.
+*/
+double evaluate_plan(const struct plan* plan, const double* vars)
+{
+	union plan_value result;
+
+	return evaluate_plan_typed(plan, vars, &result) == 'i' ? (double)result.i : result.f;
+}
@@ -0,0 +1,150 @@
+#ifndef PLAN_MATH_EXPR_H
+#define PLAN_MATH_EXPR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena-math-expr.h"
+
+#define PLAN_MAX_STACK 128    // deepest operand stack a plan may need
+#define PLAN_MAX_NEST 256     // deepest nesting of parentheses and '^' chains
+#define PLAN_MAX_VARS 65536   // variable slots are 16-bit indices
+#define PLAN_MAX_PARAMS 16    // parameters of a user-defined function
+#define PLAN_INLINE_MAX 32    // user functions of at most this many opcodes are inlined from their text
+#define PLAN_MAX_LENGTH (1u << 24)  // opcodes a plan may grow to by inlining calls
+
+enum plan_opcode {
+	PLAN_CONST,  // push the next constant of the pool
+	PLAN_VAR,    // push vars[next slot]
+	PLAN_NEG,
+	PLAN_ADD,
+	PLAN_SUB,
+	PLAN_MUL,
+	PLAN_DIV,
+	PLAN_POW,
+	PLAN_ICONST,      // push the next constant of the pool, an int64_t
+	PLAN_INEG,
+	PLAN_IADD,
+	PLAN_ISUB,
+	PLAN_IMUL,
+	PLAN_IPOW,
+	PLAN_FLOAT,       // convert the integer on top of the stack to double
+	PLAN_FLOAT_NEXT,  // convert the integer below the top of the stack to double
+	PLAN_SQRT,        // the built-in functions of function-math-expr.h, on doubles
+	PLAN_EXP,
+	PLAN_LOG,
+	PLAN_SIN,
+	PLAN_ABS,
+	PLAN_MIN,
+	PLAN_MAX,
+	PLAN_ARG,         // push a copy of the stack entry whose index is the next byte of code
+	PLAN_RETURN,      // drop the entry below the top of the stack, an argument of a user function
+	PLAN_IRETURN      // the same, when the result of the function is an integer
+};
+
+/* A plan is a single 64-byte aligned block allocated from the arena: this
+   16-byte header, then the constant pool, then the 16-bit variable slots, then
+   the one-byte opcodes. PLAN_CONST and PLAN_VAR consume the pool and the slots
+   in order, so opcodes carry no operand, except PLAN_ARG whose operand is the
+   following byte.
+
+   Subexpressions made only of integer literals and '+', '-', '*' and '^' are
+   typed as integers by the compiler: their constants are int64_t in the pool
+   and they run on the PLAN_I* opcodes, with PLAN_FLOAT* conversions where they
+   meet a double operand. */
+struct plan {
+	uint32_t length;
+	uint32_t n_constants;
+	uint32_t n_slots;
+	uint16_t max_depth;
+	uint16_t max_slot;   // highest variable slot read, meaningful when n_slots > 0
+};
+
+static inline const double* plan_constants(const struct plan* plan)
+{
+	return (const double*)(plan + 1);
+}
+
+static inline const uint16_t* plan_slots(const struct plan* plan)
+{
+	return (const uint16_t*)(plan_constants(plan) + plan->n_constants);
+}
+
+static inline const uint8_t* plan_code(const struct plan* plan)
+{
+	return (const uint8_t*)(plan_slots(plan) + plan->n_slots);
+}
+
+static inline char plan_power_int(int64_t* base, int64_t exponent)  // returns 1 on overflow or a negative exponent
+{
+	int64_t result = 1, square = *base;
+
+	if(exponent < 0)
+		return 1;
+	while(exponent != 0){
+		if((exponent & 1) && __builtin_mul_overflow(result, square, &result))
+			return 1;
+		if((exponent >>= 1) != 0 && __builtin_mul_overflow(square, square, &square))
+			return 1;
+	}
+	*base = result;
+	return 0;
+}
+
+/* The exact text of a literal, kept beside a plan by emit_exact_plan() for the
+   exact arithmetic modes, which cannot start from the rounded double of the
+   constant pool. literals[i] describes plan_constants(plan)[i]. */
+struct plan_literal {
+	const char* digits;   // the digits without the dot, copied to the arena
+	uint32_t n_digits;
+	uint32_t fraction;    // how many of the digits follow the dot
+	uint64_t value;       // the digits as an integer, valid when n_digits <= 19
+	int negative;
+};
+
+union plan_value {
+	double f;
+	int64_t i;
+};
+
+struct plan_shape {
+	uint32_t length;
+	uint32_t n_constants;
+	uint32_t n_slots;
+	uint32_t max_depth;
+	uint32_t peak_length;     // the sizes reached while compiling, before constant folding
+	uint32_t peak_constants;  // and argument substitution took entries back: the plan is
+	uint32_t peak_slots;      // written with this much room, then compacted
+};
+
+struct plan_symbols {
+	char** names;
+	unsigned int count;
+	unsigned int capacity;
+};
+
+struct plan_definition;
+
+struct plan_context {
+	struct arena arena;
+	struct plan_symbols symbols;  // variable names, kept across resets
+	const struct plan_definition* definitions;  // user functions, newest first, kept across resets
+	struct arena definition_arena;              // holds them, set up by the first definition
+};
+
+char plan_context_init(struct plan_context* ctx);
+void plan_context_reset(struct plan_context* ctx);
+void plan_context_release(struct plan_context* ctx);
+char plan_symbol(struct plan_context* ctx, const char* name, size_t len, unsigned int* slot);
+
+char plan_define(struct plan_context* ctx, const char* src, size_t len, size_t* error_at);
+
+char parse_plan(struct plan_context* ctx, const char* src, size_t len, struct plan_shape* shape, size_t* error_at);
+char emit_plan(struct plan_context* ctx, const char* src, size_t len, const struct plan_shape* shape, struct plan** plan);
+char compile_plan(struct plan_context* ctx, const char* src, size_t len, struct plan** plan, size_t* error_at);
+char emit_exact_plan(struct plan_context* ctx, const char* src, size_t len, const struct plan_shape* shape, struct plan** plan, struct plan_literal** literals);
+char compile_exact_plan(struct plan_context* ctx, const char* src, size_t len, struct plan** plan, struct plan_literal** literals, size_t* error_at);
+size_t plan_size(const struct plan_shape* shape);
+double evaluate_plan(const struct plan* plan, const double* vars);
+char evaluate_plan_typed(const struct plan* plan, const double* vars, union plan_value* result);
+
+#endif
@@ -0,0 +1,521 @@
+/*!
+	\file rational-math-expr.c
+	\brief
+	This file contains the exact rational evaluator. It runs the same plans as
+	evaluate_plan() over fractions, so 1/3*3 is exactly 1. Like the decimal
+	evaluator it reads the literals from the exact text kept by
+	emit_exact_plan() (0.1 is 1/10) and does not allocate.
+
+	Numerators and denominators are int64_t and every operation checks for
+	overflow. Fractions are not reduced after each operation: a GCD costs more
+	than the operation itself and most intermediate results never come close to
+	overflowing. An operation that overflows first retries on reduced operands
+	(with the cross-reduction a/b * c/d = (a/g1)(c/g2) / ((b/g2)(d/g1)) for
+	products and a common denominator for sums); only when that still overflows
+	does it spill to bignums, where results are always kept in lowest terms.
+*/
+
+#include <string.h>
+#include "rational-math-expr.h"
+
+static const int64_t pow10_64[19] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+	10000000000, 100000000000, 1000000000000, 10000000000000, 100000000000000,
+	1000000000000000, 10000000000000000, 100000000000000000, 1000000000000000000
+};
+
+static uint64_t magnitude(int64_t value)
+{
+	return value < 0 ? (uint64_t)0 - (uint64_t)value : (uint64_t)value;
+}
+
+static uint64_t gcd64(uint64_t a, uint64_t b)  // binary GCD
+{
+	uint64_t t;
+	int shift;
+
+	if(a == 0 || b == 0)
+		return a | b;
+	shift = __builtin_ctzll(a | b);
+	a >>= __builtin_ctzll(a);
+	do{
+		b >>= __builtin_ctzll(b);
+		if(a > b){
+			t = a;
+			a = b;
+			b = t;
+		}
+		b -= a;
+	}while(b != 0);
+	return a << shift;
+}
+
+static void reduce_small(struct rational* a)
+{
+	int64_t g = (int64_t)gcd64(magnitude(a->num), (uint64_t)a->den);
+
+	if(g > 1){
+		a->num /= g;
+		a->den /= g;
+	}
+}
+
+static void widen(const struct rational* a, struct bignum* num, struct bignum* den)
+{
+	if(a->big){
+		*num = a->wide_num;
+		*den = a->wide_den;
+	}
+	else{
+		bignum_from_int64(num, a->num);
+		bignum_from_int64(den, a->den);
+	}
+}
+
+/*! \fn static char settle(struct rational* r, struct bignum* num, struct bignum* den)
+		\brief
+		This function stores the result num/den of a bignum operation in lowest
+		terms with a positive denominator, back in int64_t if both parts fit.
+*/
+static char settle(struct rational* r, struct bignum* num, struct bignum* den)
+{
+	struct bignum g;
+
+	if(bignum_is_zero(den))
+		return 'z';
+	bignum_gcd(&g, num, den);
+	if(!(g.n == 1 && g.limb[0] == 1)){
+		bignum_divmod(num, NULL, num, &g);
+		bignum_divmod(den, NULL, den, &g);
+	}
+	if(den->negative){
+		den->negative = 0;
+		num->negative = !num->negative && !bignum_is_zero(num);
+	}
+	if(bignum_to_int64(num, &r->num) == 'n' && bignum_to_int64(den, &r->den) == 'n')
+		r->big = 0;
+	else{
+		r->wide_num = *num;
+		r->wide_den = *den;
+		r->big = 1;
+	}
+	return 'n';
+}
+
+static char literal_rational(const struct plan_literal* literal, struct rational* r)
+{
+	struct bignum num, den;
+
+	if(literal->n_digits <= 18 && literal->fraction <= 18){
+		r->num = literal->negative ? -(int64_t)literal->value : (int64_t)literal->value;
+		r->den = pow10_64[literal->fraction];
+		r->big = 0;
+		return 'n';
+	}
+	if(bignum_from_digits(&num, literal->digits, literal->n_digits) != 'n'
+		|| literal->fraction > BIGNUM_LIMBS * 9 || bignum_pow10(&den, literal->fraction) != 'n')
+		return 'v';
+	num.negative = literal->negative && !bignum_is_zero(&num);
+	return settle(r, &num, &den);
+}
+
+static int is_negative(const struct rational* a)
+{
+	return a->big ? a->wide_num.negative : a->num < 0;
+}
+
+static char negate(struct rational* a)
+{
+	struct bignum num, den;
+
+	if(!a->big && a->num != INT64_MIN){
+		a->num = -a->num;
+		return 'n';
+	}
+	widen(a, &num, &den);
+	num.negative = !num.negative && !bignum_is_zero(&num);
+	return settle(a, &num, &den);
+}
+
+static char add(struct rational* a, const struct rational* b, int subtract)
+{
+	struct bignum an, ad, bn, bd, x;
+	int64_t c, e, g, n, d, p, q;
+
+	if(!a->big && !b->big && !(subtract && b->num == INT64_MIN)){
+		c = subtract ? -b->num : b->num;
+		if(a->den == b->den){
+			if(!__builtin_add_overflow(a->num, c, &n)){
+				a->num = n;
+				return 'n';
+			}
+		}
+		else if(!__builtin_mul_overflow(a->num, b->den, &p) && !__builtin_mul_overflow(c, a->den, &q)
+			&& !__builtin_add_overflow(p, q, &n) && !__builtin_mul_overflow(a->den, b->den, &d)){
+			a->num = n;
+			a->den = d;
+			return 'n';
+		}
+
+		// retry on reduced operands over the least common denominator
+		reduce_small(a);
+		g = (int64_t)gcd64(magnitude(c), (uint64_t)b->den);
+		c /= g;
+		e = b->den / g;
+		g = (int64_t)gcd64((uint64_t)a->den, (uint64_t)e);
+		if(!__builtin_mul_overflow(a->num, e / g, &p) && !__builtin_mul_overflow(c, a->den / g, &q)
+			&& !__builtin_add_overflow(p, q, &n) && !__builtin_mul_overflow(a->den, e / g, &d)){
+			a->num = n;
+			a->den = d;
+			return 'n';
+		}
+	}
+	widen(a, &an, &ad);
+	widen(b, &bn, &bd);
+	if(subtract)
+		bn.negative = !bn.negative && !bignum_is_zero(&bn);
+	if(bignum_mul(&an, &an, &bd) != 'n' || bignum_mul(&x, &bn, &ad) != 'n'
+		|| bignum_add(&an, &an, &x) != 'n' || bignum_mul(&ad, &ad, &bd) != 'n')
+		return 'v';
+	return settle(a, &an, &ad);
+}
+
+/*! \fn static char multiply_parts(struct rational* a, int64_t num, int64_t den)
+		\brief
+		This function multiplies 'a' by num/den (den > 0), both given as int64_t.
+*/
+static char multiply_parts(struct rational* a, int64_t num, int64_t den)
+{
+	struct bignum an, ad, bn, bd;
+	int64_t n, d;
+
+	if(!a->big){
+		int64_t g1, g2;
+
+		if(!__builtin_mul_overflow(a->num, num, &n) && !__builtin_mul_overflow(a->den, den, &d)){
+			a->num = n;
+			a->den = d;
+			return 'n';
+		}
+		g1 = (int64_t)gcd64(magnitude(a->num), (uint64_t)den);
+		g2 = (int64_t)gcd64(magnitude(num), (uint64_t)a->den);
+		if(!__builtin_mul_overflow(a->num / g1, num / g2, &n) && !__builtin_mul_overflow(a->den / g2, den / g1, &d)){
+			a->num = n;
+			a->den = d;
+			return 'n';
+		}
+	}
+	widen(a, &an, &ad);
+	bignum_from_int64(&bn, num);
+	bignum_from_int64(&bd, den);
+	if(bignum_mul(&an, &an, &bn) != 'n' || bignum_mul(&ad, &ad, &bd) != 'n')
+		return 'v';
+	return settle(a, &an, &ad);
+}
+
+static char multiply(struct rational* a, const struct rational* b, int divide)
+{
+	struct bignum an, ad, bn, bd;
+
+	if(!b->big){
+		if(!divide)
+			return multiply_parts(a, b->num, b->den);
+		if(b->num == 0)
+			return 'z';
+		if(b->num != INT64_MIN)
+			return b->num > 0 ? multiply_parts(a, b->den, b->num) : multiply_parts(a, -b->den, -b->num);
+	}
+	widen(a, &an, &ad);
+	widen(b, &bn, &bd);
+	if(divide && (bignum_mul(&an, &an, &bd) != 'n' || bignum_mul(&ad, &ad, &bn) != 'n'))
+		return 'v';
+	if(!divide && (bignum_mul(&an, &an, &bn) != 'n' || bignum_mul(&ad, &ad, &bd) != 'n'))
+		return 'v';
+	return settle(a, &an, &ad);
+}
+
+/*! \fn static char power(struct rational* a, const struct rational* b)
+		\brief
+		This function raises 'a' to the integer power 'b'. The base is reduced
+		first, so that its powers are in lowest terms too.
+
+		\return 'n' on success, 'x' if 'b' is not an integer (the result would not be rational in general), 'z' for a negative power of zero, 'v' on overflow.
+*/
+static char power(struct rational* a, const struct rational* b)
+{
+	struct rational e = *b;
+	struct bignum num, den, t;
+	int64_t n, rn = 1, rd = 1, sn, sd;
+	uint64_t m, k;
+
+	if(e.big){
+		widen(&e, &num, &den);
+		settle(&e, &num, &den);
+	}
+	else
+		reduce_small(&e);
+	if(e.big)
+		return e.wide_den.n == 1 && e.wide_den.limb[0] == 1 ? 'v' : 'x';
+	if(e.den != 1)
+		return 'x';
+	n = e.num;
+	m = magnitude(n);
+
+	if(a->big){
+		widen(a, &num, &den);
+		settle(a, &num, &den);
+	}
+	else
+		reduce_small(a);
+	if(n < 0){
+		if(a->big ? bignum_is_zero(&a->wide_num) : a->num == 0)
+			return 'z';
+		if(a->big){
+			t = a->wide_num;
+			a->wide_num = a->wide_den;
+			a->wide_den = t;
+			if(t.negative){
+				a->wide_den.negative = 0;
+				a->wide_num.negative = 1;
+			}
+		}
+		else if(a->num == INT64_MIN){
+			widen(a, &num, &den);
+			a->wide_num = den;
+			a->wide_num.negative = 1;
+			a->wide_den = num;
+			a->wide_den.negative = 0;
+			a->big = 1;
+		}
+		else{
+			sn = a->num;
+			a->num = sn < 0 ? -a->den : a->den;
+			a->den = sn < 0 ? -sn : sn;
+		}
+	}
+
+	if(!a->big){
+		sn = a->num;
+		sd = a->den;
+		for(k = m; k != 0; k >>= 1){
+			if((k & 1) && (__builtin_mul_overflow(rn, sn, &rn) || __builtin_mul_overflow(rd, sd, &rd)))
+				break;
+			if(k > 1 && (__builtin_mul_overflow(sn, sn, &sn) || __builtin_mul_overflow(sd, sd, &sd)))
+				break;
+		}
+		if(k == 0){
+			a->num = rn;
+			a->den = rd;
+			return 'n';
+		}
+	}
+	widen(a, &num, &den);
+	if(bignum_pow(&num, &num, m) != 'n' || bignum_pow(&den, &den, m) != 'n')
+		return 'v';
+	return settle(a, &num, &den);
+}
+
+/*! \fn char rational_parse(const char* text, size_t len, struct rational* value)
+		\brief
+		This function reads a rational number, such as the value of a '--var', with
+		an optional sign, digits and at most one dot (2.5 is 25/10).
+
+		\return 'n' on success, 's' if the text is not a number, 'v' if it is too long.
+*/
+char rational_parse(const char* text, size_t len, struct rational* value)
+{
+	char digits[BIGNUM_LIMBS * 9];
+	struct plan_literal literal = {digits, 0, 0, 0, 0};
+	int dot = 0;
+	size_t i = 0;
+
+	if(i < len && (text[i] == '-' || text[i] == '+'))
+		literal.negative = text[i++] == '-';
+	for(; i < len; i++){
+		if(text[i] == '.' && !dot)
+			dot = 1;
+		else if(text[i] >= '0' && text[i] <= '9'){
+			if(literal.n_digits == sizeof(digits))
+				return 'v';
+			digits[literal.n_digits++] = text[i];
+			literal.value = literal.value * 10 + (uint64_t)(text[i] - '0');
+			literal.fraction += (uint32_t)dot;
+		}
+		else
+			return 's';
+	}
+	if(literal.n_digits == 0)
+		return 's';
+	return literal_rational(&literal, value);
+}
+
+static int format_int64(int64_t value, char* out)
+{
+	char digits[20];
+	uint64_t m = magnitude(value);
+	int len = 0, n = 0;
+
+	do{
+		digits[len++] = (char)('0' + m % 10);
+		m /= 10;
+	}while(m != 0);
+	if(value < 0)
+		out[n++] = '-';
+	while(len > 0)
+		out[n++] = digits[--len];
+	return n;
+}
+
+/*! \fn int rational_format(const struct rational* value, char* out)
+		\brief
+		This function writes a rational number as "num/den", or as "num" when the
+		denominator is 1. The value is written as it is, so pass a result of
+		evaluate_rational() to get lowest terms.
+
+		\param out a buffer of at least RATIONAL_FORMAT_MAX chars.
+		\return the length written, without the terminating NUL.
+*/
+int rational_format(const struct rational* value, char* out)
+{
+	int n;
+
+	if(!value->big){
+		n = format_int64(value->num, out);
+		if(value->den != 1){
+			out[n++] = '/';
+			n += format_int64(value->den, out + n);
+		}
+	}
+	else{
+		n = bignum_to_string(&value->wide_num, out, RATIONAL_FORMAT_MAX / 2);
+		if(!(value->wide_den.n == 1 && value->wide_den.limb[0] == 1)){
+			out[n++] = '/';
+			n += bignum_to_string(&value->wide_den, out + n, RATIONAL_FORMAT_MAX / 2);
+		}
+	}
+	out[n] = '\0';
+	return n;
+}
+
+/*! \fn static char extreme(struct rational* a, const struct rational* b, int maximum)
+		\brief
+		This function keeps in 'a' the smaller of 'a' and 'b', or the larger one
+		with 'maximum' set, by the sign of their exact difference.
+*/
+static char extreme(struct rational* a, const struct rational* b, int maximum)
+{
+	struct rational difference = *a;
+	char status = add(&difference, b, 1);
+
+	if(status == 'n' && is_negative(&difference) == maximum)
+		*a = *b;
+	return status;
+}
+
+/*! \fn char evaluate_rational(const struct plan* plan, const struct plan_literal* literals, const struct rational* vars, struct rational* result)
+		\brief
+		This function evaluates a plan in exact rational arithmetic and returns its
+		result in lowest terms. The operand stack lives on the C stack, so
+		evaluation performs no heap allocation.
+
+		\param plan a plan compiled by compile_exact_plan().
+		\param literals the literals kept with the plan.
+		\param vars the values of the variables, indexed by slot.
+		\param result a pointer that receives the result.
+		\return a char indicating the status of the evaluation:
+			- 'n' on success
+			- 'z' for a division by zero or a negative power of zero
+			- 'x' for a power with a non-integer exponent
+			- 'u' for sqrt, exp, log and sin, whose results are not exact
+			- 'v' if a value exceeds the capacity of the bignums
+*/
+char evaluate_rational(const struct plan* plan, const struct plan_literal* literals, const struct rational* vars, struct rational* result)
+{
+	struct rational stack[PLAN_MAX_STACK];
+	const uint16_t* slot = plan_slots(plan);
+	const uint8_t* code = plan_code(plan);
+	const struct rational* var;
+	struct bignum num, den;
+	char status = 'n';
+	int top = -1;
+	uint32_t i;
+
+	for(i = 0; i < plan->length && status == 'n'; i++){
+		switch(code[i]){
+			case PLAN_CONST:
+			case PLAN_ICONST:
+				status = literal_rational(literals++, &stack[++top]);
+				break;
+			case PLAN_VAR:
+			case PLAN_ARG:
+				var = code[i] == PLAN_VAR ? &vars[*slot++] : &stack[code[++i]];
+				top++;
+				if(var->big)
+					stack[top] = *var;
+				else{
+					stack[top].num = var->num;
+					stack[top].den = var->den;
+					stack[top].big = 0;
+				}
+				break;
+			case PLAN_RETURN:
+			case PLAN_IRETURN:
+				var = &stack[top--];
+				if(var->big)
+					stack[top] = *var;
+				else{
+					stack[top].num = var->num;
+					stack[top].den = var->den;
+					stack[top].big = 0;
+				}
+				break;
+			case PLAN_NEG:
+			case PLAN_INEG:
+				status = negate(&stack[top]);
+				break;
+			case PLAN_ADD:
+			case PLAN_SUB:
+			case PLAN_IADD:
+			case PLAN_ISUB:
+				top--;
+				status = add(&stack[top], &stack[top+1], code[i] == PLAN_SUB || code[i] == PLAN_ISUB);
+				break;
+			case PLAN_MUL:
+			case PLAN_IMUL:
+			case PLAN_DIV:
+				top--;
+				status = multiply(&stack[top], &stack[top+1], code[i] == PLAN_DIV);
+				break;
+			case PLAN_POW:
+			case PLAN_IPOW:
+				top--;
+				status = power(&stack[top], &stack[top+1]);
+				break;
+			case PLAN_FLOAT:
+			case PLAN_FLOAT_NEXT:
+				break;
+			case PLAN_ABS:
+				if(is_negative(&stack[top]))
+					status = negate(&stack[top]);
+				break;
+			case PLAN_MIN:
+			case PLAN_MAX:
+				top--;
+				status = extreme(&stack[top], &stack[top+1], code[i] == PLAN_MAX);
+				break;
+			default:
+				status = 'u';
+		}
+	}
+	if(status != 'n')
+		return status;
+	if(stack[0].big){
+		widen(&stack[0], &num, &den);
+		settle(result, &num, &den);
+	}
+	else{
+		*result = stack[0];
+		reduce_small(result);
+	}
+	return 'n';
+}
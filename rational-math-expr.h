@@ -0,0 +1,27 @@
+#ifndef RATIONAL_MATH_EXPR_H
+#define RATIONAL_MATH_EXPR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "plan-math-expr.h"
+#include "bignum-math-expr.h"
+
+#define RATIONAL_FORMAT_MAX (2 * (BIGNUM_LIMBS * 10 + 2) + 2)  // longest "num/den", '\0' included
+
+/* A rational number num/den with den > 0. It is held in two int64_t while they
+   fit; 'big' is set when it lives in 'wide_num' and 'wide_den' instead. The
+   fraction is not kept in lowest terms: evaluate_rational() reduces it only
+   when an operation would overflow, and once on its result. */
+struct rational {
+	int64_t num;
+	int64_t den;
+	int big;
+	struct bignum wide_num;
+	struct bignum wide_den;
+};
+
+char rational_parse(const char* text, size_t len, struct rational* value);
+int rational_format(const struct rational* value, char* out);
+char evaluate_rational(const struct plan* plan, const struct plan_literal* literals, const struct rational* vars, struct rational* result);
+
+#endif
@@ -0,0 +1,59 @@
+/*!
+	\file ring-math-expr.c
+	\brief
+	This file contains the setup of the lock-free single-producer
+	single-consumer ring used to pass batches between the threads of the
+	pipeline, and the back-off used by a thread that finds its ring full or
+	empty. The push and pop operations are inline in ring-math-expr.h. The ring
+	carries whole batches rather than single expressions, so that its cost is
+	shared by the lines of a batch.
+*/
+
+#include <stdlib.h>
+#include <sched.h>
+#include "ring-math-expr.h"
+
+/*! \fn char ring_init(struct ring* ring, size_t capacity)
+		\brief
+		This function prepares an empty ring.
+
+		\param ring the ring.
+		\param capacity the number of slots, rounded up to a power of two.
+		\return 'n' on success, 'm' when out of memory.
+*/
+char ring_init(struct ring* ring, size_t capacity)
+{
+	size_t size = 1;
+
+	while(size < capacity)
+		size <<= 1;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	ring->cached_head = ring->cached_tail = 0;
+	ring->mask = size - 1;
+	ring->slots = malloc(size * sizeof(void*));
+	return ring->slots ? 'n' : 'm';
+}
+
+void ring_free(struct ring* ring)
+{
+	free(ring->slots);
+	ring->slots = NULL;
+}
+
+/*! \fn void ring_wait(unsigned int* spins)
+		\brief
+		This function backs off a thread waiting on a ring: it spins briefly, then
+		yields the CPU so that the other stages can run on busy or small hosts. The
+		caller resets 'spins' to 0 once the ring operation succeeds.
+*/
+void ring_wait(unsigned int* spins)
+{
+	if(++*spins < 64){
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#endif
+	}
+	else
+		sched_yield();
+}
@@ -0,0 +1,55 @@
+#ifndef RING_MATH_EXPR_H
+#define RING_MATH_EXPR_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define CACHE_LINE 64
+
+/* Bounded single-producer single-consumer ring of pointers. The producer and
+   the consumer indices live on their own cache lines, each next to the side's
+   cached copy of the other index, so a push or a pop only touches the shared
+   line of the other side when the ring looks full or empty. */
+struct ring {
+	_Alignas(CACHE_LINE) atomic_size_t head;   // next slot to pop, written by the consumer
+	size_t cached_tail;
+	_Alignas(CACHE_LINE) atomic_size_t tail;   // next slot to push, written by the producer
+	size_t cached_head;
+	_Alignas(CACHE_LINE) size_t mask;
+	void** slots;
+};
+
+char ring_init(struct ring* ring, size_t capacity);
+void ring_free(struct ring* ring);
+void ring_wait(unsigned int* spins);
+
+static inline int ring_push(struct ring* ring, void* item)
+{
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+	if(tail - ring->cached_head > ring->mask){
+		ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+		if(tail - ring->cached_head > ring->mask)
+			return 0;  // full
+	}
+	ring->slots[tail & ring->mask] = item;
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+	return 1;
+}
+
+static inline void* ring_pop(struct ring* ring)
+{
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	void* item;
+
+	if(head == ring->cached_tail){
+		ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+		if(head == ring->cached_tail)
+			return NULL;  // empty
+	}
+	item = ring->slots[head & ring->mask];
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+	return item;
+}
+
+#endif
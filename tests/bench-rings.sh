@@ -0,0 +1,6 @@
+# The rings benchmark passes every item through the SPSC ring and the MPMC ring
+# (its consumers stop only once all of them arrived) for each batch size.
+
+$BENCH --rings > $TMP/rings.out
+[ $(grep -c '^spsc ' $TMP/rings.out) -eq 6 ]
+[ $(grep -c '^mpmc ' $TMP/rings.out) -eq 6 ]
@@ -0,0 +1,30 @@
+# --check validates without evaluating: OK, SYNTAX ERROR or TOO DEEP per line,
+# the same whether the input arrives at once or in small reads that split long
+# lines, and the exit status tells whether every line is valid.
+
+long(){
+	printf '%s' "$1"
+	yes "$2" | head -n $3 | tr -d '\n'
+}
+{
+	printf '1+2\n'
+	long 1 +x 700000; printf '\n'
+	long 1 +2 400000; printf '$'; long '' +2 400000; printf '\n'
+	long '' '(' 300; printf '1\n'
+	printf 'f(1, 2)\n'
+	printf 'x+\n'
+	long 2 '*3' 800000
+} > $TMP/check-mode.in
+printf 'OK\nOK\nSYNTAX ERROR\nTOO DEEP\nOK\nSYNTAX ERROR\nOK\n' > $TMP/check-mode.expected
+printf '3\tsyntax\t800001\t$\n4\ttoo-deep\t256\t(\n6\tsyntax\t2\t\n' > $TMP/check-mode.expected-errors
+
+$CALC --check --define 'f(a, b) = a*b' --errors $TMP/check-mode.errors < $TMP/check-mode.in > $TMP/check-mode.out && exit 1
+cmp -s $TMP/check-mode.expected $TMP/check-mode.out
+cmp -s $TMP/check-mode.expected-errors $TMP/check-mode.errors
+
+dd if=$TMP/check-mode.in bs=997 2> /dev/null | $CALC --check --define 'f(a, b) = a*b' --errors $TMP/check-mode.errors > $TMP/check-mode.out && exit 1
+cmp -s $TMP/check-mode.expected $TMP/check-mode.out
+cmp -s $TMP/check-mode.expected-errors $TMP/check-mode.errors
+
+printf '1+2\nsin(x)*y\n' | $CALC --check > $TMP/check-mode.out
+printf 'OK\nOK\n' | cmp -s - $TMP/check-mode.out
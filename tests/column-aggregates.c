@@ -0,0 +1,111 @@
+/* The aggregates of reduce_plan_rows() and column_reduction_result(): exact
+   sums, means, minimums and maximums of integers, NaN rows ignored by min and
+   max, dot products, and the error of each summation mode on a sum of 0.1.
+   The rows are split into consecutive ranges as between workers, and every
+   instruction set gives the same bits. */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "plan-math-expr.h"
+#include "column-math-expr.h"
+
+#define ROWS 100003
+#define MAX_PARTS 7
+
+#define CHECK(condition) do{ \
+	if(!(condition)){ \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+		exit(1); \
+	} \
+}while(0)
+
+static double a[ROWS], b[ROWS], d[ROWS];
+static const double* const columns[3] = {a, b, d};
+
+/* the aggregate of 'text' over the rows split into 'parts' consecutive ranges */
+static double aggregate(struct plan_context* ctx, const char* text, int kind, int summation, unsigned int parts)
+{
+	struct column_reduction partials[MAX_PARTS];
+	struct plan* plan;
+	size_t error_at;
+	unsigned int p;
+
+	plan_context_reset(ctx);
+	CHECK(compile_plan(ctx, text, strlen(text), &plan, &error_at) == 'n');
+	for(p = 0; p < parts; p++)
+		reduce_plan_rows(plan, (const double* const*)columns, 3, (uint64_t)ROWS * p / parts, (uint64_t)ROWS * (p + 1) / parts, summation, &partials[p]);
+	return column_reduction_result(partials, parts, kind, summation);
+}
+
+int main(void)
+{
+	static const char* isas[] = {"sse2", "avx2", "avx512"};
+	static const unsigned int parts[] = {1, 3, 7};
+	const double n = ROWS, ulp = nextafter(n / 10, INFINITY) - n / 10;
+	double first[3][3], tenth, error[3];
+	long double exact = 0;
+	struct plan_context ctx;
+	unsigned int slot, k, s, p, i;
+	int isa_done = 0;
+
+	for(i = 0; i < ROWS; i++){
+		a[i] = i + 1;
+		b[i] = 0.1;
+		d[i] = i % 10 == 3 ? NAN : (double)i - 5000;
+		exact += (long double)0.1;
+	}
+	CHECK(plan_context_init(&ctx) == 'n');
+	CHECK(plan_symbol(&ctx, "a", 1, &slot) == 'n' && slot == 0);
+	CHECK(plan_symbol(&ctx, "b", 1, &slot) == 'n' && slot == 1);
+	CHECK(plan_symbol(&ctx, "d", 1, &slot) == 'n' && slot == 2);
+
+	for(k = 0; k < 3; k++){
+		if(column_isa(isas[k]) != 'n')
+			continue;  // not an instruction set of this CPU
+		for(s = 0; s < 3; s++)
+			for(p = 0; p < 3; p++){
+				CHECK(aggregate(&ctx, "a", AGGREGATE_SUM, s, parts[p]) == n * (n + 1) / 2);
+				CHECK(aggregate(&ctx, "2*a - 1", AGGREGATE_SUM, s, parts[p]) == n * n);
+				CHECK(aggregate(&ctx, "a", AGGREGATE_MEAN, s, parts[p]) == (n + 1) / 2);
+				CHECK(aggregate(&ctx, "a", AGGREGATE_MIN, s, parts[p]) == 1);
+				CHECK(aggregate(&ctx, "a", AGGREGATE_MAX, s, parts[p]) == n);
+				CHECK(aggregate(&ctx, "-a", AGGREGATE_MIN, s, parts[p]) == -n);
+				CHECK(aggregate(&ctx, "d", AGGREGATE_MIN, s, parts[p]) == -5000);
+				CHECK(aggregate(&ctx, "d", AGGREGATE_MAX, s, parts[p]) == n - 1 - 5000);
+				CHECK(isnan(aggregate(&ctx, "d", AGGREGATE_SUM, s, parts[p])));
+				CHECK(aggregate(&ctx, "a*(a-1)", AGGREGATE_SUM, s, parts[p]) == (n - 1) * n * (n + 1) / 3);  // dot(a, a-1)
+
+				// every instruction set sums 0.1 into the same bits
+				tenth = aggregate(&ctx, "b", AGGREGATE_SUM, s, parts[p]);
+				if(!isa_done)
+					first[s][p] = tenth;
+				CHECK(memcmp(&tenth, &first[s][p], sizeof(double)) == 0);
+				if(p == 0)
+					error[s] = fabs((double)((long double)tenth - exact));
+			}
+		isa_done = 1;
+	}
+	// the compensated modes are within a few ulps, the plain running sums drift further
+	CHECK(error[SUMMATION_KAHAN] <= 2 * ulp);
+	CHECK(error[SUMMATION_PAIRWISE] <= 4 * ulp);
+	CHECK(error[SUMMATION_KAHAN] <= error[SUMMATION_PLAIN] && error[SUMMATION_PAIRWISE] <= error[SUMMATION_PLAIN]);
+
+	// no rows
+	for(s = 0; s < 3; s++){
+		struct column_reduction none;
+		struct plan* plan;
+		size_t error_at;
+
+		plan_context_reset(&ctx);
+		CHECK(compile_plan(&ctx, "a", 1, &plan, &error_at) == 'n');
+		reduce_plan_rows(plan, (const double* const*)columns, 3, 0, 0, s, &none);
+		CHECK(column_reduction_result(&none, 1, AGGREGATE_SUM, s) == 0);
+		CHECK(isnan(column_reduction_result(&none, 1, AGGREGATE_MEAN, s)));
+		CHECK(isnan(column_reduction_result(&none, 1, AGGREGATE_MIN, s)));
+	}
+	plan_context_release(&ctx);
+	return 0;
+}
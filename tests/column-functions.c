@@ -0,0 +1,69 @@
+/* The built-in functions evaluated in blocks by evaluate_plan_rows() give, with
+   every instruction set of the CPU, the same bits as evaluate_plan() row by row,
+   including at special arguments and over a partial last block. */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "plan-math-expr.h"
+#include "column-math-expr.h"
+
+#define ROWS (3 * COLUMN_BLOCK + 17)
+
+#define CHECK(condition) do{ \
+	if(!(condition)){ \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+		exit(1); \
+	} \
+}while(0)
+
+int main(void)
+{
+	static const char* isas[] = {"sse2", "avx2", "avx512"};
+	static const char* texts[] = {"sqrt(x)", "exp(x)", "log(x)", "sin(x)", "abs(x)", "min(x, y)", "max(x, y)",
+		"sin(exp(x)) + min(abs(x), 2)*log(y)"};
+	static const double special[] = {0.0, -0.0, 1.0, -1.0, 1e-310, -1e-310, 709.8, -745.2, 1e6, 3e9, -1e22, 1e300,
+		INFINITY, -INFINITY, NAN};
+	static double x[ROWS], y[ROWS], out[ROWS];
+	const double* columns[2] = {x, y};
+	struct plan_context ctx;
+	struct plan* plan;
+	unsigned int slot, t, k, i;
+	uint64_t seed = 42;
+	size_t error_at;
+
+	for(i = 0; i < ROWS; i++){
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		x[i] = i < sizeof(special) / sizeof(special[0]) ? special[i] : ((double)(seed >> 11) * 0x1p-53 - 0.5) * 80.0;
+		y[i] = ROWS - i < sizeof(special) / sizeof(special[0]) ? special[ROWS - i] : (double)(seed & 0xff) / 16.0;
+	}
+
+	CHECK(plan_context_init(&ctx) == 'n');
+	CHECK(plan_symbol(&ctx, "x", 1, &slot) == 'n' && slot == 0);
+	CHECK(plan_symbol(&ctx, "y", 1, &slot) == 'n' && slot == 1);
+	for(t = 0; t < sizeof(texts) / sizeof(texts[0]); t++){
+		plan_context_reset(&ctx);
+		CHECK(compile_plan(&ctx, texts[t], strlen(texts[t]), &plan, &error_at) == 'n');
+		for(k = 0; k < sizeof(isas) / sizeof(isas[0]); k++){
+			if(column_isa(isas[k]) != 'n')
+				continue;  // not an instruction set of this CPU
+			evaluate_plan_rows(plan, columns, 2, 0, ROWS, out);
+			for(i = 0; i < ROWS; i++){
+				double vars[2] = {x[i], y[i]};
+				double expected = evaluate_plan(plan, vars);
+
+				if(memcmp(&expected, &out[i], sizeof(double)) != 0 && !(isnan(expected) && isnan(out[i]))){
+					fprintf(stderr, "%s with %s at x=%a y=%a: %a instead of %a\n", texts[t], isas[k], x[i], y[i], out[i], expected);
+					return 1;
+				}
+			}
+		}
+	}
+	plan_context_release(&ctx);
+	return 0;
+}
@@ -0,0 +1,89 @@
+/* The block evaluator reads variables and constants in place by the operator
+   that follows them ("v v op", "v c op", "c v op", "x v op", ...) and keeps the
+   whole plan in one pass over each block. With every instruction set of the
+   CPU it gives the same bits as evaluate_plan() row by row, for these fused
+   patterns, for integer subexpressions and after an integer overflow makes it
+   widen to doubles, and over ranges that do not start on a block. */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "plan-math-expr.h"
+#include "column-math-expr.h"
+
+#define ROWS (4 * COLUMN_BLOCK + 29)
+
+#define CHECK(condition) do{ \
+	if(!(condition)){ \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+		exit(1); \
+	} \
+}while(0)
+
+int main(void)
+{
+	static const char* isas[] = {"sse2", "avx2", "avx512"};
+	static const char* texts[] = {
+		"x*y + x*2 - 3", "a*b + c*d - e", "3 - x", "1/x", "x/y", "2/3 + x", "x*x*x - y/x",
+		"(x + 1)*(y - 2)/(x - y)", "-x + y^2 - x^y", "2*3 + x", "2^10 - x*(7 - 4)", "x + (2 - 5)*3",
+		"x*(3^40 + 1)", "x + (9223372036854775807 + 1)*2", "4", "3 - 1*2", "y"};
+	static const uint64_t ranges[][2] = {{0, ROWS}, {1, ROWS - 1}, {COLUMN_BLOCK - 3, 2 * COLUMN_BLOCK + 5},
+		{77, 78}, {ROWS - 29, ROWS}, {5, 5}};
+	static double x[ROWS], y[ROWS], c[ROWS], d[ROWS], e[ROWS], out[ROWS];
+	const double* columns[7] = {x, y, c, d, e, x, y};  // a and b are x and y again
+	struct plan_context ctx;
+	struct plan* plan;
+	unsigned int slot, t, k, r;
+	uint64_t seed = 7, i;
+	size_t error_at;
+
+	for(i = 0; i < ROWS; i++){
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		x[i] = ((double)(seed >> 11) * 0x1p-53 - 0.25) * 20.0;
+		y[i] = (double)(seed & 0xfff) / 64.0 - 8.0;
+		c[i] = (double)(seed >> 40);
+		d[i] = i % 17 == 0 ? 0.0 : 1.0 / (double)i;
+		e[i] = (double)i;
+	}
+
+	CHECK(plan_context_init(&ctx) == 'n');
+	CHECK(plan_symbol(&ctx, "x", 1, &slot) == 'n' && slot == 0);
+	CHECK(plan_symbol(&ctx, "y", 1, &slot) == 'n' && slot == 1);
+	CHECK(plan_symbol(&ctx, "c", 1, &slot) == 'n' && slot == 2);
+	CHECK(plan_symbol(&ctx, "d", 1, &slot) == 'n' && slot == 3);
+	CHECK(plan_symbol(&ctx, "e", 1, &slot) == 'n' && slot == 4);
+	CHECK(plan_symbol(&ctx, "a", 1, &slot) == 'n' && slot == 5);
+	CHECK(plan_symbol(&ctx, "b", 1, &slot) == 'n' && slot == 6);
+	for(t = 0; t < sizeof(texts) / sizeof(texts[0]); t++){
+		plan_context_reset(&ctx);
+		CHECK(compile_plan(&ctx, texts[t], strlen(texts[t]), &plan, &error_at) == 'n');
+		for(k = 0; k < sizeof(isas) / sizeof(isas[0]); k++){
+			if(column_isa(isas[k]) != 'n')
+				continue;  // not an instruction set of this CPU
+			for(r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++){
+				const uint64_t first = ranges[r][0], last = ranges[r][1];
+
+				for(i = 0; i < ROWS; i++)
+					out[i] = -1.5;
+				evaluate_plan_rows(plan, columns, 7, first, last, out);
+				for(i = 0; i < ROWS; i++){
+					double vars[7] = {x[i], y[i], c[i], d[i], e[i], x[i], y[i]};
+					double expected = i >= first && i < last ? evaluate_plan(plan, vars) : -1.5;
+
+					if(memcmp(&expected, &out[i], sizeof(double)) != 0 && !(isnan(expected) && isnan(out[i]))){
+						fprintf(stderr, "%s with %s on [%llu, %llu) at row %llu: %a instead of %a\n", texts[t], isas[k],
+							(unsigned long long)first, (unsigned long long)last, (unsigned long long)i, out[i], expected);
+						return 1;
+					}
+				}
+			}
+		}
+	}
+	plan_context_release(&ctx);
+	return 0;
+}
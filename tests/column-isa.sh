@@ -0,0 +1,38 @@
+# Every instruction set of the CPU, forced by --isa or MATH_EXPR_ISA, writes the
+# same column and prints the same aggregates; an instruction set that is not
+# one of the CPU is ignored with a warning, an unknown --isa is an error, and
+# the benchmark times the blocks and the reductions of each instruction set.
+
+# 1.0, 2.0, 0.5 and -3.0 as little-endian doubles, over 2 blocks and a partial one
+for i in $(seq 75); do
+	printf '\0\0\0\0\0\0\360\077\0\0\0\0\0\0\0\100\0\0\0\0\0\0\340\077\0\0\0\0\0\0\010\300'
+done > $TMP/isa-x.raw
+expr='sin(x)*exp(x) + sqrt(abs(x))/(x + 4) - min(x, 1)^3'
+
+$CALC --expr "$expr" --column x=$TMP/isa-x.raw --output $TMP/isa-reference.raw --raw-output
+[ $(wc -c < $TMP/isa-reference.raw) -eq 2400 ]
+$CALC --expr "sum($expr)" --column x=$TMP/isa-x.raw --precision 17 > $TMP/isa-reference.sum
+for isa in sse2 avx2 avx512; do
+	$CALC --expr "sum(x)" --column x=$TMP/isa-x.raw --isa $isa > /dev/null 2> $TMP/isa.errors || {
+		grep -q "^This CPU does not support --isa $isa$" $TMP/isa.errors
+		continue
+	}
+	$CALC --expr "$expr" --column x=$TMP/isa-x.raw --isa $isa --output $TMP/isa.raw --raw-output
+	cmp -s $TMP/isa-reference.raw $TMP/isa.raw
+	MATH_EXPR_ISA=$isa $CALC --expr "$expr" --column x=$TMP/isa-x.raw --output $TMP/isa.raw --raw-output 2> $TMP/isa.errors
+	cmp -s $TMP/isa-reference.raw $TMP/isa.raw
+	[ ! -s $TMP/isa.errors ]
+	MATH_EXPR_ISA=$isa $CALC --expr "sum($expr)" --column x=$TMP/isa-x.raw --precision 17 > $TMP/isa.sum
+	cmp -s $TMP/isa-reference.sum $TMP/isa.sum
+done
+
+MATH_EXPR_ISA=foo $CALC --expr "$expr" --column x=$TMP/isa-x.raw --output $TMP/isa.raw --raw-output 2> $TMP/isa.errors
+cmp -s $TMP/isa-reference.raw $TMP/isa.raw
+grep -q '^Ignoring MATH_EXPR_ISA=foo: not an instruction set of this CPU, using \(sse2\|avx2\|avx512\)$' $TMP/isa.errors
+
+$CALC --expr "sum(x)" --column x=$TMP/isa-x.raw --isa bogus 2> $TMP/isa.errors && exit 1
+grep -q '^--isa must be sse2, avx2 or avx512$' $TMP/isa.errors
+
+$BENCH --columns > $TMP/isa-bench.out
+grep -q '^blocks   sse2 ' $TMP/isa-bench.out
+grep -q '^reduce   sse2 ' $TMP/isa-bench.out
@@ -0,0 +1,17 @@
+# A column table with no rows: the outputs are empty and the aggregates are
+# those of no rows, with and without --raw-output.
+
+# the 16-byte header of one column "x" and no rows, its name padded to the first 64-byte boundary
+{ printf 'MXC1\001\000\000\000\000\000\000\000\000\000\000\000x'; head -c 47 /dev/zero; } > $TMP/zero-rows.bin
+
+$CALC --expr 'x*2' --input $TMP/zero-rows.bin --output $TMP/zero-rows.raw --raw-output
+test ! -s $TMP/zero-rows.raw
+$CALC --expr 'x*2' --input $TMP/zero-rows.bin --output $TMP/zero-rows.out --workers 4
+$CALC --expr 'sum(result)' --input $TMP/zero-rows.out | grep -qx '0.000'
+
+for aggregate in 'sum(x)' 'dot(x, x)'; do
+	$CALC --expr "$aggregate" --input $TMP/zero-rows.bin --workers 4 | grep -qx '0.000'
+done
+for aggregate in 'mean(x)' 'min(x)' 'max(x)'; do
+	$CALC --expr "$aggregate" --input $TMP/zero-rows.bin --workers 4 | grep -qx 'nan'
+done
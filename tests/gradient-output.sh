@@ -0,0 +1,11 @@
+# --gradient follows each result with its partial derivatives in the order of
+# the bindings; a line in error prints its error alone, and the option does
+# not combine with the pipeline or an exact arithmetic.
+
+printf 'x*y^2\nx^y\n2^3\nmin(x, y) + abs(x-y)\nz\n(x\n' | $CALC --batch --gradient --var x=3 --var y=2 > $TMP/gradient.out
+printf '%s\n' '12.000 [4.000, 12.000]' '9.000 [6.000, 9.888]' '8.000 [0.000, 0.000]' '3.000 [1.000, 0.000]' \
+	'UNDEFINED VARIABLE' 'SYNTAX ERROR' | cmp -s - $TMP/gradient.out
+
+printf 'x\n' | $CALC --batch --gradient --pipeline --var x=1 > /dev/null 2>&1 && exit 1
+printf 'x\n' | $CALC --batch --gradient --rational --var x=1 > /dev/null 2>&1 && exit 1
+exit 0
@@ -0,0 +1,87 @@
+/* Forward and reverse mode give the gradients of the derivation rules, for
+   constant and variable exponents and the built-in functions, and forward mode
+   gives the same derivatives when its directions span several passes of
+   DIFF_LANES. */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "plan-math-expr.h"
+#include "diff-math-expr.h"
+
+#define VARS 3
+#define DIRECTIONS 6
+
+#define CHECK(condition) do{ \
+	if(!(condition)){ \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+		exit(1); \
+	} \
+}while(0)
+
+static int close_to(double a, double b)
+{
+	return fabs(a - b) <= 1e-12 * (fabs(b) > 1 ? fabs(b) : 1);
+}
+
+int main(void)
+{
+	const double x = 1.3, y = 0.7, z = 2.1, s = x + y + z;
+	const struct {
+		const char* text;
+		double gradient[VARS];
+	} cases[] = {
+		{"x*y^2", {y * y, 2 * x * y, 0}},
+		{"x^y", {y * pow(x, y - 1), pow(x, y) * log(x), 0}},
+		{"y^3", {0, 3 * y * y, 0}},
+		{"2^x", {pow(2, x) * log(2), 0, 0}},
+		{"sin(x)*exp(y)", {cos(x) * exp(y), sin(x) * exp(y), 0}},
+		{"log(x*z)/sqrt(y)", {1 / (x * sqrt(y)), -0.5 * log(x * z) / (y * sqrt(y)), 1 / (z * sqrt(y))}},
+		{"min(x, y)*max(y, z) + abs(y-z)", {0, z - 1, y + 1}},
+		{"(x+y+z)^-2", {-2 / (s * s * s), -2 / (s * s * s), -2 / (s * s * s)}},
+		{"-x/(y-z) + 4", {-1 / (y - z), x / ((y - z) * (y - z)), -x / ((y - z) * (y - z))}},
+	};
+	// the unit directions, then combinations of them
+	static const double seeds[DIRECTIONS][VARS] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {1, 1, 0}, {0, 0, 2}, {1, -1, 1}};
+	const double vars[VARS] = {x, y, z};
+	double gradient[VARS], tangents[DIRECTIONS], value;
+	struct plan_context ctx;
+	struct diff_tape tape;
+	struct plan* plan;
+	unsigned int c, d, v, slot;
+	size_t error_at;
+
+	CHECK(plan_context_init(&ctx) == 'n');
+	CHECK(plan_symbol(&ctx, "x", 1, &slot) == 'n' && slot == 0);
+	CHECK(plan_symbol(&ctx, "y", 1, &slot) == 'n' && slot == 1);
+	CHECK(plan_symbol(&ctx, "z", 1, &slot) == 'n' && slot == 2);
+	for(c = 0; c < sizeof(cases) / sizeof(cases[0]); c++){
+		plan_context_reset(&ctx);
+		CHECK(compile_plan(&ctx, cases[c].text, strlen(cases[c].text), &plan, &error_at) == 'n');
+		CHECK(diff_tape_init(&ctx, plan, &tape) == 'n');
+
+		value = diff_reverse(plan, vars, &tape, VARS, gradient);
+		CHECK(value == evaluate_plan(plan, vars));
+		for(v = 0; v < VARS; v++)
+			if(!close_to(gradient[v], cases[c].gradient[v])){
+				fprintf(stderr, "d/d%c %s: %.17g instead of %.17g\n", "xyz"[v], cases[c].text, gradient[v], cases[c].gradient[v]);
+				return 1;
+			}
+
+		CHECK(diff_forward(plan, vars, &seeds[0][0], VARS, DIRECTIONS, tangents) == value);
+		for(d = 0; d < DIRECTIONS; d++){
+			double expected = 0;
+
+			for(v = 0; v < VARS; v++)
+				expected += seeds[d][v] * cases[c].gradient[v];
+			if(!close_to(tangents[d], expected)){
+				fprintf(stderr, "direction %u of %s: %.17g instead of %.17g\n", d, cases[c].text, tangents[d], expected);
+				return 1;
+			}
+		}
+	}
+	plan_context_release(&ctx);
+	return 0;
+}
@@ -0,0 +1,11 @@
+# Bytes above 0x7f are syntax errors, in the interactive calculator and in batch
+# mode, and never index the parser windows with a negative char.
+
+for line in '1+\351' '\3512' '2*\377' '(1+\200)*3' '12\351+1'; do
+	printf "$line\n" | $CALC > $TMP/high-bit.out && exit 1
+	printf '\nSYNTAX ERROR\n' | cmp -s - $TMP/high-bit.out
+done
+printf '1+2\n' | $CALC | grep -qx '3.000'
+
+printf '1+\351\n\3512\n(1+\200)*3\n2*3\n' | $CALC --batch > $TMP/high-bit.out
+printf 'SYNTAX ERROR\nSYNTAX ERROR\nSYNTAX ERROR\n6.000\n' | cmp -s - $TMP/high-bit.out
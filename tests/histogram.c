@@ -0,0 +1,67 @@
+/* The latency histograms: the percentiles of known values are within 1/64 of
+   the exact ones and never above the maximum, every uint64_t is recorded, a
+   merge adds counts and keeps the extremes, and an empty histogram reads 0. */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "histogram-math-expr.h"
+
+#define CHECK(condition) do{ \
+	if(!(condition)){ \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+		exit(1); \
+	} \
+}while(0)
+
+/* 'value' is 'exact' to the precision of the buckets */
+static int near(uint64_t value, uint64_t exact)
+{
+	uint64_t error = value > exact ? value - exact : exact - value;
+
+	return error <= exact / 64;
+}
+
+int main(void)
+{
+	static struct histogram a, b, merged;
+	static const double percentiles[] = {0, 1, 50, 90, 99, 99.9, 100};
+	uint64_t value;
+	unsigned int p;
+
+	histogram_init(&a);
+	CHECK(a.count == 0 && histogram_value_at(&a, 50) == 0);
+
+	// 1..100000 ns: the value at p percent is p * 1000
+	for(value = 1; value <= 100000; value++)
+		histogram_record(&a, value);
+	CHECK(a.count == 100000 && a.min == 1 && a.max == 100000 && a.total == 100000ull * 100001 / 2);
+	for(p = 0; p < sizeof(percentiles) / sizeof(percentiles[0]); p++){
+		uint64_t exact = percentiles[p] == 0 ? 1 : (uint64_t)(percentiles[p] * 1000);
+
+		value = histogram_value_at(&a, percentiles[p]);
+		if(!near(value, exact) || value > a.max){
+			fprintf(stderr, "p%g: %llu instead of %llu\n", percentiles[p], (unsigned long long)value, (unsigned long long)exact);
+			return 1;
+		}
+	}
+	// below 2^HISTOGRAM_SUB_BITS every value is exact
+	histogram_init(&b);
+	for(value = 0; value < 100; value++)
+		histogram_record(&b, value);
+	CHECK(histogram_value_at(&b, 50) == 49 && histogram_value_at(&b, 100) == 99);
+
+	// the extremes of uint64_t have buckets
+	histogram_record(&b, UINT64_MAX);
+	histogram_record(&b, (uint64_t)1 << 63);
+	CHECK(b.max == UINT64_MAX && histogram_value_at(&b, 100) == UINT64_MAX);
+	CHECK(near(histogram_value_at(&b, 99.5), (uint64_t)1 << 63));
+
+	histogram_init(&merged);
+	histogram_merge(&merged, &a);
+	histogram_merge(&merged, &b);
+	CHECK(merged.count == a.count + b.count);
+	CHECK(merged.min == 0 && merged.max == UINT64_MAX);
+	CHECK(near(histogram_value_at(&merged, 50), 50000 - 50));
+	return 0;
+}
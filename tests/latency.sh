@@ -0,0 +1,43 @@
+# --latency reports on stderr the count and percentiles of the parse, compile
+# and evaluate phases of every expression, as text or JSON, in batch and in
+# pipeline mode, at the end of the run and again whenever SIGUSR1 arrives.
+
+seq 1000 | sed 's/$/*x + 1/' > $TMP/latency.in
+for mode in '' '--pipeline --workers 2'; do
+	$CALC --batch $mode --var x=2 --latency text < $TMP/latency.in > $TMP/latency.out 2> $TMP/latency.errors
+	[ $(wc -l < $TMP/latency.out) -eq 1000 ]
+	head -n 1 $TMP/latency.errors | grep -q '^phase  *count  *mean ns  *min  *p50  *p99  *p99.9  *max$'
+	for phase in parse compile evaluate; do
+		# the count, then min <= p50 <= p99 <= p99.9 <= max
+		awk -v phase=$phase '$1 == phase { found = 1; if($2 != 1000 || $4 > $5 || $5 > $6 || $6 > $7 || $7 > $8) exit 1 } END { exit !found }' $TMP/latency.errors
+	done
+	grep -q '^1000 expressions in [0-9.]* s, [0-9]* expressions/s$' $TMP/latency.errors
+
+	$CALC --batch $mode --var x=2 --latency json < $TMP/latency.in > /dev/null 2> $TMP/latency.errors
+	grep -q '^{"expressions": 1000, "seconds": [0-9.]*, "expr_per_s": [0-9]*, "phases": \[$' $TMP/latency.errors
+	[ $(grep -c '^  {"phase": "\(parse\|compile\|evaluate\)", "count": 1000, "mean_ns": [0-9.]*, "min_ns": [0-9]*, "p50_ns": [0-9]*, "p99_ns": [0-9]*, "p999_ns": [0-9]*, "max_ns": [0-9]*}' $TMP/latency.errors) -eq 3 ]
+	tail -c 4 $TMP/latency.errors | grep -q '^}]}$'
+done
+
+# SIGUSR1 once the handler is installed (bit 10 of the caught signals), then more lines
+for mode in '' '--pipeline --workers 2'; do
+	rm -f $TMP/latency.fifo
+	mkfifo $TMP/latency.fifo
+	$CALC --batch $mode --latency text < $TMP/latency.fifo > $TMP/latency.out 2> $TMP/latency.errors &
+	exec 3> $TMP/latency.fifo
+	printf '1+1\n' >&3
+	for i in $(seq 100); do
+		[ $(( 0x$(sed -n 's/^SigCgt:\t*//p' /proc/$!/status) >> 9 & 1 )) -eq 1 ] && break
+		sleep 0.1
+	done
+	kill -USR1 $!
+	printf '2+2\n3+3\n' >&3
+	exec 3>&-
+	wait $!
+	printf '2.000\n4.000\n6.000\n' | cmp -s - $TMP/latency.out
+	[ $(grep -c '^phase ' $TMP/latency.errors) -eq 2 ]
+	[ $(grep -c '^[0-9]* expressions in ' $TMP/latency.errors) -eq 2 ]
+done
+
+$CALC --batch --latency xml < /dev/null 2> $TMP/latency.errors && exit 1
+grep -q '^--latency must be text or json$' $TMP/latency.errors
@@ -0,0 +1,39 @@
+# The column workers write and reduce the same values whether or not they are
+# placed on the NUMA nodes, --profile reports the rows of every node, and the
+# pipeline takes a CPU list or one CPU per core for --affinity and refuses a
+# malformed list.
+
+# 1.0, 2.0, 0.5 and -3.0 as little-endian doubles, 4 * 2^12 rows
+printf '\0\0\0\0\0\0\360\077\0\0\0\0\0\0\0\100\0\0\0\0\0\0\340\077\0\0\0\0\0\0\010\300' > $TMP/numa-x.raw
+for i in $(seq 12); do
+	cat $TMP/numa-x.raw $TMP/numa-x.raw > $TMP/numa-x2.raw
+	mv $TMP/numa-x2.raw $TMP/numa-x.raw
+done
+expr='x*x - 3*x + 1/x'
+
+$CALC --expr "$expr" --column x=$TMP/numa-x.raw --output $TMP/numa-one.raw --raw-output
+$CALC --expr "$expr" --column x=$TMP/numa-x.raw --workers 4 --output $TMP/numa.raw --raw-output
+cmp -s $TMP/numa-one.raw $TMP/numa.raw
+$CALC --expr "$expr" --column x=$TMP/numa-x.raw --workers 4 --no-numa --output $TMP/numa.raw --raw-output
+cmp -s $TMP/numa-one.raw $TMP/numa.raw
+# 4096 * ((1 - 3 + 1) + (4 - 6 + 0.5) + (0.25 - 1.5 + 2) + (9 + 9 - 1/3))
+[ "$($CALC --expr "sum($expr)" --column x=$TMP/numa-x.raw --workers 4 --precision 3)" = "65194.667" ]
+[ "$($CALC --expr "sum($expr)" --column x=$TMP/numa-x.raw --workers 4 --no-numa --precision 3)" = "65194.667" ]
+
+# every row is counted once among the nodes
+$CALC --expr "sum($expr)" --column x=$TMP/numa-x.raw --workers 3 --profile > /dev/null 2> $TMP/numa.profile
+grep -q '^node [0-9]*: [0-9]* workers, [0-9]* rows in ' $TMP/numa.profile
+[ "$(awk '/^node / { workers += $3; rows += $5 } END { print workers, rows }' $TMP/numa.profile)" = '3 16384' ]
+
+printf '1+2\n3*4\n' > $TMP/numa.in
+printf '3.000\n12.000\n' > $TMP/numa.expected
+for cpus in 0 0,0 cores; do
+	$CALC --batch --pipeline --workers 2 --affinity $cpus < $TMP/numa.in > $TMP/numa.out
+	cmp -s $TMP/numa.expected $TMP/numa.out
+done
+for cpus in 0-x 3-1 1, '' 1024 -1; do
+	$CALC --batch --pipeline --affinity "$cpus" < $TMP/numa.in > /dev/null 2> $TMP/numa.errors && exit 1
+	grep -q '^Invalid CPU list$' $TMP/numa.errors
+done
+$CALC --batch --affinity 0 < $TMP/numa.in 2> $TMP/numa.errors && exit 1
+grep -q '^--affinity and --io-cpus need --batch --pipeline$' $TMP/numa.errors
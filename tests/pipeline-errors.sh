@@ -0,0 +1,30 @@
+# The error column of the pipeline numbers the lines across batches and workers
+# as batch mode does, and a pipeline that cannot start stops the threads it
+# created and fails without output.
+
+awk 'BEGIN {
+	for(i = 1; i <= 3000; i++){
+		if(i % 97 == 0) print "(" i "+"
+		else if(i % 131 == 0) print "y*" i
+		else if(i % 499 == 0) printf "%*s\n", 100000, i "+1)"
+		else print i "*x"
+	}
+}' > $TMP/pipeline-errors.in
+
+$CALC --batch --var x=2 --errors $TMP/pipeline-errors.batch-errors < $TMP/pipeline-errors.in > $TMP/pipeline-errors.batch
+[ $(wc -l < $TMP/pipeline-errors.batch-errors) -eq 58 ]
+head -n 2 $TMP/pipeline-errors.batch-errors > $TMP/pipeline-errors.head
+printf '97\tsyntax\t4\t\n131\tundefined-variable\t0\ty\n' | cmp -s - $TMP/pipeline-errors.head
+grep -qx "2994	syntax	99999	)" $TMP/pipeline-errors.batch-errors
+for workers in 1 2 5; do
+	$CALC --batch --pipeline --workers $workers --var x=2 --errors $TMP/pipeline-errors.errors < $TMP/pipeline-errors.in > $TMP/pipeline-errors.out
+	cmp -s $TMP/pipeline-errors.batch $TMP/pipeline-errors.out
+	cmp -s $TMP/pipeline-errors.batch-errors $TMP/pipeline-errors.errors
+done
+
+# the thread stacks of 64 workers do not fit in 100 MB of address space
+(ulimit -v 100000; timeout 10 $CALC --batch --pipeline --workers 64 --errors $TMP/pipeline-errors.errors \
+	< $TMP/pipeline-errors.in > $TMP/pipeline-errors.out 2> $TMP/pipeline-errors.stderr) && exit 1
+[ $? -ne 124 ]
+grep -q '^Cannot start the pipeline' $TMP/pipeline-errors.stderr
+test ! -s $TMP/pipeline-errors.out
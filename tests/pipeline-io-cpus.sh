@@ -0,0 +1,51 @@
+# --io-cpus R,W pins the reader to R and the writer to W, and keeps both CPUs
+# free of workers: no thread may inherit the reader's CPU.
+
+allowed=$(awk '/^Cpus_allowed_list/ {
+	n = split($2, ranges, ",")
+	for(i = 1; i <= n; i++){
+		if(split(ranges[i], bounds, "-") == 1)
+			bounds[2] = bounds[1]
+		for(c = bounds[1]; c <= bounds[2]; c++)
+			printf "%d ", c
+	}
+}' /proc/self/status)
+set -- $allowed
+if [ $# -lt 3 ]; then
+	# the I/O CPUs take every CPU: none is left for the workers
+	printf '1+1\n' | $CALC --batch --pipeline --io-cpus $1,${2:-$1} > /dev/null 2>&1 && exit 1
+	exit 0
+fi
+reader=$1
+writer=$2
+
+# every thread is pinned as expected: the reader is the main thread
+placed(){
+	[ $(ls /proc/$pid/task | wc -l) -eq 4 ] || return 1
+	for task in /proc/$pid/task/*; do
+		cpus=$(awk '/^Cpus_allowed_list/ {print $2}' $task/status)
+		if [ ${task##*/} -eq $pid ]; then
+			[ "$cpus" = "$reader" ] || return 1
+		elif [ "$cpus" = "$writer" ]; then
+			writers=$((writers + 1))
+		else
+			case "$cpus" in *[,-]*|"$reader") return 1;; esac
+		fi
+	done
+}
+
+rm -f $TMP/io-cpus.fifo
+mkfifo $TMP/io-cpus.fifo
+$CALC --batch --pipeline --workers 2 --io-cpus $reader,$writer < $TMP/io-cpus.fifo > $TMP/io-cpus.out &
+pid=$!
+exec 3> $TMP/io-cpus.fifo
+printf '1+1\n' >&3
+tries=0
+until writers=0 && placed && [ $writers -eq 1 ]; do
+	tries=$((tries + 1))
+	[ $tries -lt 100 ] || { exec 3>&-; wait $pid; exit 1; }
+	sleep 0.05
+done
+exec 3>&-
+wait $pid
+printf '2.000\n' | cmp -s - $TMP/io-cpus.out
@@ -0,0 +1,24 @@
+# Lines longer than a pipeline batch (64 KiB) are evaluated as in batch mode,
+# in input order, the last one also without a final newline.
+
+long(){
+	printf '%s' "$1"
+	yes "$2" | head -n $3 | tr -d '\n'
+}
+{
+	printf '1+2\n'
+	long 1 +0 40000; printf '\n'
+	printf '2*3\n'
+	long '' ' ' 150000; printf '7\n'
+	long 2 '+(0' 30000; printf '\n'
+	printf 'x+\n'
+	long 5 +1 70000
+} > $TMP/long-lines.in
+
+$CALC --batch --errors $TMP/long-lines.batch-errors < $TMP/long-lines.in > $TMP/long-lines.batch
+printf '3.000\n1.000\n6.000\n7.000\nTOO DEEP\nSYNTAX ERROR\n70005.000\n' | cmp -s - $TMP/long-lines.batch
+for workers in 1 3; do
+	$CALC --batch --pipeline --workers $workers --errors $TMP/long-lines.errors < $TMP/long-lines.in > $TMP/long-lines.out
+	cmp -s $TMP/long-lines.batch $TMP/long-lines.out
+	cmp -s $TMP/long-lines.batch-errors $TMP/long-lines.errors
+done
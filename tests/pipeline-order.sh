@@ -0,0 +1,24 @@
+# The pipeline writes the results in input order for any number of workers,
+# also when its output is read late, and a writer that cannot write holds the
+# reader back instead of letting batches pile up in memory.
+
+awk 'BEGIN { for(i = 1; i <= 200000; i++) print i % 7 == 0 ? "(" i : i "*x+" i % 13 }' > $TMP/order.in
+$CALC --batch --var x=3 < $TMP/order.in > $TMP/order.batch
+for workers in 1 2 4 7; do
+	$CALC --batch --pipeline --workers $workers --var x=3 < $TMP/order.in > $TMP/order.out
+	cmp -s $TMP/order.batch $TMP/order.out
+done
+$CALC --batch --pipeline --workers 3 --var x=3 < $TMP/order.in | { sleep 1; cat; } > $TMP/order.out
+cmp -s $TMP/order.batch $TMP/order.out
+
+# backpressure: an endless input and an output nobody reads
+rm -f $TMP/order.fifo
+mkfifo $TMP/order.fifo
+exec 3<> $TMP/order.fifo
+yes '1+2*3' | $CALC --batch --pipeline --workers 2 >&3 &
+pid=$!
+sleep 2
+peak=$(awk '/^VmHWM/ {print $2}' /proc/$pid/status)
+kill $pid
+exec 3>&-
+[ $peak -lt 65536 ]  # kB, while the input goes on forever
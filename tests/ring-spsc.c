@@ -0,0 +1,68 @@
+/* The SPSC ring of the pipeline: a capacity rounds up to a power of two, a full
+   ring refuses a push and an empty one returns NULL, indices keep working once
+   they wrap the slots, and a consumer thread receives every item of a producer
+   thread once and in order. */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ring-math-expr.h"
+
+#define ITEMS 1000000
+
+#define CHECK(condition) do{ \
+	if(!(condition)){ \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+		exit(1); \
+	} \
+}while(0)
+
+static void* produce(void* arg)
+{
+	struct ring* ring = arg;
+	unsigned int spins = 0;
+
+	for(uintptr_t i = 1; i <= ITEMS; i++){
+		while(!ring_push(ring, (void*)i))
+			ring_wait(&spins);
+		spins = 0;
+	}
+	return NULL;
+}
+
+int main(void)
+{
+	struct ring ring;
+	pthread_t producer;
+	unsigned int spins = 0;
+
+	CHECK(ring_init(&ring, 5) == 'n');
+	CHECK(ring.mask == 7);
+	CHECK(ring_pop(&ring) == NULL);
+
+	// fill, refuse, drain: three rounds move the indices past the slots
+	for(uintptr_t round = 0; round < 3; round++){
+		for(uintptr_t i = 1; i <= 8; i++)
+			CHECK(ring_push(&ring, (void*)(round * 8 + i)));
+		CHECK(!ring_push(&ring, (void*)1));
+		for(uintptr_t i = 1; i <= 8; i++)
+			CHECK(ring_pop(&ring) == (void*)(round * 8 + i));
+		CHECK(ring_pop(&ring) == NULL);
+	}
+
+	CHECK(pthread_create(&producer, NULL, produce, &ring) == 0);
+	for(uintptr_t i = 1; i <= ITEMS; i++){
+		void* item;
+
+		while((item = ring_pop(&ring)) == NULL)
+			ring_wait(&spins);
+		spins = 0;
+		CHECK(item == (void*)i);
+	}
+	CHECK(pthread_join(producer, NULL) == 0);
+	CHECK(ring_pop(&ring) == NULL);
+	ring_free(&ring);
+	return 0;
+}
@@ -0,0 +1,19 @@
+# The single expression of calc is printed with --precision or --shortest like
+# a batch line, and --workers takes a number of threads from 1 to 64 only.
+
+printf '1/3\n' | $CALC > $TMP/single.out
+printf '\n0.333\n' | cmp -s - $TMP/single.out
+printf '1/3\n' | $CALC --precision 6 > $TMP/single.out
+printf '\n0.333333\n' | cmp -s - $TMP/single.out
+printf '2/3\n' | $CALC --precision 0 > $TMP/single.out
+printf '\n1\n' | cmp -s - $TMP/single.out
+printf '1/3\n' | $CALC --shortest > $TMP/single.out
+printf '\n0.3333333333333333\n' | cmp -s - $TMP/single.out
+
+for workers in 0 65 -1 2x x '' ' 2' 99999999999999999999; do
+	printf '1\n' | $CALC --batch --pipeline --workers "$workers" > $TMP/single.out 2> $TMP/single.errors && exit 1
+	grep -qx -- '--workers must be between 1 and 64' $TMP/single.errors
+done
+for workers in 1 64; do
+	printf '1+1\n' | $CALC --batch --pipeline --workers $workers | grep -qx '2.000'
+done
@@ -0,0 +1,49 @@
+# --trace writes a Chrome trace_event file: a name for every thread, then its
+# spans as complete events. The pipeline reader, workers and writer account for
+# every byte read, every line evaluated and every byte written, and the column
+# workers for every row.
+
+# the sum of the values of the spans named $1
+total(){
+	sed -n "s/^{\"name\": \"$1\", \"ph\": \"X\", \"pid\": [0-9]*, \"tid\": [0-9]*, \"ts\": [0-9.]*, \"dur\": [0-9.]*, \"args\": {\"value\": \([0-9]*\)}}.*/\1/p" $2 |
+		awk '{ sum += $1 } END { print sum + 0 }'
+}
+# the file is one event per line between the brackets
+well_formed(){
+	[ "$(head -n 1 $1)" = '{"traceEvents": [' ]
+	[ "$(tail -n 1 $1)" = ']}' ]
+	! sed '1d;$d' $1 | grep -v '^{"name": "[a-z_ ]*", "ph": "[MX]", "pid": [0-9]*, "tid": [0-9]*, .*}},\{0,1\}$'
+}
+
+seq 200000 | sed 's/$/*2 + 1/' > $TMP/trace.in
+$CALC --batch --pipeline --workers 2 --trace $TMP/trace.json < $TMP/trace.in > $TMP/trace.out
+well_formed $TMP/trace.json
+for thread in 'reader 0' 'worker 0' 'worker 1' 'writer 0'; do
+	grep -q "\"ph\": \"M\", .*\"args\": {\"name\": \"$thread\"}}" $TMP/trace.json
+done
+[ $(total read $TMP/trace.json) -eq $(wc -c < $TMP/trace.in) ]
+[ $(total evaluate $TMP/trace.json) -eq 200000 ]
+[ $(total write $TMP/trace.json) -eq $(wc -c < $TMP/trace.out) ]
+
+# a line longer than a batch is read into the batch as it grows
+{ printf '1'; yes '+1' | head -n 100000 | tr -d '\n'; printf '\n2*3\n'; } > $TMP/trace.in
+$CALC --batch --pipeline --trace $TMP/trace.json < $TMP/trace.in > /dev/null
+[ $(total read $TMP/trace.json) -eq $(wc -c < $TMP/trace.in) ]
+[ $(total evaluate $TMP/trace.json) -eq 2 ]
+
+# 1.0, 2.0, 0.5 and -3.0 as little-endian doubles, 4000 rows
+for i in $(seq 1000); do
+	printf '\0\0\0\0\0\0\360\077\0\0\0\0\0\0\0\100\0\0\0\0\0\0\340\077\0\0\0\0\0\0\010\300'
+done > $TMP/trace-x.raw
+$CALC --expr 'x*2' --column x=$TMP/trace-x.raw --workers 3 --output $TMP/trace.raw --raw-output --trace $TMP/trace.json
+well_formed $TMP/trace.json
+[ $(grep -c '"ph": "M", .*"args": {"name": "column worker [0-2]"}}' $TMP/trace.json) -eq 3 ]
+[ $(total 'evaluate rows' $TMP/trace.json) -eq 4000 ]
+$CALC --expr 'sum(x*2)' --column x=$TMP/trace-x.raw --workers 3 --trace $TMP/trace.json > /dev/null
+well_formed $TMP/trace.json
+[ $(total 'reduce rows' $TMP/trace.json) -eq 4000 ]
+
+$CALC --batch --trace $TMP/trace.json < /dev/null 2> $TMP/trace.errors && exit 1
+grep -q '^--trace needs --batch --pipeline or --expr$' $TMP/trace.errors
+$CALC --batch --pipeline --trace $TMP/missing/trace.json < /dev/null 2> $TMP/trace.errors
+grep -q "^Cannot write the trace to '$TMP/missing/trace.json'$" $TMP/trace.errors
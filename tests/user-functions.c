@@ -0,0 +1,107 @@
+/* User functions: a short body is inlined and folded with constant arguments,
+   a long one is compiled once and gives the same values as its text, calls
+   nest, and definitions and calls beyond the limits are refused. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "plan-math-expr.h"
+
+#define CHECK(condition) do{ \
+	if(!(condition)){ \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+		exit(1); \
+	} \
+}while(0)
+
+static char define(struct plan_context* ctx, const char* text)
+{
+	return plan_define(ctx, text, strlen(text), NULL);
+}
+
+static char compile(struct plan_context* ctx, const char* text, struct plan** plan)
+{
+	size_t error_at;
+
+	plan_context_reset(ctx);
+	return compile_plan(ctx, text, strlen(text), plan, &error_at);
+}
+
+/* 'call' and 'expansion' compile and give the same value */
+static void same(struct plan_context* ctx, const char* call, const char* expansion, const double* vars)
+{
+	struct plan* plan;
+	double expected;
+
+	CHECK(compile(ctx, expansion, &plan) == 'n');
+	expected = evaluate_plan(plan, vars);
+	CHECK(compile(ctx, call, &plan) == 'n');
+	if(evaluate_plan(plan, vars) != expected){
+		fprintf(stderr, "%s: %.17g instead of %.17g\n", call, evaluate_plan(plan, vars), expected);
+		exit(1);
+	}
+}
+
+int main(void)
+{
+	static const char* big_body = "a*b + a/b + (a-b)*(a+b) + a*a*a - b*b*b + sin(a)*exp(b)/2 + 3*a + 4*b + sqrt(a*a + b*b) + log(a + 10)";
+	const double vars[3] = {1.5, -0.25, 3};  // x, y and r
+	char text[512], chain[64];
+	struct plan_context ctx;
+	struct plan* plan;
+	union plan_value value;
+	unsigned int slot, level;
+	char status;
+
+	CHECK(plan_context_init(&ctx) == 'n');
+	CHECK(plan_symbol(&ctx, "x", 1, &slot) == 'n' && slot == 0);
+	CHECK(plan_symbol(&ctx, "y", 1, &slot) == 'n' && slot == 1);
+
+	// a short body folds with integer arguments into one constant
+	CHECK(define(&ctx, "f(x, y) = x*x + y") == 'n');
+	CHECK(compile(&ctx, "f(3, 1)", &plan) == 'n');
+	CHECK(plan->length == 1);
+	CHECK(evaluate_plan_typed(plan, vars, &value) == 'i' && value.i == 10);
+	same(&ctx, "f(x, y)", "x*x + y", vars);
+	same(&ctx, "f(x+1, y*2) - f(y, x)", "(x+1)*(x+1) + y*2 - (y*y + x)", vars);
+
+	// a long body is compiled once and spliced, its arguments computed once
+	snprintf(text, sizeof(text), "big(a, b) = %s", big_body);
+	CHECK(define(&ctx, text) == 'n');
+	same(&ctx, "big(x, y)", "x*y + x/y + (x-y)*(x+y) + x*x*x - y*y*y + sin(x)*exp(y)/2 + 3*x + 4*y + sqrt(x*x + y*y) + log(x + 10)", vars);
+	same(&ctx, "big(f(x, 1), 2) + 1", "(x*x+1)*2 + (x*x+1)/2 + ((x*x+1)-2)*((x*x+1)+2) + (x*x+1)*(x*x+1)*(x*x+1) - 8 "
+		"+ sin(x*x+1)*exp(2)/2 + 3*(x*x+1) + 8 + sqrt((x*x+1)*(x*x+1) + 4) + log(x*x+1 + 10) + 1", vars);
+
+	// a body calls the functions defined before it only
+	CHECK(define(&ctx, "g(t) = f(t, t) * big(t, 2)") == 'n');
+	same(&ctx, "g(y)", "(y*y + y) * big(y, 2)", vars);
+	// so no recursion: 'r' in its own body is a variable, times (t)
+	CHECK(define(&ctx, "r(t) = r(t) + 1") == 'n');
+	same(&ctx, "r(y)", "r*y + 1", vars);
+
+	// names, parameters and arities
+	CHECK(define(&ctx, "sin(t) = t") == 's');
+	CHECK(define(&ctx, "f(t) = t") == 's');
+	CHECK(define(&ctx, "h(t, t) = t") == 's');
+	CHECK(define(&ctx, "h(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p, q) = a") == 'd');
+	CHECK(define(&ctx, "h(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p) = a + p") == 'n');
+	CHECK(compile(&ctx, "f(1)", &plan) == 's');
+	CHECK(compile(&ctx, "f(1, 2, 3)", &plan) == 's');
+
+	// every level calls the previous one 8 times, until a plan would exceed PLAN_MAX_LENGTH
+	CHECK(define(&ctx, "e0(t) = t + 1") == 'n');
+	status = 'n';
+	for(level = 1; status == 'n'; level++){
+		snprintf(text, sizeof(text), "e%u(t) = e%u(t)+e%u(t)+e%u(t)+e%u(t)+e%u(t)+e%u(t)+e%u(t)+e%u(t)", level,
+			level - 1, level - 1, level - 1, level - 1, level - 1, level - 1, level - 1, level - 1);
+		status = define(&ctx, text);
+		snprintf(chain, sizeof(chain), "e%u(x)", level);
+		if(status == 'n')
+			CHECK(compile(&ctx, chain, &plan) == 'n' && plan->length <= PLAN_MAX_LENGTH);
+	}
+	CHECK(status == 'd');
+	CHECK(level - 1 == 8);  // e7 is about 3*8^7 opcodes, within 2^24, and e8 8 times more
+	plan_context_release(&ctx);
+	return 0;
+}
@@ -0,0 +1,145 @@
+/*!
+	\file trace-math-expr.c
+	\brief
+	This file contains the tracing of the threaded modes. A thread that calls
+	trace_thread() gets a buffer of its own, taken from a global table with one
+	atomic increment, and then records its spans there without any lock or
+	shared write. At exit the buffers are written as a Chrome trace_event JSON
+	file, which chrome://tracing and Perfetto open as one timeline per thread:
+	where the pipeline reader waits for spare batches, where a worker's queue
+	is full, how long each batch takes to evaluate.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "histogram-math-expr.h"
+#include "trace-math-expr.h"
+
+struct trace_buffer {
+	char name[32];
+	uint32_t count;
+	uint64_t dropped;
+	struct trace_event events[TRACE_EVENTS];
+};
+
+char trace_enabled;
+
+static const char* trace_path;
+static struct trace_buffer* buffers[TRACE_MAX_THREADS];
+static unsigned int n_buffers;
+static __thread struct trace_buffer* current;
+
+/*! \fn static void trace_dump(void)
+		\brief
+		This function writes the spans of all the threads to the trace file, run
+		at exit. Timestamps are in microseconds from the first span, as Chrome
+		expects.
+*/
+static void trace_dump(void)
+{
+	unsigned int t, i, count = __atomic_load_n(&n_buffers, __ATOMIC_ACQUIRE);
+	uint64_t origin = UINT64_MAX;
+	const struct trace_event* e;
+	const char* separator = "";
+	int pid = (int)getpid();
+	FILE* file;
+
+	trace_enabled = 0;
+	if(count > TRACE_MAX_THREADS)
+		count = TRACE_MAX_THREADS;
+	for(t = 0; t < count; t++)
+		if(buffers[t] != NULL && buffers[t]->count > 0 && buffers[t]->events[0].start < origin)
+			origin = buffers[t]->events[0].start;
+	if((file = fopen(trace_path, "w")) == NULL){
+		fprintf(stderr, "Cannot write the trace to '%s'\n", trace_path);
+		return;
+	}
+
+	fprintf(file, "{\"traceEvents\": [");
+	for(t = 0; t < count; t++){
+		if(buffers[t] == NULL)
+			continue;
+		fprintf(file, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %u, \"args\": {\"name\": \"%s\"}}",
+			separator, pid, t, buffers[t]->name);
+		separator = ",";
+		for(i = 0; i < buffers[t]->count; i++){
+			e = &buffers[t]->events[i];
+			fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"value\": %llu}}",
+				e->name, pid, t, (double)(e->start - origin) / 1e3, (double)e->duration / 1e3, (unsigned long long)e->value);
+		}
+		if(buffers[t]->dropped > 0)
+			fprintf(stderr, "trace: %s dropped %llu spans\n", buffers[t]->name, (unsigned long long)buffers[t]->dropped);
+	}
+	fprintf(file, "\n]}\n");
+	if(fclose(file) != 0)
+		fprintf(stderr, "Cannot write the trace to '%s'\n", trace_path);
+}
+
+/*! \fn char trace_open(const char* path)
+		\brief
+		This function turns tracing on. The trace is written to 'path' when the
+		process exits, by exit() or by returning from main().
+
+		\return 'n' on success, 'm' if the exit handler cannot be registered.
+*/
+char trace_open(const char* path)
+{
+	trace_path = path;
+	if(atexit(trace_dump) != 0)
+		return 'm';
+	trace_enabled = 1;
+	return 'n';
+}
+
+/*! \fn void trace_thread(const char* name, unsigned int index)
+		\brief
+		This function gives the calling thread a buffer for its spans, shown as
+		"name index" in the trace. A thread that already has one keeps it, and
+		its spans are not recorded when the table or the memory runs out.
+*/
+void trace_thread(const char* name, unsigned int index)
+{
+	struct trace_buffer* buffer;
+	unsigned int slot;
+
+	if(!trace_enabled || current != NULL)
+		return;
+	slot = __atomic_fetch_add(&n_buffers, 1, __ATOMIC_RELAXED);
+	if(slot >= TRACE_MAX_THREADS || (buffer = malloc(sizeof(*buffer))) == NULL)
+		return;
+	snprintf(buffer->name, sizeof(buffer->name), "%s %u", name, index);
+	buffer->count = 0;
+	buffer->dropped = 0;
+	__atomic_store_n(&buffers[slot], buffer, __ATOMIC_RELEASE);
+	current = buffer;
+}
+
+uint64_t trace_clock(void)
+{
+	return histogram_now();
+}
+
+/*! \fn void trace_record(const char* name, uint64_t start, uint64_t value)
+		\brief
+		This function records a span of the calling thread from 'start' to now.
+		Use trace_end() instead, which skips the call when tracing is off.
+*/
+void trace_record(const char* name, uint64_t start, uint64_t value)
+{
+	struct trace_buffer* buffer = current;
+	struct trace_event* e;
+
+	if(buffer == NULL)
+		return;
+	if(buffer->count == TRACE_EVENTS){
+		buffer->dropped++;
+		return;
+	}
+	e = &buffer->events[buffer->count++];
+	e->name = name;
+	e->start = start;
+	e->duration = histogram_now() - start;
+	e->value = value;
+}
@@ -0,0 +1,38 @@
+#ifndef TRACE_MATH_EXPR_H
+#define TRACE_MATH_EXPR_H
+
+#include <stdint.h>
+
+#define TRACE_MAX_THREADS 256
+#define TRACE_EVENTS 65536   // spans kept per thread, the later ones are counted and dropped
+
+/* A span of a thread, a Chrome "complete" event: 'name' must be a string
+   literal, 'value' is shown as its argument (lines, bytes or rows). */
+struct trace_event {
+	const char* name;
+	uint64_t start;     // histogram_now() nanoseconds
+	uint64_t duration;
+	uint64_t value;
+};
+
+extern char trace_enabled;
+
+char trace_open(const char* path);
+void trace_thread(const char* name, unsigned int index);
+uint64_t trace_clock(void);
+void trace_record(const char* name, uint64_t start, uint64_t value);
+
+/* Spans are taken as trace_end("name", trace_begin(), value): when tracing is
+   off, each costs one test of a global that is always false. */
+static inline uint64_t trace_begin(void)
+{
+	return __builtin_expect(trace_enabled, 0) ? trace_clock() : 0;
+}
+
+static inline void trace_end(const char* name, uint64_t start, uint64_t value)
+{
+	if(__builtin_expect(trace_enabled, 0))
+		trace_record(name, start, value);
+}
+
+#endif